@@ -2,8 +2,14 @@
 //                        BMP format
 // This software was developed by James R. Miller and is OPEN SOURCE.
 
+#include <string.h>
+
+#include <mutex>
+
 #include "BMPLoader.h"
 #include "BMPImageReader.h"
+#include "MappedFile.h"
+#include "PixelSwizzle.h"
 
 BMPImageReader::BMPImageReader(const BMPImageReader& b) : ImageReader(b)
 {
@@ -11,30 +17,127 @@ BMPImageReader::BMPImageReader(const BMPImageReader& b) : ImageReader(b)
 
 // Here are the supported constructors
 
-BMPImageReader::BMPImageReader(std::string fileName) :
-	ImageReader(fileName)
+BMPImageReader::BMPImageReader(std::string fileName, FILE* fp) :
+	ImageReader(fileName, fp)
 {
 	readImage();
 }
 
+BMPImageReader::BMPImageReader(const void* bytes, size_t nBytes) :
+	ImageReader(bytes, nBytes)
+{
+	readImage();
+}
+
+// BMP header fields are little-endian
+static int get16(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static int get32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
 bool BMPImageReader::read()
+{
+	// Uncompressed 24- and 32-bit images are converted directly out of the
+	// caller's buffer or a memory map of the file. Everything else (paletted,
+	// RLE, ...) goes through the general purpose loader.
+	if (inputBuffer != nullptr)
+		return readUncompressed(inputBuffer, inputBufferSize) ||
+		       readWithLoader(nullptr);
+
+	FILE* fp = openInputFile();
+	if (fp == nullptr)
+		return false;
+
+	MappedFile file(fileno(fp));
+	bool ok = file.isValid() && readUncompressed(file.getData(), file.getSize());
+	if (!ok)
+	{
+		rewind(fp);
+		ok = readWithLoader(fp);
+	}
+	closeInputFile(fp);
+	return ok;
+}
+
+// Read with BMPLoader from 'fp' or, if it is nullptr, from inputBuffer
+bool BMPImageReader::readWithLoader(FILE* fp)
 {
 	int			widthOut, heightOut, nChannelsOut;
 	unsigned char*	pixels;
 
-	LOAD_TEXTUREBMP_RESULT res = loadBMPData(fullFileName.c_str(),&pixels,
-										widthOut, heightOut, nChannelsOut);
+	// loadBMPData keeps its state in file-scope variables, so only one
+	// thread at a time (see ImageReader::createAll) may use it.
+	static std::mutex loaderMutex;
+	std::unique_lock<std::mutex> lock(loaderMutex);
+	LOAD_TEXTUREBMP_RESULT res;
+	if (fp == nullptr)
+		res = loadBMPData(inputBuffer, inputBufferSize, &pixels,
+						widthOut, heightOut, nChannelsOut);
+	else
+		res = loadBMPData(fp, &pixels, widthOut, heightOut, nChannelsOut);
+	lock.unlock();
 	if ( (pixels == nullptr) || (res != LOAD_TEXTUREBMP_SUCCESS) )
 		return false;
 
+	// The loader's buffer is already laid out as theImage expects, so it is
+	// adopted rather than copied.
 	theImage = new cryph::Packed3DArray<unsigned char>(
-							heightOut, widthOut, nChannelsOut);
-	int nextPixel = 0;
-	for (int i=0 ; i<heightOut ; i++)
-		for (int j=0 ; j<widthOut ; j++)
-			for (int k=0 ; k<nChannelsOut ; k++)
-				theImage->setDataElement(i,j,k,pixels[nextPixel++]);
-	delete [] pixels;
+							heightOut, widthOut, nChannelsOut, pixels,
+							[](unsigned char* p) { delete [] p; });
 
     return true;
 }
+
+// Returns false (without creating theImage) if the file is not an uncompressed
+// 24- or 32-bit BMP whose pixel data is entirely present in 'bytes'.
+bool BMPImageReader::readUncompressed(const unsigned char* bytes, size_t nBytes)
+{
+	// BITMAPFILEHEADER (14 bytes) followed by at least a BITMAPINFOHEADER (40)
+	const size_t HEADER_SIZE = 54;
+	if ((nBytes < HEADER_SIZE) || (bytes[0] != 'B') || (bytes[1] != 'M'))
+		return false;
+	size_t pixelStart = static_cast<unsigned int>(get32(bytes + 10));
+	const unsigned char* info = bytes + 14;
+	if (get32(info) < 40)
+		return false;
+	int width = get32(info + 4);
+	int height = get32(info + 8); // negative => rows stored top-down
+	int bitCount = get16(info + 14);
+	int compression = get32(info + 16);
+	if ((get16(info + 12) != 1) || (compression != 0) ||
+	    ((bitCount != 24) && (bitCount != 32)))
+		return false;
+	bool topDown = (height < 0);
+	if (topDown)
+		height = -height;
+	if ((width <= 0) || (height <= 0))
+		return false;
+
+	int nChannels = bitCount / 8;
+	size_t rowBytes = static_cast<size_t>(width) * nChannels;
+	size_t fileRowBytes = (rowBytes + 3) & ~static_cast<size_t>(3);
+	if ((pixelStart < HEADER_SIZE) ||
+	    (pixelStart + fileRowBytes * height > nBytes))
+		return false;
+
+	theImage = new cryph::Packed3DArray<unsigned char>(height, width, nChannels);
+	unsigned char* image = theImage->getModifiableData();
+	const unsigned char* fileRow = bytes + pixelStart;
+	for (int i=0 ; i<height ; i++, fileRow+=fileRowBytes)
+	{
+		// Our row 0 is the bottom row of the image, as is the first row
+		// stored in a bottom-up BMP.
+		int row = topDown ? (height - 1 - i) : i;
+		unsigned char* imageRow = image + row * rowBytes;
+		if (nChannels == 3)
+			swapRedBlue3(fileRow, imageRow, width);
+		else
+			swapRedBlue4(fileRow, imageRow, width);
+	}
+	return true;
+}
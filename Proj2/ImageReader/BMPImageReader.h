@@ -11,12 +11,17 @@
 class BMPImageReader : public ImageReader
 {
 public:
-	BMPImageReader(std::string fileName);
+	BMPImageReader(std::string fileName, FILE* fp=nullptr);
+	BMPImageReader(const void* bytes, size_t nBytes);
 
 protected:
 	BMPImageReader(const BMPImageReader& s);
 
 	virtual bool read();
+
+private:
+	bool	readUncompressed(const unsigned char* bytes, size_t nBytes);
+	bool	readWithLoader(FILE* fp);
 };
 
 #endif
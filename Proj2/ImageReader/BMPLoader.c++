@@ -20,6 +20,11 @@ using namespace std;
 // The file that the BMP is stored in.
 static FILE* file;
 
+// ...or, if file is nullptr, the memory buffer it is stored in.
+static const unsigned char* memData;
+static size_t memSize;
+static size_t memPos;
+
 // The offset from the BITMAPFILEHEADER structure
 // to the actual bitmap data in the file.
 static long byteOffset;
@@ -47,13 +52,23 @@ static unsigned char palette[3][256];
 // The number of bytes read so far
 static long bytesRead;
 
+// Reads the next byte from the file or memory buffer. Returns EOF at the end.
+static int nextByte()
+{
+  if (file)
+    return fgetc(file);
+  if (memPos < memSize)
+    return memData[memPos++];
+  return EOF;
+}
+
 // Reads and returns a 32-bit value from the file.
 static long read32BitValue()
 {
-  int c1 = fgetc(file);
-  int c2 = fgetc(file);
-  int c3 = fgetc(file);
-  int c4 = fgetc(file);
+  int c1 = nextByte();
+  int c2 = nextByte();
+  int c3 = nextByte();
+  int c4 = nextByte();
   
   bytesRead+=4;
   
@@ -63,8 +78,8 @@ static long read32BitValue()
 // Reads and returns a 16-bit value from the file
 static short read16BitValue()
 {
-  int c1 = fgetc(file);
-  int c2 = fgetc(file);
+  int c1 = nextByte();
+  int c2 = nextByte();
   
   bytesRead+=2;
   
@@ -74,7 +89,7 @@ static short read16BitValue()
 // Reads and returns a 8-bit value from the file
 static unsigned char read8BitValue()
 {
-  unsigned int c1 = fgetc(file);
+  unsigned int c1 = nextByte();
   
   bytesRead+=1;
   
@@ -568,50 +583,15 @@ static LOAD_TEXTUREBMP_RESULT readBitmapData(unsigned char* bitmapData)
   }
 }
 
-// Load the BMP. Assumes that no extension is appended to the filename.
-// If successful *bitmapData will contain a pointer to the data.
-LOAD_TEXTUREBMP_RESULT loadBMP(const char* filename, 
-                               unsigned char** bitmapData)
-{
-  *bitmapData = nullptr; 
-
-  // Append .bmp extension
-  char* str = new char[strlen(filename)+5];
-  if (!str)
-    return LOAD_TEXTUREBMP_OUT_OF_MEMORY;
-
-  strcpy(str,filename);
-  strcat(str,".bmp");
-  int widthOut, heightOut, nChannelsOut;
-  LOAD_TEXTUREBMP_RESULT res = loadBMPData(str,bitmapData,
-		widthOut, heightOut, nChannelsOut);
- 
-  // Clean up
-  delete[] str;
-
-  return res;
-}
-
-LOAD_TEXTUREBMP_RESULT loadBMPData(const char* fName,
-	unsigned char** bitmapData,
+// Reads the BMP from "file" or, if it is nullptr, "memData".
+static LOAD_TEXTUREBMP_RESULT loadBMPDataFromSource(unsigned char** bitmapData,
 	int& widthOut, int& heightOut, int& nChannelsOut)
 {
-  // Open file for buffered read.
-  file = fopen(fName,"rb");
-
-  char readBuffer[BUFSIZ];
+  *bitmapData = nullptr;
 
   LOAD_TEXTUREBMP_RESULT res = LOAD_TEXTUREBMP_SUCCESS;
 
-  if (!file)
-    res = LOAD_TEXTUREBMP_COULD_NOT_FIND_OR_READ_FILE;
-  
-  if (!res)
-  {
-    setbuf(file, readBuffer);
-  
-    bytesRead=0;
-  }
+  bytesRead=0;
 
   // Read File Header
   if (!res)
@@ -642,7 +622,10 @@ LOAD_TEXTUREBMP_RESULT loadBMPData(const char* fName,
 
   // Only clean up bitmapData if there was an error.
   if (*bitmapData && res)
+  {
     delete[] *bitmapData;
+    *bitmapData = nullptr;
+  }
   else
   {
 	widthOut = width;
@@ -650,8 +633,86 @@ LOAD_TEXTUREBMP_RESULT loadBMPData(const char* fName,
 	nChannelsOut = numChannels;
   }
 
-  if (file)
-    fclose(file);
+  return res;
+}
+
+// Load the BMP. Assumes that no extension is appended to the filename.
+// If successful *bitmapData will contain a pointer to the data.
+LOAD_TEXTUREBMP_RESULT loadBMP(const char* filename, 
+                               unsigned char** bitmapData)
+{
+  *bitmapData = nullptr; 
+
+  // Append .bmp extension
+  char* str = new char[strlen(filename)+5];
+  if (!str)
+    return LOAD_TEXTUREBMP_OUT_OF_MEMORY;
+
+  strcpy(str,filename);
+  strcat(str,".bmp");
+  int widthOut, heightOut, nChannelsOut;
+  LOAD_TEXTUREBMP_RESULT res = loadBMPData(str,bitmapData,
+		widthOut, heightOut, nChannelsOut);
+ 
+  // Clean up
+  delete[] str;
+
+  return res;
+}
+
+LOAD_TEXTUREBMP_RESULT loadBMPData(const char* fName,
+	unsigned char** bitmapData,
+	int& widthOut, int& heightOut, int& nChannelsOut)
+{
+  *bitmapData = nullptr;
+
+  // Open file for buffered read.
+  FILE* fp = fopen(fName,"rb");
+  if (!fp)
+    return LOAD_TEXTUREBMP_COULD_NOT_FIND_OR_READ_FILE;
+
+  char readBuffer[BUFSIZ];
+  setbuf(fp, readBuffer);
+
+  LOAD_TEXTUREBMP_RESULT res = loadBMPData(fp,bitmapData,
+		widthOut, heightOut, nChannelsOut);
+
+  fclose(fp);
+
+  return res;
+}
+
+// Load from a file that is already open and positioned at the start of the
+// BMP data. The file is not closed.
+LOAD_TEXTUREBMP_RESULT loadBMPData(FILE* fp,
+	unsigned char** bitmapData,
+	int& widthOut, int& heightOut, int& nChannelsOut)
+{
+  *bitmapData = nullptr;
+  if (!fp)
+    return LOAD_TEXTUREBMP_COULD_NOT_FIND_OR_READ_FILE;
+
+  file = fp;
+  LOAD_TEXTUREBMP_RESULT res = loadBMPDataFromSource(bitmapData,
+		widthOut, heightOut, nChannelsOut);
+  file = nullptr;
+
+  return res;
+}
+
+// Load from the complete contents of a BMP file held in memory.
+LOAD_TEXTUREBMP_RESULT loadBMPData(const unsigned char* bytes, size_t nBytes,
+	unsigned char** bitmapData,
+	int& widthOut, int& heightOut, int& nChannelsOut)
+{
+  file = nullptr;
+  memData = bytes;
+  memSize = nBytes;
+  memPos = 0;
+  LOAD_TEXTUREBMP_RESULT res = loadBMPDataFromSource(bitmapData,
+		widthOut, heightOut, nChannelsOut);
+  memData = nullptr;
+  memSize = 0;
 
   return res;
 }
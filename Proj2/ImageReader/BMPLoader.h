@@ -9,6 +9,8 @@
 #ifndef BMP_LOADER_HEADER
 #define BMP_LOADER_HEADER
 
+#include <stdio.h>
+
 // The following is the function return type. Use this to
 // get information about how the loading operation went.
 
@@ -29,4 +31,13 @@ enum LOAD_TEXTUREBMP_RESULT {
 LOAD_TEXTUREBMP_RESULT loadBMPData(const char* fName,
  unsigned char** bitmapData, int& widthOut, int& heightOut, int& nChannelsOut);
 
+// Same, but reads from an open file positioned at the start of the BMP data.
+// The file is left open.
+LOAD_TEXTUREBMP_RESULT loadBMPData(FILE* fp,
+ unsigned char** bitmapData, int& widthOut, int& heightOut, int& nChannelsOut);
+
+// Same, but reads the complete contents of a BMP file held in memory.
+LOAD_TEXTUREBMP_RESULT loadBMPData(const unsigned char* bytes, size_t nBytes,
+ unsigned char** bitmapData, int& widthOut, int& heightOut, int& nChannelsOut);
+
 #endif
@@ -8,9 +8,9 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <fstream>
 
 #include "ImageReader.h"
+#include "PixelSwizzle.h"
 
 // Known subclasses (needed by factory method "create"):
 #include "BMPImageReader.h"
@@ -32,8 +32,16 @@ ImageReader::ImageReader(const ImageReader&)
 
 // Here are the supported constructors
 
-ImageReader::ImageReader(const std::string& fileName) :
-	theImage(nullptr), fullFileName(fileName), readFailed(false)
+ImageReader::ImageReader(const std::string& fileName, FILE* fp) :
+	theImage(nullptr), fullFileName(fileName), readFailed(false),
+	inputBuffer(nullptr), inputBufferSize(0), inputFile(fp)
+{
+}
+
+ImageReader::ImageReader(const void* bytes, size_t nBytes) :
+	theImage(nullptr), readFailed(false),
+	inputBuffer(static_cast<const unsigned char*>(bytes)),
+	inputBufferSize(nBytes), inputFile(nullptr)
 {
 }
 
@@ -41,16 +49,49 @@ ImageReader::ImageReader(const std::string& fileName) :
 
 ImageReader* ImageReader::create(std::string fileName) // CLASS METHOD
 {
-	std::ifstream seeIfExists(fileName.c_str());
-	if (seeIfExists.good())
-		seeIfExists.close();
-	else
+	FILE* fp = fopen(fileName.c_str(), "rb");
+	if (fp == nullptr)
 	{
 		std::cerr << "ImageReader::create could not open " << fileName
 		          << " for reading.\n";
 		return nullptr;
 	}
-	ImageReader* p = guessFileType(fileName);
+	ImageReader* p = guessFileType(fileName, fp);
+	fclose(fp);
+	return finishCreate(p);
+}
+
+ImageReader* ImageReader::createFromMemory(const void* bytes, size_t nBytes) // CLASS METHOD
+{
+	ImageReader* p = nullptr;
+	if (bytes != nullptr)
+	{
+		switch (fileTypeFromContents(static_cast<const unsigned char*>(bytes), nBytes))
+		{
+			case BMP_TYPE:
+				p = new BMPImageReader(bytes, nBytes);
+				break;
+			case JPEG_TYPE:
+				p = new JPEGImageReader(bytes, nBytes);
+				break;
+			case PNG_TYPE:
+				p = new PNGImageReader(bytes, nBytes);
+				break;
+			case TGA_TYPE:
+				p = new TGAImageReader(bytes, nBytes);
+				break;
+			default:
+				std::cerr << "ImageReader::createFromMemory cannot determine "
+				          << "the type of the image data\n";
+				break;
+		}
+	}
+	return finishCreate(p);
+}
+
+// Common post-processing of a newly read image for the "create" methods
+ImageReader* ImageReader::finishCreate(ImageReader* p) // CLASS METHOD
+{
 	if (p == nullptr)
 		return nullptr;
 
@@ -66,13 +107,11 @@ ImageReader* ImageReader::create(std::string fileName) // CLASS METHOD
 		int nCols = p->theImage->getDim2();
 		cryph::Packed3DArray<unsigned char>* grayImage =
 			new cryph::Packed3DArray<unsigned char>(nRows, nCols, 3);
-		for (int i=0 ; i<nRows ; i++)
-			for (int j=0 ; j<nCols ; j++)
-			{
-				unsigned char b = p->theImage->getDataElement(i,j,0);
-				for (int k=0 ; k<3 ; k++)
-					grayImage->setDataElement(i,j,k,b);
-			}
+		const unsigned char* from = p->theImage->begin();
+		unsigned char* to = grayImage->begin();
+		size_t nPixels = static_cast<size_t>(nRows) * nCols;
+		for (size_t i=0 ; i<nPixels ; i++, to+=3)
+			to[0] = to[1] = to[2] = from[i];
 		delete p->theImage;
 		p->theImage = grayImage;
 	}
@@ -82,22 +121,34 @@ ImageReader* ImageReader::create(std::string fileName) // CLASS METHOD
 		int nCols = p->theImage->getDim2();
 		cryph::Packed3DArray<unsigned char>* imageWithAlpha =
 			new cryph::Packed3DArray<unsigned char>(nRows, nCols, 4);
-		for (int i=0 ; i<nRows ; i++)
-			for (int j=0 ; j<nCols ; j++)
-			{
-				for (int k=0 ; k<3 ; k++)
-				{
-					unsigned char b = p->theImage->getDataElement(i,j,k);
-					imageWithAlpha->setDataElement(i,j,k,b);
-				}
-				imageWithAlpha->setDataElement(i,j,3,255);
-			}
+		const unsigned char* from = p->theImage->begin();
+		unsigned char* to = imageWithAlpha->begin();
+		size_t nPixels = static_cast<size_t>(nRows) * nCols;
+		for (size_t i=0 ; i<nPixels ; i++, from+=3, to+=4)
+		{
+			to[0] = from[0];
+			to[1] = from[1];
+			to[2] = from[2];
+			to[3] = 255;
+		}
 		delete p->theImage;
 		p->theImage = imageWithAlpha;
 	}
 	return p;
 }
 
+cryph::Packed3DArray<unsigned char, cryph::Planar>* ImageReader::createPlanarImage() const
+{
+	int nRows = theImage->getDim1();
+	int nCols = theImage->getDim2();
+	int nChannels = theImage->getDim3();
+	cryph::Packed3DArray<unsigned char, cryph::Planar>* planar =
+		new cryph::Packed3DArray<unsigned char, cryph::Planar>(nRows, nCols, nChannels);
+	deinterleave(theImage->getData(), planar->getModifiableData(),
+		static_cast<size_t>(nRows) * nCols, nChannels);
+	return planar;
+}
+
 int ImageReader::getNumChannels() const
 {
 	return theImage->getDim3();
@@ -113,22 +164,87 @@ int ImageReader::getWidth() const
 	return theImage->getDim2();
 }
 
-ImageReader* ImageReader::guessFileType(const std::string& fileName) // CLASS METHOD
+ImageReader::FileType ImageReader::fileTypeFromContents(
+	const unsigned char* header, size_t n) // CLASS METHOD
+{
+	static const unsigned char pngSignature[] =
+		{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if ((n >= 3) && (header[0] == 0xff) && (header[1] == 0xd8) &&
+	    (header[2] == 0xff))
+		return JPEG_TYPE;
+	if ((n >= 8) && (memcmp(header, pngSignature, 8) == 0))
+		return PNG_TYPE;
+	if ((n >= 2) && (header[0] == 'B') && (header[1] == 'M'))
+		return BMP_TYPE;
+
+	// TGA files have no signature, so check that the 18 byte header is
+	// self-consistent: color map type 0 or 1; a known image type; nonzero
+	// dimensions; a plausible pixel depth; and reserved descriptor bits clear.
+	if (n >= 18)
+	{
+		int colorMapType = header[1];
+		int imageType = header[2];
+		int colorMapEntryBits = header[7];
+		int width = header[12] + header[13] * 256;
+		int height = header[14] + header[15] * 256;
+		int pixelBits = header[16];
+		bool knownImageType = (imageType >= 1 && imageType <= 3) ||
+		                      (imageType >= 9 && imageType <= 11);
+		bool goodColorMap = (colorMapType == 1) ?
+			(colorMapEntryBits == 15 || colorMapEntryBits == 16 ||
+			 colorMapEntryBits == 24 || colorMapEntryBits == 32) :
+			(colorMapType == 0);
+		bool goodDepth = (pixelBits == 8 || pixelBits == 15 ||
+			pixelBits == 16 || pixelBits == 24 || pixelBits == 32);
+		if (knownImageType && goodColorMap && goodDepth && (width > 0) &&
+		    (height > 0) && ((header[17] & 0xc0) == 0))
+			return TGA_TYPE;
+	}
+	return UNKNOWN_TYPE;
+}
+
+ImageReader::FileType ImageReader::fileTypeFromExtension(
+	const std::string& fileName) // CLASS METHOD
 {
 	int dotLoc = fileName.find_last_of('.');
 	if (dotLoc != std::string::npos)
 	{
 		std::string extension = fileName.substr(dotLoc+1);
 		if ((extension.compare("bmp") == 0) || (extension.compare("BMP") == 0))
-			return new BMPImageReader(fileName);
+			return BMP_TYPE;
 		if ((extension.compare("jpg") == 0) || (extension.compare("JPG") == 0))
-			return new JPEGImageReader(fileName);
+			return JPEG_TYPE;
 		if ((extension.compare("jpeg") == 0) || (extension.compare("JPEG") == 0))
-			return new JPEGImageReader(fileName);
+			return JPEG_TYPE;
 		if ((extension.compare("png") == 0) || (extension.compare("PNG") == 0))
-			return new PNGImageReader(fileName);
+			return PNG_TYPE;
 		if ((extension.compare("tga") == 0) || (extension.compare("TGA") == 0))
-			return new TGAImageReader(fileName);
+			return TGA_TYPE;
+	}
+	return UNKNOWN_TYPE;
+}
+
+ImageReader* ImageReader::guessFileType(const std::string& fileName, FILE* fp) // CLASS METHOD
+{
+	unsigned char header[18];
+	size_t n = fread(header, 1, sizeof(header), fp);
+	rewind(fp);
+
+	FileType type = fileTypeFromContents(header, n);
+	if (type == UNKNOWN_TYPE)
+		type = fileTypeFromExtension(fileName);
+	switch (type)
+	{
+		case BMP_TYPE:
+			return new BMPImageReader(fileName, fp);
+		case JPEG_TYPE:
+			return new JPEGImageReader(fileName, fp);
+		case PNG_TYPE:
+			return new PNGImageReader(fileName, fp);
+		case TGA_TYPE:
+			return new TGAImageReader(fileName, fp);
+		default:
+			break;
 	}
 
 	std::cerr << "ImageReader::guessFileType cannot determine file type of: "
@@ -136,7 +252,24 @@ ImageReader* ImageReader::guessFileType(const std::string& fileName) // CLASS ME
 	return nullptr;
 }
 
+FILE* ImageReader::openInputFile()
+{
+	if (inputFile == nullptr)
+		return fopen(fullFileName.c_str(), "rb");
+	rewind(inputFile);
+	return inputFile;
+}
+
+void ImageReader::closeInputFile(FILE* fp)
+{
+	if ((fp != nullptr) && (fp != inputFile))
+		fclose(fp);
+}
+
 void ImageReader::readImage()
 {
 	readFailed = !read();
+	inputFile = nullptr;
+	inputBuffer = nullptr;
+	inputBufferSize = 0;
 }
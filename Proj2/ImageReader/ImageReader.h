@@ -1,6 +1,8 @@
 //  ImageReader.h -- Abstract Base Class.
 //
 //  Read an Image file and give access to its specifications and contents.
+//  The type of a file is determined from its contents; the file name extension
+//  is only consulted if the contents are not recognized.
 //  Currently the following image file types are supported:
 //      * BMP format (.bmp)
 //      * JPEG format (.jpg; .jpeg) (Assumes a system jpeg library)
@@ -11,7 +13,8 @@
 //  James R. Miller (jrmiller@ku.edu) and is OPEN SOURCE.
 //
 // Quick synopsis of use:
-// 1. Use ImageReader::create to open and read an image file
+// 1. Use ImageReader::create to open and read an image file (or
+//    ImageReader::createAll to read many files concurrently)
 // 2. The various query methods can be used to retrieve relevant parameters
 //    such as its width, height, number of channels, and pixel contents.
 //
@@ -23,6 +26,12 @@
 #ifndef IMAGEREADER_H
 #define IMAGEREADER_H
 
+#include <stdio.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
 #include "Packed3DArray.h"
 
 class ImageReader
@@ -37,17 +46,60 @@ public:
 
 	std::string getFileName() const { return fullFileName; }
 
+	// Specifications of an image file as reported by "probe"
+	struct Info
+	{
+		int	width, height, numChannels;
+	};
+
 	// public class methods
 	// 1. create - dynamically allocates an ImageReader instance of the
 	//             appropriate subtype if the type can be determined from the
-	//             file name extension.
+	//             leading bytes of the file (or, failing that, from the file
+	//             name extension). The file is opened exactly once.
 	//             It returns nullptr if either the file does not exist, or its
-	//             type cannot be determined based on the file name extension.
+	//             type cannot be determined.
 	//             If a non-nullptr ImageReader pointer is returned, the caller is
 	//             responsible for deleting it when it is done with it.
 	static ImageReader*	create(std::string fileName);
 
-	// 2. Miscellaneous
+	// 2. createFromMemory - like create, but decodes the complete contents of
+	//             an image file that the caller already holds in memory (e.g.,
+	//             received over MPI or extracted from an archive). The type is
+	//             determined from the leading bytes. The bytes are not retained
+	//             and may be released as soon as createFromMemory returns.
+	//             getFileName() of the result is the empty string.
+	static ImageReader*	createFromMemory(const void* bytes, size_t nBytes);
+
+	// 3. createAll - reads each of the given files (using "create") on a pool
+	//             of 'numThreads' worker threads. As each file is completed,
+	//             onImage(index, reader) is called ON THE CALLING THREAD, where
+	//             'index' is the file's position in 'fileNames'. Files complete
+	//             in no particular order. 'reader' is nullptr if the file could
+	//             not be read; otherwise the callback is responsible for
+	//             deleting it. At most 'maxInFlight' images are being decoded
+	//             or waiting for the callback at any time, which bounds the
+	//             memory in use; workers wait for the callback to catch up.
+	//             numThreads <= 0 means use all hardware threads; maxInFlight
+	//             <= 0 means twice the number of threads. createAll returns
+	//             once every file has been passed to the callback.
+	static void	createAll(const std::vector<std::string>& fileNames,
+					const std::function<void(int, ImageReader*)>& onImage,
+					int numThreads=0, int maxInFlight=0);
+
+	// 4. probe - determines the width, height, and number of channels that
+	//             "create" would report for the given file WITHOUT decoding
+	//             it. Only the file header is read (JPEG SOF segment, PNG
+	//             IHDR chunk, BMP info header, or TGA header), so this is cheap
+	//             enough to call on every file before deciding how to read them
+	//             (e.g., to size buffers or balance work by pixel count). The
+	//             current setEnsureAlphaChannel and setPromoteSingleChannelToGray
+	//             settings are applied to numChannels. Returns false if the
+	//             file cannot be opened, its type cannot be determined, or its
+	//             header is not one that "create" could read.
+	static bool	probe(std::string fileName, Info& info);
+
+	// 5. Miscellaneous
 	static void	setEnsureAlphaChannel(bool b) { ensureAlphaChannel = b; }
 	static void	setPromoteSingleChannelToGray(bool b)
 		{ promoteSingleChannelToGray = b; }
@@ -55,26 +107,50 @@ public:
 	// (ii) be careful if you modify.
 	cryph::Packed3DArray<unsigned char>* getInternalPacked3DArrayImage() const
 		{ return theImage; }
+	// A copy of the image in Planar layout (each channel contiguous) for
+	// per-channel processing. The caller is responsible for deleting it.
+	cryph::Packed3DArray<unsigned char, cryph::Planar>* createPlanarImage() const;
 
 protected:
 	// Since the class is abstract, you CANNOT use these constructors.
 	// Use instead the class method "create" or create instances of
 	// concrete subclasses (TGAImageReader, RGBImageReader, etc.)
-	ImageReader(const std::string& fileName);
+	// If 'fp' is not nullptr, it is an already open handle on 'fileName'
+	// that read() uses instead of opening the file again.
+	ImageReader(const std::string& fileName, FILE* fp=nullptr);
+	// Decode the given bytes instead of a file (see inputBuffer)
+	ImageReader(const void* bytes, size_t nBytes);
 	ImageReader(const ImageReader& s); // cannot use the copy constructor
 
 	virtual bool read() = 0;
 	void	readImage();
 
+	// For use by read(): returns the handle given to the constructor (rewound
+	// to the start of the file) if there is one; otherwise opens the file.
+	// Either way, the result must be passed to closeInputFile.
+	FILE*	openInputFile();
+	void	closeInputFile(FILE* fp);
+
 	// The image read from the file
 	cryph::Packed3DArray<unsigned char>*	theImage;
 
 	std::string	fullFileName;
 	bool	readFailed;
 
+	// If not nullptr, read() must decode these bytes (the complete contents
+	// of an image file) instead of reading a file. Only valid during read().
+	const unsigned char*	inputBuffer;
+	size_t	inputBufferSize;
+
 private:
+	enum FileType { UNKNOWN_TYPE, BMP_TYPE, JPEG_TYPE, PNG_TYPE, TGA_TYPE };
+
+	static FileType	fileTypeFromContents(const unsigned char* header, size_t n);
+	static FileType	fileTypeFromExtension(const std::string& fileName);
+	static ImageReader* guessFileType(const std::string& fileName, FILE* fp);
+	static ImageReader* finishCreate(ImageReader* p);
 
-	static ImageReader* guessFileType(const std::string& fileName);
+	FILE*	inputFile; // only valid while read() is running
 
 	static bool	ensureAlphaChannel, promoteSingleChannelToGray;
 };
@@ -0,0 +1,94 @@
+//  ImageReaderBatch.c++ -- ImageReader::createAll: read many image files
+//                          concurrently on a pool of worker threads.
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "ImageReader.h"
+
+void ImageReader::createAll(const std::vector<std::string>& fileNames,
+	const std::function<void(int, ImageReader*)>& onImage,
+	int numThreads, int maxInFlight) // CLASS METHOD
+{
+	int nFiles = fileNames.size();
+	if (nFiles == 0)
+		return;
+	if (numThreads <= 0)
+		numThreads = std::thread::hardware_concurrency();
+	if (numThreads <= 0)
+		numThreads = 1;
+	if (numThreads > nFiles)
+		numThreads = nFiles;
+	if (maxInFlight <= 0)
+		maxInFlight = 2 * numThreads;
+
+	std::mutex mtx;
+	std::condition_variable slotAvailable, imageAvailable;
+	int nextFile = 0; // next file to be claimed by a worker
+	int inFlight = 0; // claimed by a worker, but not yet handed to onImage
+	std::deque< std::pair<int, ImageReader*> > finished;
+
+	auto worker = [&]()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		while (true)
+		{
+			slotAvailable.wait(lock, [&]
+				{ return (nextFile >= nFiles) || (inFlight < maxInFlight); });
+			if (nextFile >= nFiles)
+				return;
+			int index = nextFile++;
+			inFlight++;
+
+			lock.unlock();
+			ImageReader* p = create(fileNames[index]);
+			lock.lock();
+
+			finished.push_back(std::make_pair(index, p));
+			imageAvailable.notify_one();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (int i=0 ; i<numThreads ; i++)
+		workers.push_back(std::thread(worker));
+
+	std::unique_lock<std::mutex> lock(mtx);
+	for (int nDelivered=0 ; nDelivered<nFiles ; nDelivered++)
+	{
+		imageAvailable.wait(lock, [&] { return !finished.empty(); });
+		std::pair<int, ImageReader*> next = finished.front();
+		finished.pop_front();
+
+		lock.unlock();
+		try
+		{
+			onImage(next.first, next.second);
+		}
+		catch (...)
+		{
+			// Stop handing out files, let the workers finish what they
+			// have, and discard anything not yet delivered.
+			lock.lock();
+			nextFile = nFiles;
+			slotAvailable.notify_all();
+			lock.unlock();
+			for (auto& w : workers)
+				w.join();
+			for (auto& f : finished)
+				delete f.second;
+			throw;
+		}
+		lock.lock();
+
+		inFlight--;
+		slotAvailable.notify_one();
+	}
+	lock.unlock();
+
+	for (auto& w : workers)
+		w.join();
+}
@@ -0,0 +1,173 @@
+//  ImageReaderProbe.c++ -- ImageReader::probe: report the specifications of
+//                          an image file by reading only its header.
+
+#include "ImageReader.h"
+
+static int get16BE(const unsigned char* p) { return (p[0] << 8) | p[1]; }
+static int get16LE(const unsigned char* p) { return p[0] | (p[1] << 8); }
+
+static long get32BE(const unsigned char* p)
+{
+	return (static_cast<long>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int get32LE(const unsigned char* p)
+{
+	return static_cast<int>(p[0] | (p[1] << 8) | (p[2] << 16) |
+		(static_cast<unsigned int>(p[3]) << 24));
+}
+
+// Walk the marker segments up to the first start-of-frame (SOFn) segment.
+static bool probeJPEG(FILE* fp, ImageReader::Info& info)
+{
+	unsigned char b[8];
+	if ((fread(b, 1, 2, fp) != 2) || (b[0] != 0xff) || (b[1] != 0xd8))
+		return false;
+	while (true)
+	{
+		int c = fgetc(fp);
+		if (c != 0xff)
+			return false;
+		while (c == 0xff) // markers may be preceded by any number of fill bytes
+			c = fgetc(fp);
+		if (c == EOF)
+			return false;
+		if ((c == 0x01) || ((c >= 0xd0) && (c <= 0xd8)))
+			continue; // TEM, RSTn, and SOI have no length field
+		if ((c == 0xd9) || (c == 0xda))
+			return false; // EOI or SOS before any frame header
+		if (fread(b, 1, 2, fp) != 2)
+			return false;
+		int length = get16BE(b);
+		if (length < 2)
+			return false;
+		// SOF0-SOF15, except DHT (c4), JPG (c8), and DAC (cc)
+		bool isSOF = (c >= 0xc0) && (c <= 0xcf) &&
+		             (c != 0xc4) && (c != 0xc8) && (c != 0xcc);
+		if (isSOF)
+		{
+			// precision (1), height (2), width (2), number of components (1)
+			if ((length < 8) || (fread(b, 1, 6, fp) != 6))
+				return false;
+			info.height = get16BE(b + 1);
+			info.width = get16BE(b + 3);
+			// libjpeg decodes gray as 1, YCbCr/RGB as 3, and CMYK/YCCK as 4
+			info.numChannels = b[5];
+			return (info.numChannels == 1) || (info.numChannels == 3) ||
+			       (info.numChannels == 4);
+		}
+		if (fseek(fp, length - 2, SEEK_CUR) != 0)
+			return false;
+	}
+}
+
+// The IHDR chunk must immediately follow the 8 byte signature.
+static bool probePNG(FILE* fp, ImageReader::Info& info)
+{
+	// signature (8), chunk length (4), "IHDR" (4), width (4), height (4),
+	// bit depth (1), color type (1)
+	unsigned char b[26];
+	if ((fread(b, 1, sizeof(b), fp) != sizeof(b)) ||
+	    (b[12] != 'I') || (b[13] != 'H') || (b[14] != 'D') || (b[15] != 'R'))
+		return false;
+	info.width = get32BE(b + 16);
+	info.height = get32BE(b + 20);
+	switch (b[25]) // the color types supported by PNGImageReader
+	{
+		case 0: // PNG_COLOR_TYPE_GRAY
+			info.numChannels = 1;
+			return true;
+		case 2: // PNG_COLOR_TYPE_RGB
+			info.numChannels = 3;
+			return true;
+		case 6: // PNG_COLOR_TYPE_RGB_ALPHA
+			info.numChannels = 4;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool probeBMP(FILE* fp, ImageReader::Info& info)
+{
+	// BITMAPFILEHEADER (14 bytes) followed by at least a BITMAPINFOHEADER (40)
+	unsigned char b[54];
+	if ((fread(b, 1, sizeof(b), fp) != sizeof(b)) || (b[0] != 'B') ||
+	    (b[1] != 'M') || (get32LE(b + 14) < 40) || (get16LE(b + 26) != 1))
+		return false;
+	int bitCount = get16LE(b + 28);
+	if ((bitCount != 1) && (bitCount != 4) && (bitCount != 8) &&
+	    (bitCount != 24) && (bitCount != 32))
+		return false;
+	// The compressions BMPImageReader supports: none (BI_RGB), and BI_RLE8
+	// and BI_RLE4 for 8- and 4-bit images (not BI_BITFIELDS, BI_JPEG, ...)
+	int compression = get32LE(b + 30);
+	if ((compression != 0) && !((compression == 1) && (bitCount == 8)) &&
+	    !((compression == 2) && (bitCount == 4)))
+		return false;
+	info.width = get32LE(b + 18);
+	info.height = get32LE(b + 22);
+	if (info.height < 0) // rows stored top-down
+		info.height = -info.height;
+	// palette images are expanded to RGB
+	info.numChannels = (bitCount == 32) ? 4 : 3;
+	return true;
+}
+
+static bool probeTGA(FILE* fp, ImageReader::Info& info)
+{
+	unsigned char b[18];
+	if ((fread(b, 1, sizeof(b), fp) != sizeof(b)) ||
+	    (b[1] != 0) || ((b[2] != 2) && (b[2] != 3)))
+		return false;
+	int imageBits = b[16];
+	if ((imageBits != 8) && (imageBits != 24) && (imageBits != 32))
+		return false;
+	info.width = get16LE(b + 12);
+	info.height = get16LE(b + 14);
+	info.numChannels = imageBits / 8;
+	return true;
+}
+
+bool ImageReader::probe(std::string fileName, Info& info) // CLASS METHOD
+{
+	FILE* fp = fopen(fileName.c_str(), "rb");
+	if (fp == nullptr)
+		return false;
+
+	unsigned char header[18];
+	size_t n = fread(header, 1, sizeof(header), fp);
+	rewind(fp);
+	FileType type = fileTypeFromContents(header, n);
+	if (type == UNKNOWN_TYPE)
+		type = fileTypeFromExtension(fileName);
+
+	bool ok = false;
+	switch (type)
+	{
+		case BMP_TYPE:
+			ok = probeBMP(fp, info);
+			break;
+		case JPEG_TYPE:
+			ok = probeJPEG(fp, info);
+			break;
+		case PNG_TYPE:
+			ok = probePNG(fp, info);
+			break;
+		case TGA_TYPE:
+			ok = probeTGA(fp, info);
+			break;
+		default:
+			break;
+	}
+	fclose(fp);
+	if (!ok || (info.width <= 0) || (info.height <= 0))
+		return false;
+
+	// Same post-processing as "create"
+	if ((info.numChannels == 1) && promoteSingleChannelToGray)
+		info.numChannels = 3;
+	if ((info.numChannels == 3) && ensureAlphaChannel)
+		info.numChannels = 4;
+	return true;
+}
@@ -2,8 +2,11 @@
 
 // This software was developed by James R. Miller and is OPEN SOURCE.
 
+#include <setjmp.h>
 #include <stdio.h>
 
+#include <algorithm>
+
 #include "jpeglib.h"
 
 #include "JPEGImageReader.h"
@@ -18,28 +21,70 @@ JPEGImageReader::JPEGImageReader(const JPEGImageReader& j) : ImageReader(j)
 
 // Here are the supported constructors
 
-JPEGImageReader::JPEGImageReader(std::string fileName) :
-	ImageReader(fileName)
+JPEGImageReader::JPEGImageReader(std::string fileName, FILE* fp) :
+	ImageReader(fileName, fp)
+{
+	readImage();
+}
+
+JPEGImageReader::JPEGImageReader(const void* bytes, size_t nBytes) :
+	ImageReader(bytes, nBytes)
 {
 	readImage();
 }
 
+// jpeg_std_error's error_exit calls exit(); this one reports the error and
+// jumps back to read, which then fails like any other unreadable image.
+struct JPEGErrorManager
+{
+	struct jpeg_error_mgr pub; // must be first: libjpeg sees only this
+	jmp_buf recover;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+	(*cinfo->err->output_message)(cinfo);
+	longjmp(reinterpret_cast<JPEGErrorManager*>(cinfo->err)->recover, 1);
+}
+
 bool JPEGImageReader::read()
 {
-    FILE *fp = fopen(fullFileName.c_str(), "rb");
-    if (fp == nullptr)
+    FILE *fp = nullptr;
+	if (inputBuffer == nullptr)
 	{
-		cerr << "JPEGImageReader:: read - could not open: '" << fullFileName
-		     << "'\n";
-        return false;
+		fp = openInputFile();
+		if (fp == nullptr)
+		{
+			cerr << "JPEGImageReader:: read - could not open: '" << fullFileName
+			     << "'\n";
+			return false;
+		}
 	}
 
 	struct jpeg_decompress_struct cinfo;
-	struct jpeg_error_mgr jerr;
-	cinfo.err = jpeg_std_error(&jerr);
+	JPEGErrorManager jerr;
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = jpegErrorExit;
+	// locals changed after setjmp must be volatile
+	JSAMPARRAY volatile scanlines = nullptr;
+	if (setjmp(jerr.recover))
+	{
+		jpeg_destroy_decompress(&cinfo);
+		delete [] scanlines;
+	scanlines = nullptr;
+		delete theImage;
+		theImage = nullptr;
+		cerr << "JPEGImageReader::read - could not decode the JPEG data\n";
+		closeInputFile(fp);
+		return false;
+	}
 	jpeg_create_decompress(&cinfo);
 
-	jpeg_stdio_src(&cinfo, fp);
+	if (fp == nullptr)
+		jpeg_mem_src(&cinfo, const_cast<unsigned char*>(inputBuffer),
+			inputBufferSize);
+	else
+		jpeg_stdio_src(&cinfo, fp);
 #ifdef __APPLE_CC__
 	jpeg_read_header(&cinfo, TRUE);
 #else
@@ -86,39 +131,22 @@ bool JPEGImageReader::read()
 	// JDIMENSION jpeg_read_scanlines (j_decompress_ptr cinfo,
     //                 JSAMPARRAY scanlines, JDIMENSION max_lines);
 
-	JSAMPARRAY scanlines = new JSAMPROW[cinfo.rec_outbuf_height];
-	int nCols = theImage->getDim2();
-	int nChannels = theImage->getDim3();
-	for (int i=0 ; i<cinfo.rec_outbuf_height ; i++)
-		scanlines[i] = new JSAMPLE[nCols*nChannels];
-
-	JDIMENSION totalLinesRead = 0;
+	// Decode straight into theImage; its row 0 is the bottom of the image.
+	scanlines = new JSAMPROW[cinfo.rec_outbuf_height];
 	int setRow = theImage->getDim1() - 1;
 	while (cinfo.output_scanline < cinfo.output_height)
 	{
-		JDIMENSION res = jpeg_read_scanlines(&cinfo,scanlines,
-			cinfo.rec_outbuf_height);
-		for (int ii=0 ; ii<res ; ii++)
-		{
-			for (int jj=0 ; jj<nChannels*nCols ; jj+=nChannels)
-			{
-				int setCol = jj / nChannels;
-				for (int kk=0 ; kk<nChannels ; kk++)
-					theImage->setDataElement(setRow,setCol,kk,
-							scanlines[ii][jj+kk]);
-			}
-			setRow--;
-		}
-		totalLinesRead += res;
+		int nLines = std::min(static_cast<int>(cinfo.rec_outbuf_height), setRow+1);
+		for (int ii=0 ; ii<nLines ; ii++)
+			scanlines[ii] = theImage->getSlice(setRow-ii).begin();
+		JDIMENSION res = jpeg_read_scanlines(&cinfo,scanlines,nLines);
+		setRow -= res;
 	}
+	delete [] scanlines;
 
 	jpeg_finish_decompress(&cinfo);
-	fclose(fp);
+	closeInputFile(fp);
 	jpeg_destroy_decompress(&cinfo);
 
-	for (int i=0 ; i<cinfo.rec_outbuf_height ; i++)
-		delete [] scanlines[i];
-	delete [] scanlines;
-
 	return true;
 }
@@ -11,7 +11,8 @@
 class JPEGImageReader : public ImageReader
 {
 public:
-	JPEGImageReader(std::string fileName);
+	JPEGImageReader(std::string fileName, FILE* fp=nullptr);
+	JPEGImageReader(const void* bytes, size_t nBytes);
 
 protected:
 	JPEGImageReader(const JPEGImageReader& s);
@@ -0,0 +1,70 @@
+// MappedFile.c++ -- read-only access to the entire contents of a file.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const std::string& fileName) :
+	mData(nullptr), mSize(0), mIsMapped(false)
+{
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	mapOrRead(fd);
+	close(fd);
+}
+
+MappedFile::MappedFile(int fd) :
+	mData(nullptr), mSize(0), mIsMapped(false)
+{
+	if (fd >= 0)
+		mapOrRead(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (mIsMapped)
+		munmap(const_cast<unsigned char*>(mData), mSize);
+}
+
+void MappedFile::mapOrRead(int fd)
+{
+	struct stat sb;
+	if ((fstat(fd, &sb) == 0) && S_ISREG(sb.st_mode) && (sb.st_size > 0))
+	{
+		void* p = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED)
+		{
+			// Readers make a single front-to-back pass over the pixels.
+			posix_madvise(p, sb.st_size, POSIX_MADV_SEQUENTIAL);
+			mData = static_cast<const unsigned char*>(p);
+			mSize = sb.st_size;
+			mIsMapped = true;
+		}
+	}
+	if (!mIsMapped)
+		readContents(fd);
+}
+
+void MappedFile::readContents(int fd)
+{
+	const size_t CHUNK = 1 << 16;
+	size_t nRead = 0;
+	while (true)
+	{
+		mBuffer.resize(nRead + CHUNK);
+		ssize_t n = ::read(fd, &mBuffer[nRead], CHUNK);
+		if (n <= 0)
+			break;
+		nRead += n;
+	}
+	mBuffer.resize(nRead);
+	if (nRead > 0)
+	{
+		mData = &mBuffer[0];
+		mSize = nRead;
+	}
+}
@@ -0,0 +1,44 @@
+// MappedFile.h -- read-only access to the entire contents of a file.
+//
+// The file is mapped into memory (mmap) whenever possible so that image
+// readers can parse headers and pixel data in place rather than copying the
+// file through stdio buffers first. If the file cannot be mapped (e.g., it is
+// a pipe or a special file), its contents are read into a private buffer so
+// that callers see the same interface either way.
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+class MappedFile
+{
+public:
+	MappedFile(const std::string& fileName);
+	// Map a file that is already open. 'fd' is not closed; if the file
+	// cannot be mapped, it is read from its current position.
+	MappedFile(int fd);
+	virtual ~MappedFile();
+
+	// false if the file could not be opened or is empty
+	bool	isValid() const { return mData != nullptr; }
+
+	const unsigned char*	getData() const { return mData; }
+	size_t	getSize() const { return mSize; }
+
+private:
+	MappedFile(const MappedFile& m); // cannot use the copy constructor
+
+	void	mapOrRead(int fd);
+	void	readContents(int fd);
+
+	const unsigned char*	mData;
+	size_t	mSize;
+	bool	mIsMapped; // false => mData points into mBuffer
+	std::vector<unsigned char>	mBuffer;
+};
+
+#endif
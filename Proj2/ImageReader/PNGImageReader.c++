@@ -4,6 +4,7 @@
 // OPEN SOURCE.
 
 #include <stdio.h>
+#include <string.h>
 
 #include "png.h"
 
@@ -17,8 +18,14 @@ PNGImageReader::PNGImageReader(const PNGImageReader& j) : ImageReader(j)
 
 // Here are the supported constructors
 
-PNGImageReader::PNGImageReader(std::string fileName) :
-	ImageReader(fileName)
+PNGImageReader::PNGImageReader(std::string fileName, FILE* fp) :
+	ImageReader(fileName, fp)
+{
+	readImage();
+}
+
+PNGImageReader::PNGImageReader(const void* bytes, size_t nBytes) :
+	ImageReader(bytes, nBytes)
 {
 	readImage();
 }
@@ -52,28 +59,62 @@ int PNGImageReader::numChannelsFromColorType(int cType)
 	}
 }
 
+// PNG data held in memory (see ImageReader::createFromMemory)
+struct PNGMemorySource
+{
+	const unsigned char* bytes;
+	size_t nBytes;
+	size_t pos;
+};
+
+static void readPNGFromMemory(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	PNGMemorySource* src = static_cast<PNGMemorySource*>(png_get_io_ptr(png_ptr));
+	if (length > src->nBytes - src->pos)
+		png_error(png_ptr, "PNG data is truncated");
+	memcpy(data, src->bytes + src->pos, length);
+	src->pos += length;
+}
+
 bool PNGImageReader::read()
 {
-    FILE *fp = fopen(fullFileName.c_str(), "rb");
-    if (fp == nullptr)
-	{
-		std::cerr << "PNGImageReader::read - could not open: '" << fullFileName
-		     << "'\n";
-        return false;
-	}
 	// check signature
 	const int NUM_HEADER_BYTES_TO_CHECK = 8;
 	unsigned char header[NUM_HEADER_BYTES_TO_CHECK];
-	fread(header, 1, NUM_HEADER_BYTES_TO_CHECK, fp);
+	PNGMemorySource memSource = { inputBuffer, inputBufferSize,
+	                              NUM_HEADER_BYTES_TO_CHECK };
+    FILE *fp = nullptr;
+	if (inputBuffer != nullptr)
+	{
+		if (inputBufferSize < NUM_HEADER_BYTES_TO_CHECK)
+		{
+			std::cerr << "PNGImageReader::read - bad signature\n";
+			return false;
+		}
+		memcpy(header, inputBuffer, NUM_HEADER_BYTES_TO_CHECK);
+	}
+	else
+	{
+		fp = openInputFile();
+		if (fp == nullptr)
+		{
+			std::cerr << "PNGImageReader::read - could not open: '" << fullFileName
+			     << "'\n";
+			return false;
+		}
+		fread(header, 1, NUM_HEADER_BYTES_TO_CHECK, fp);
+	}
 	if (png_sig_cmp(header, 0, NUM_HEADER_BYTES_TO_CHECK) != 0)
 	{
 		std::cerr << "PNGImageReader::read - bad signature\n";
+		closeInputFile(fp);
         return false;
 	}
 	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
 	if (png_ptr == nullptr)
 	{
 		std::cerr << "PNGImageReader::read - could not allocate png_struct\n";
+		closeInputFile(fp);
 		return false;
 	}
 	png_infop info_ptr = png_create_info_struct(png_ptr);
@@ -81,10 +122,27 @@ bool PNGImageReader::read()
 	{
 		png_destroy_read_struct(&png_ptr, (png_infopp)nullptr, (png_infopp)nullptr);
 		std::cerr << "PNGImageReader::read - could not allocate png_info\n";
+		closeInputFile(fp);
+		return false;
+	}
+	// libpng reports errors (such as truncated data) by jumping back here;
+	// locals changed after setjmp must be volatile
+	png_bytep* volatile row_pointers = nullptr;
+	if (setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+		delete [] row_pointers;
+		delete theImage;
+		theImage = nullptr;
+		std::cerr << "PNGImageReader::read - could not decode the PNG data\n";
+		closeInputFile(fp);
 		return false;
 	}
 	// set up input reading code
-	png_init_io(png_ptr, fp);
+	if (fp == nullptr)
+		png_set_read_fn(png_ptr, &memSource, readPNGFromMemory);
+	else
+		png_init_io(png_ptr, fp);
 	png_set_sig_bytes(png_ptr, NUM_HEADER_BYTES_TO_CHECK); // tell it we read the signature
 	png_read_info(png_ptr, info_ptr);
 
@@ -95,17 +153,22 @@ bool PNGImageReader::read()
 				 nullptr, nullptr, nullptr); // don't care about interlace, compression, or filter types
 	int nChannels = numChannelsFromColorType(color_type);
 	if (nChannels == 0)
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+		closeInputFile(fp);
 		return false;
+	}
 	theImage = new cryph::Packed3DArray<unsigned char>(height, width, nChannels);
-	unsigned char* p = theImage->getModifiableData();
-	png_bytep* row_pointers = new png_byte*[height];
+	row_pointers = new png_byte*[height];
 	// need to flip order of the rows:
 	int rpi = height;
 	for (int i=0 ; i<height ; i++)
-		row_pointers[--rpi] = p + i*width*nChannels*sizeof(unsigned char);
+		row_pointers[--rpi] = theImage->getSlice(i).begin();
 	png_read_image(png_ptr, row_pointers);
 	delete [] row_pointers;
+	row_pointers = nullptr;
 	png_read_end(png_ptr, (png_infop)nullptr);
 	png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+	closeInputFile(fp);
 	return true;
 }
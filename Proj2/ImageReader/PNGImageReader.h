@@ -11,7 +11,8 @@
 class PNGImageReader : public ImageReader
 {
 public:
-	PNGImageReader(std::string fileName);
+	PNGImageReader(std::string fileName, FILE* fp=nullptr);
+	PNGImageReader(const void* bytes, size_t nBytes);
 
 protected:
 	PNGImageReader(const PNGImageReader& s);
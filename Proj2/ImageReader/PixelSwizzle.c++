@@ -0,0 +1,242 @@
+// PixelSwizzle.c++ -- fast channel reordering used by the image readers.
+
+#include "PixelSwizzle.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SWIZZLE_SSSE3 1
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON)
+#define SWIZZLE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if SWIZZLE_SSSE3
+
+// The SSSE3 versions are compiled for SSSE3 regardless of the global compiler
+// flags and only called after a run-time check of the processor.
+
+static bool haveSSSE3()
+{
+	static const bool b = __builtin_cpu_supports("ssse3");
+	return b;
+}
+
+// Each iteration loads 16 bytes but only converts the 5 whole pixels (15 bytes)
+// they contain. Byte 15 is written back unchanged and then overwritten by the
+// next iteration (or the scalar tail loop), which makes in-place use safe.
+__attribute__((target("ssse3")))
+static size_t swapRedBlue3SSSE3(const unsigned char* src, unsigned char* dst,
+	size_t nPixels)
+{
+	const __m128i mask = _mm_setr_epi8(2,1,0, 5,4,3, 8,7,6, 11,10,9, 14,13,12, 15);
+	size_t done = 0;
+	while (nPixels - done >= 6)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3*done));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3*done),
+			_mm_shuffle_epi8(v, mask));
+		done += 5;
+	}
+	return done;
+}
+
+__attribute__((target("ssse3")))
+static size_t swapRedBlue4SSSE3(const unsigned char* src, unsigned char* dst,
+	size_t nPixels)
+{
+	const __m128i mask = _mm_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+	size_t done = 0;
+	for ( ; done+4 <= nPixels ; done+=4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4*done));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4*done),
+			_mm_shuffle_epi8(v, mask));
+	}
+	return done;
+}
+
+// Both directions move 16 pixels (3 or 4 vectors) per iteration. Each output
+// vector is the OR of one byte shuffle of every input vector; the shuffle
+// masks are derived from the pixel layout rather than written out by hand.
+template <int N>
+__attribute__((target("ssse3")))
+static size_t deinterleaveSSSE3(const unsigned char* src, unsigned char* dst,
+	size_t nPixels)
+{
+	__m128i mask[N][N]; // mask[plane][input vector]
+	for (int k=0 ; k<N ; k++)
+		for (int v=0 ; v<N ; v++)
+		{
+			unsigned char m[16];
+			for (int p=0 ; p<16 ; p++)
+			{
+				int b = N*p + k; // byte of the input holding channel k of pixel p
+				m[p] = (b/16 == v) ? (b % 16) : 0x80;
+			}
+			mask[k][v] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m));
+		}
+	size_t done = 0;
+	for ( ; done+16 <= nPixels ; done+=16)
+	{
+		__m128i in[N];
+		for (int v=0 ; v<N ; v++)
+			in[v] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + N*done + 16*v));
+		for (int k=0 ; k<N ; k++)
+		{
+			__m128i out = _mm_shuffle_epi8(in[0], mask[k][0]);
+			for (int v=1 ; v<N ; v++)
+				out = _mm_or_si128(out, _mm_shuffle_epi8(in[v], mask[k][v]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + k*nPixels + done), out);
+		}
+	}
+	return done;
+}
+
+template <int N>
+__attribute__((target("ssse3")))
+static size_t interleaveSSSE3(const unsigned char* src, unsigned char* dst,
+	size_t nPixels)
+{
+	__m128i mask[N][N]; // mask[output vector][plane]
+	for (int v=0 ; v<N ; v++)
+		for (int k=0 ; k<N ; k++)
+		{
+			unsigned char m[16];
+			for (int j=0 ; j<16 ; j++)
+			{
+				int b = 16*v + j; // output byte; holds channel b%N of pixel b/N
+				m[j] = ((b % N) == k) ? (b / N) : 0x80;
+			}
+			mask[v][k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m));
+		}
+	size_t done = 0;
+	for ( ; done+16 <= nPixels ; done+=16)
+	{
+		__m128i in[N];
+		for (int k=0 ; k<N ; k++)
+			in[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k*nPixels + done));
+		for (int v=0 ; v<N ; v++)
+		{
+			__m128i out = _mm_shuffle_epi8(in[0], mask[v][0]);
+			for (int k=1 ; k<N ; k++)
+				out = _mm_or_si128(out, _mm_shuffle_epi8(in[k], mask[v][k]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + N*done + 16*v), out);
+		}
+	}
+	return done;
+}
+
+#endif
+
+void swapRedBlue3(const unsigned char* src, unsigned char* dst, size_t nPixels)
+{
+	size_t done = 0;
+#if SWIZZLE_SSSE3
+	if (haveSSSE3())
+		done = swapRedBlue3SSSE3(src, dst, nPixels);
+#elif SWIZZLE_NEON
+	for ( ; done+16 <= nPixels ; done+=16)
+	{
+		uint8x16x3_t v = vld3q_u8(src + 3*done);
+		uint8x16_t t = v.val[0];
+		v.val[0] = v.val[2];
+		v.val[2] = t;
+		vst3q_u8(dst + 3*done, v);
+	}
+#endif
+	for (size_t i=3*done ; i<3*nPixels ; i+=3)
+	{
+		unsigned char b = src[i];
+		dst[i+1] = src[i+1];
+		dst[i] = src[i+2];
+		dst[i+2] = b;
+	}
+}
+
+void swapRedBlue4(const unsigned char* src, unsigned char* dst, size_t nPixels)
+{
+	size_t done = 0;
+#if SWIZZLE_SSSE3
+	if (haveSSSE3())
+		done = swapRedBlue4SSSE3(src, dst, nPixels);
+#elif SWIZZLE_NEON
+	for ( ; done+16 <= nPixels ; done+=16)
+	{
+		uint8x16x4_t v = vld4q_u8(src + 4*done);
+		uint8x16_t t = v.val[0];
+		v.val[0] = v.val[2];
+		v.val[2] = t;
+		vst4q_u8(dst + 4*done, v);
+	}
+#endif
+	for (size_t i=4*done ; i<4*nPixels ; i+=4)
+	{
+		unsigned char b = src[i];
+		dst[i+1] = src[i+1];
+		dst[i] = src[i+2];
+		dst[i+2] = b;
+		dst[i+3] = src[i+3];
+	}
+}
+
+void deinterleave(const unsigned char* src, unsigned char* dst, size_t nPixels,
+	int nChannels)
+{
+	size_t done = 0;
+#if SWIZZLE_SSSE3
+	if (haveSSSE3() && (nChannels == 3))
+		done = deinterleaveSSSE3<3>(src, dst, nPixels);
+	else if (haveSSSE3() && (nChannels == 4))
+		done = deinterleaveSSSE3<4>(src, dst, nPixels);
+#elif SWIZZLE_NEON
+	if (nChannels == 3)
+		for ( ; done+16 <= nPixels ; done+=16)
+		{
+			uint8x16x3_t v = vld3q_u8(src + 3*done);
+			for (int k=0 ; k<3 ; k++)
+				vst1q_u8(dst + k*nPixels + done, v.val[k]);
+		}
+	else if (nChannels == 4)
+		for ( ; done+16 <= nPixels ; done+=16)
+		{
+			uint8x16x4_t v = vld4q_u8(src + 4*done);
+			for (int k=0 ; k<4 ; k++)
+				vst1q_u8(dst + k*nPixels + done, v.val[k]);
+		}
+#endif
+	for (int k=0 ; k<nChannels ; k++)
+		for (size_t i=done ; i<nPixels ; i++)
+			dst[k*nPixels + i] = src[nChannels*i + k];
+}
+
+void interleave(const unsigned char* src, unsigned char* dst, size_t nPixels,
+	int nChannels)
+{
+	size_t done = 0;
+#if SWIZZLE_SSSE3
+	if (haveSSSE3() && (nChannels == 3))
+		done = interleaveSSSE3<3>(src, dst, nPixels);
+	else if (haveSSSE3() && (nChannels == 4))
+		done = interleaveSSSE3<4>(src, dst, nPixels);
+#elif SWIZZLE_NEON
+	if (nChannels == 3)
+		for ( ; done+16 <= nPixels ; done+=16)
+		{
+			uint8x16x3_t v;
+			for (int k=0 ; k<3 ; k++)
+				v.val[k] = vld1q_u8(src + k*nPixels + done);
+			vst3q_u8(dst + 3*done, v);
+		}
+	else if (nChannels == 4)
+		for ( ; done+16 <= nPixels ; done+=16)
+		{
+			uint8x16x4_t v;
+			for (int k=0 ; k<4 ; k++)
+				v.val[k] = vld1q_u8(src + k*nPixels + done);
+			vst4q_u8(dst + 4*done, v);
+		}
+#endif
+	for (int k=0 ; k<nChannels ; k++)
+		for (size_t i=done ; i<nPixels ; i++)
+			dst[nChannels*i + k] = src[k*nPixels + i];
+}
@@ -0,0 +1,26 @@
+// PixelSwizzle.h -- fast channel reordering used by the image readers.
+//
+// BMP and TGA files store pixels as BGR(A); ImageReader exposes RGB(A). These
+// routines copy 'nPixels' pixels from 'src' to 'dst', exchanging the first and
+// third channel of each pixel. SSSE3 (x86) or NEON (ARM) shuffles are used when
+// the processor supports them; otherwise a scalar loop is used. 'src' and 'dst'
+// may be identical (in-place conversion), but must not otherwise overlap.
+
+#ifndef PIXELSWIZZLE_H
+#define PIXELSWIZZLE_H
+
+#include <stddef.h>
+
+void swapRedBlue3(const unsigned char* src, unsigned char* dst, size_t nPixels);
+void swapRedBlue4(const unsigned char* src, unsigned char* dst, size_t nPixels);
+
+// Conversions between interleaved pixels (RGBRGB...) and planes (RRR...GGG...
+// BBB...), the Interleaved and Planar layouts of cryph::Packed3DArray. Plane k
+// starts at k*nPixels. 3 and 4 channels use SSSE3 or NEON as above; other
+// channel counts use a scalar loop. 'src' and 'dst' must not overlap.
+void deinterleave(const unsigned char* src, unsigned char* dst, size_t nPixels,
+	int nChannels);
+void interleave(const unsigned char* src, unsigned char* dst, size_t nPixels,
+	int nChannels);
+
+#endif
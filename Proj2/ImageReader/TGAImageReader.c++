@@ -4,9 +4,12 @@
 // This software was developed by James R. Miller (jrmiller@ku.edu) and is
 // OPEN SOURCE.
 
-#include <iomanip>
+#include <iostream>
+#include <string.h>
 
 #include "TGAImageReader.h"
+#include "MappedFile.h"
+#include "PixelSwizzle.h"
 
 // The copy constructor cannot be used.
 
@@ -16,162 +19,103 @@ TGAImageReader::TGAImageReader(const TGAImageReader& t) : ImageReader(t)
 
 // Here are the supported constructors
 
-TGAImageReader::TGAImageReader(std::string fileName) :
-	ImageReader(fileName)
+TGAImageReader::TGAImageReader(std::string fileName, FILE* fp) :
+	ImageReader(fileName, fp)
 {
 	readImage();
 }
 
-#include <iostream>
-
-#include <stdio.h>
-
-using namespace std;
-
-/* =============
-getRGBA
-
-Reads in RGBA data for a 32bit image.
-============= */
-void getRGBA (FILE *s, int size, unsigned char* buf)
+TGAImageReader::TGAImageReader(const void* bytes, size_t nBytes) :
+	ImageReader(bytes, nBytes)
 {
-    int bread = fread (buf, sizeof (unsigned char), size * 4, s);
-
-    /* TGA is stored in BGRA, make it RGBA */
-    for (int i = 0; i < size * 4; i += 4 )
-    {
-        unsigned char temp = buf[i];
-        buf[i] = buf[i + 2];
-        buf[i + 2] = temp;
-    }
-}
-/* =============
-getRGB
-
-Reads in RGB data for a 24bit image.
-============= */
-void getRGB (FILE *s, int size, unsigned char* buf)
-{
-    int bread = fread (buf, sizeof (unsigned char), size * 3, s);
-
-    /* TGA is stored in BGR, make it RGB */
-    for (int i = 0; i < size * 3; i += 3)
-    {
-        unsigned char temp = buf[i];
-        buf[i] = buf[i + 2];
-        buf[i + 2] = temp;
-    }
-}
-/* =============
-getGray
-
-Gets the grayscale image data.  Used as an alpha channel.
-============= */
-void getGray (FILE *s, int size, unsigned char* buf)
-{
-    int bread = fread (buf, sizeof (unsigned char), size, s);
+	readImage();
 }
-/* =============
-getData
 
-Gets the image data for the specified bit depth.
-============= */
-void getData (FILE *s, int sz, int iBits, unsigned char* buf)
-{
-    if (iBits == 32)
-        getRGBA (s, sz,  buf);
-    else if (iBits == 24)
-        getRGB (s, sz, buf);
-    else if (iBits == 8)
-        getGray (s, sz, buf);
-}
 /* =============
-loadTGA
+read
 
 Loads up a targa file.  Supported types are 8,24 and 32 uncompressed images.
-id is the texture ID to bind too.
+The pixels are converted (TGA stores BGR(A); we want RGB(A)) directly from a
+memory map of the file (or from the caller's buffer) into the image; no
+intermediate buffer is used.
 ============= */
 bool TGAImageReader::read()
 {
-    FILE *fp = fopen(fullFileName.c_str(), "rb");
-    if (fp == nullptr)
+	if (inputBuffer != nullptr)
+		return readFromBytes(inputBuffer, inputBufferSize);
+
+	FILE* fp = openInputFile();
+	if (fp == nullptr)
 	{
 		std::cerr << "TGAImageReader:: read - could not open: '" << fullFileName
 		     << "'\n";
-        return false;
+		return false;
 	}
+	MappedFile file(fileno(fp));
+	closeInputFile(fp);
+	return file.isValid() && readFromBytes(file.getData(), file.getSize());
+}
 
-    unsigned char header[12];
-	// Header (12 bytes)
-	// byte   0: ignored
-	// byte 1-2: color map information and image type
-	// byte 3-12: ? (original implementation just fseek-ed over them...)
-    fread (header, sizeof (char), 12, fp);
-/*
-	if (debug)
-	{
-		std::cout << "Header: ";
-		for (int ii=0 ; ii<12 ; ii++)
-			std::cout << setw(4) << (int)header[ii];
-		std::cout << '\n';
-	}
-*/
-    if (header[1] != 0 || (header[2] != 2 && header[2] != 3))
-	{
-		fclose(fp);
+bool TGAImageReader::readFromBytes(const unsigned char* bytes, size_t nBytes)
+{
+	// Header (18 bytes)
+	// byte     0: length of the image ID field that follows the header
+	// byte     1: color map type (we require 0: no color map)
+	// byte     2: image type (2: uncompressed true color; 3: uncompressed gray)
+	// byte  3-11: color map specification and image origin (ignored)
+	// byte 12-15: width and height (little-endian)
+	// byte    16: bits per pixel
+	// byte    17: image descriptor (bit 5 set => first row is the top row)
+	const size_t HEADER_SIZE = 18;
+	const unsigned char* header = bytes;
+	if (nBytes < HEADER_SIZE)
+		return false;
+	if (header[1] != 0 || (header[2] != 2 && header[2] != 3))
 		return false;
-	}
 
-	const int nBytes = 6;
-    unsigned char info[nBytes];
-    fread (info, sizeof (char), nBytes, fp);
-/*
-	if (debug)
-	{
-		std::cout << "  info: ";
-		for (int jj=0 ; jj<nBytes ; jj++)
-			std::cout << setw(4) << static_cast<int>(info[jj]);
-		std::cout << '\n';
-	}
-*/
-    int nCols = info[0] + info[1] * 256;
-    int nRows = info[2] + info[3] * 256;
-    int imageBits =	info[4];
+	int nCols = header[12] + header[13] * 256;
+	int nRows = header[14] + header[15] * 256;
+	int imageBits = header[16];
+	bool topDown = ((header[17] & 0x20) != 0);
 	int nChannels = imageBits/8;
 
-    int size = nCols * nRows;
+	/* make sure we are loading a supported type */
+	if (imageBits != 32 && imageBits != 24 && imageBits != 8)
+		return false;
+	if ((nCols == 0) || (nRows == 0))
+		return false;
 
-    /* make sure we are loading a supported type */
-    if (imageBits != 32 && imageBits != 24 && imageBits != 8)
+	size_t rowBytes = static_cast<size_t>(nCols) * nChannels;
+	size_t pixelStart = HEADER_SIZE + header[0];
+	if (pixelStart + rowBytes * nRows > nBytes)
 	{
-		fclose(fp);
+		std::cerr << "TGAImageReader:: read - '" << fullFileName
+		     << "' is truncated\n";
 		return false;
 	}
 
 	theImage = new cryph::Packed3DArray<unsigned char>
 								(nRows, nCols, nChannels);
 	unsigned char* imageData = theImage->getModifiableData();
-	getData (fp, size, imageBits, imageData);
-    fclose (fp);
+	const unsigned char* pixels = bytes + pixelStart;
+	if ((nChannels == 1) && !topDown)
+	{
+		// The file layout is exactly our layout
+		memcpy(imageData, pixels, rowBytes * nRows);
+		return true;
+	}
 
-	if (info[5] != 0)
+	for (int i=0 ; i<nRows ; i++, pixels+=rowBytes)
 	{
-		// rows are inverted
-		int nRowsToSwap = nRows / 2;
-		int m = nRows - 1;
-		for (int i=0 ; i<nRowsToSwap ; i++)
-		{
-			// swap row 'i' with row 'm'
-			for (int j=0 ; j<nCols ; j++)
-				for (int k=0 ; k<nChannels ; k++)
-				{
-					unsigned char from_i = theImage->getDataElement(i,j,k);
-					unsigned char from_m = theImage->getDataElement(m,j,k);
-					theImage->setDataElement(i,j,k,from_m);
-					theImage->setDataElement(m,j,k,from_i);
-				}
-			m--;
-		}
+		// Our row 0 is the bottom row of the image
+		int row = topDown ? (nRows - 1 - i) : i;
+		unsigned char* imageRow = imageData + row * rowBytes;
+		if (nChannels == 4)
+			swapRedBlue4(pixels, imageRow, nCols);
+		else if (nChannels == 3)
+			swapRedBlue3(pixels, imageRow, nCols);
+		else
+			memcpy(imageRow, pixels, rowBytes);
 	}
 
 	return true;
@@ -11,12 +11,16 @@
 class TGAImageReader : public ImageReader
 {
 public:
-	TGAImageReader(std::string fileName);
+	TGAImageReader(std::string fileName, FILE* fp=nullptr);
+	TGAImageReader(const void* bytes, size_t nBytes);
 
 protected:
 	TGAImageReader(const TGAImageReader& s);
 
 	virtual bool read();
+
+private:
+	bool	readFromBytes(const unsigned char* bytes, size_t nBytes);
 };
 
 #endif
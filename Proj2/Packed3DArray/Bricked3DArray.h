@@ -0,0 +1,302 @@
+/** @file Bricked3DArray.h
+ *  A read-only 3D array of primitive values that is too large to be held in
+ *  memory at once. The array is stored in a raw file in the same order as an
+ *  (Interleaved) Packed3DArray: [i1][i2][i3], with i3 varying fastest. The file
+ *  is memory mapped, and the array is accessed in cubical "bricks" of
+ *  brickSize^3 elements (smaller at the far edges of the array). A brick is
+ *  gathered from the file into its own Packed3DArray the first time it is
+ *  needed, and at most maxResidentBricks bricks are kept; the least recently
+ *  used brick is discarded when room is needed for another. The memory in use
+ *  is therefore bounded regardless of the size of the file (the mapped file
+ *  itself occupies only reclaimable page cache).
+ *  <p>Bricks are handed out as shared_ptrs: a brick that is in use is not
+ *  freed when it is evicted from the cache, and the array may be used from
+ *  several threads at once.</p>
+ *  Processing a brick at a time keeps traversals along any axis local, not just
+ *  traversals along i3. getDataElement is provided for occasional random
+ *  access; inner loops should use getBrick or forEachBrick instead.
+ *  <p>Proj3's BrickedProjector projects raw volume files (whose voxel (y, x, z)
+ *  is element [z][x][y]) through this class.</p>
+ *  @see Packed3DArray
+ */
+
+#ifndef BRICKED3DARRAY_H
+#define BRICKED3DARRAY_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "Packed3DArray.h"
+
+namespace cryph
+{
+
+template <typename T>
+class Bricked3DArray
+{
+public:
+	/** One brick: the elements [first1, first1+n1) x [first2, first2+n2) x
+	 *  [first3, first3+n3) of the whole array, where (n1, n2, n3) are the
+	 *  dimensions of "data".
+	 */
+	struct Brick
+	{
+		Brick(int f1, int f2, int f3, int n1, int n2, int n3) :
+			first1(f1), first2(f2), first3(f3), data(n1, n2, n3) {}
+
+		int		first1, first2, first3;
+		Packed3DArray<T>	data;
+	};
+
+	/** Open a file holding dim1*dim2*dim3 elements.
+	 *  @param fileName the raw file
+	 *  @param dim1 the first dimension
+	 *  @param dim2 the second dimension
+	 *  @param dim3 the third dimension
+	 *  @param brickSize the extent of a brick along each dimension
+	 *  @param maxResidentBricks the maximum number of bricks in the cache
+	 *  @param headerBytes the number of bytes preceding the array in the file
+	 *         (a multiple of alignof(T), so that the elements are aligned)
+	 */
+	Bricked3DArray(const std::string& fileName, int dim1, int dim2, int dim3,
+		int brickSize=64, size_t maxResidentBricks=64, size_t headerBytes=0);
+
+	/** The destructor */
+	virtual ~Bricked3DArray();
+
+	/** Return whether the file was opened and is large enough
+	 *  @return true if the array can be used
+	 */
+	bool isValid() const { return mMapped != nullptr; }
+
+	/** Return the first, second, and third array dimensions */
+	int getDim1() const { return mDim1; }
+	int getDim2() const { return mDim2; }
+	int getDim3() const { return mDim3; }
+
+	/** Return the extent of a (full) brick along each dimension */
+	int getBrickSize() const { return mBrickSize; }
+
+	/** Return the number of bricks along the first, second, and third
+	 *  dimensions
+	 */
+	int getNumBricks1() const { return numBricks(mDim1); }
+	int getNumBricks2() const { return numBricks(mDim2); }
+	int getNumBricks3() const { return numBricks(mDim3); }
+
+	/** Return the brick with the given brick indices, loading it if it is
+	 *  not resident.
+	 *  @param b1 the brick index along the first dimension
+	 *  @param b2 the brick index along the second dimension
+	 *  @param b3 the brick index along the third dimension
+	 *  @return the brick, or an empty pointer if the indices are invalid
+	 */
+	std::shared_ptr<const Brick> getBrick(int b1, int b2, int b3) const;
+
+	/** Call f for every brick, in file order. Only the brick being visited
+	 *  (and those still in the cache) is resident.
+	 */
+	void forEachBrick(const std::function<void(const Brick&)>& f) const;
+
+	/** Return an element at a specific location (slow: see the file comment)
+	 *  @param i1 the first index
+	 *  @param i2 the second index
+	 *  @param i3 the third index
+	 *  @return the element at the given location, if [i1][i2][i3] represents a
+	 *     valid array access. Otherwise returns T().
+	 */
+	T getDataElement(int i1, int i2, int i3) const;
+
+	/** Return the number of bricks gathered from the file so far; comparing
+	 *  this to the number of bricks requested shows the cache's effectiveness.
+	 */
+	size_t getNumBrickLoads() const;
+
+private:
+	Bricked3DArray(const Bricked3DArray<T>& b); // cannot use the copy constructor
+
+	typedef std::list< std::pair<size_t, std::shared_ptr<const Brick> > > LRUList;
+
+	int		numBricks(int dim) const { return (dim + mBrickSize - 1) / mBrickSize; }
+	std::shared_ptr<const Brick> loadBrick(int b1, int b2, int b3) const;
+
+	int		mDim1, mDim2, mDim3;
+	int		mBrickSize;
+	size_t	mMaxResidentBricks;
+
+	void*		mMapped; // the whole file
+	size_t		mMappedSize;
+	const T*	mArray; // the first element, within the mapped file
+
+	// The cache: most recently used brick first. Guarded by mMutex.
+	mutable std::mutex	mMutex;
+	mutable LRUList		mLRU;
+	mutable std::unordered_map<size_t, typename LRUList::iterator>	mLRUIndex;
+	mutable size_t		mNumBrickLoads;
+};
+
+template <typename T>
+Bricked3DArray<T>::Bricked3DArray(const std::string& fileName,
+	int dim1, int dim2, int dim3, int brickSize, size_t maxResidentBricks,
+	size_t headerBytes) :
+		mDim1(dim1), mDim2(dim2), mDim3(dim3), mBrickSize(brickSize),
+		mMaxResidentBricks(std::max<size_t>(maxResidentBricks, 1)),
+		mMapped(nullptr), mMappedSize(0), mArray(nullptr), mNumBrickLoads(0)
+{
+	if ( (dim1 < 1) || (dim2 < 1) || (dim3 < 1) || (brickSize < 1) )
+	{
+		std::cerr << "Bricked3DArray: Invalid dimensions: (" << dim1 << ", "
+		          << dim2 << ", " << dim3 << "), brick size " << brickSize << '\n';
+		return;
+	}
+	if (headerBytes % alignof(T) != 0)
+	{
+		// mArray would be a misaligned T*
+		std::cerr << "Bricked3DArray: a header of " << headerBytes
+		          << " bytes leaves the elements misaligned\n";
+		return;
+	}
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cerr << "Bricked3DArray: could not open " << fileName << '\n';
+		return;
+	}
+	size_t needed = headerBytes + static_cast<size_t>(dim1) * dim2 * dim3 * sizeof(T);
+	struct stat sb;
+	if ((fstat(fd, &sb) != 0) || (static_cast<size_t>(sb.st_size) < needed))
+		std::cerr << "Bricked3DArray: " << fileName << " is smaller than ("
+		          << dim1 << ", " << dim2 << ", " << dim3 << ") elements\n";
+	else
+	{
+		void* p = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+			std::cerr << "Bricked3DArray: could not map " << fileName << '\n';
+		else
+		{
+			mMapped = p;
+			mMappedSize = sb.st_size;
+			mArray = reinterpret_cast<const T*>(static_cast<const char*>(p) + headerBytes);
+		}
+	}
+	close(fd);
+}
+
+template <typename T>
+Bricked3DArray<T>::~Bricked3DArray()
+{
+	if (mMapped != nullptr)
+		munmap(mMapped, mMappedSize);
+}
+
+template <typename T>
+std::shared_ptr<const typename Bricked3DArray<T>::Brick>
+	Bricked3DArray<T>::getBrick(int b1, int b2, int b3) const
+{
+	if ( !isValid() ||
+	     (b1 < 0) || (b1 >= getNumBricks1()) ||
+	     (b2 < 0) || (b2 >= getNumBricks2()) ||
+	     (b3 < 0) || (b3 >= getNumBricks3()) )
+		return std::shared_ptr<const Brick>();
+	size_t key = (static_cast<size_t>(b1) * getNumBricks2() + b2) * getNumBricks3() + b3;
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	auto found = mLRUIndex.find(key);
+	if (found != mLRUIndex.end())
+	{
+		mLRU.splice(mLRU.begin(), mLRU, found->second);
+		return found->second->second;
+	}
+	// Gather the brick without holding the lock so that other threads can
+	// use resident bricks in the meantime.
+	lock.unlock();
+	std::shared_ptr<const Brick> brick = loadBrick(b1, b2, b3);
+	lock.lock();
+	mNumBrickLoads++;
+	found = mLRUIndex.find(key);
+	if (found != mLRUIndex.end()) // another thread loaded it first
+	{
+		mLRU.splice(mLRU.begin(), mLRU, found->second);
+		return found->second->second;
+	}
+	mLRU.push_front(std::make_pair(key, brick));
+	mLRUIndex[key] = mLRU.begin();
+	while (mLRU.size() > mMaxResidentBricks)
+	{
+		mLRUIndex.erase(mLRU.back().first);
+		mLRU.pop_back();
+	}
+	return brick;
+}
+
+template <typename T>
+std::shared_ptr<const typename Bricked3DArray<T>::Brick>
+	Bricked3DArray<T>::loadBrick(int b1, int b2, int b3) const
+{
+	int f1 = b1 * mBrickSize, f2 = b2 * mBrickSize, f3 = b3 * mBrickSize;
+	int n1 = std::min(mBrickSize, mDim1 - f1);
+	int n2 = std::min(mBrickSize, mDim2 - f2);
+	int n3 = std::min(mBrickSize, mDim3 - f3);
+	std::shared_ptr<Brick> brick = std::make_shared<Brick>(f1, f2, f3, n1, n2, n3);
+	for (int i1=0 ; i1<n1 ; i1++)
+		for (int i2=0 ; i2<n2 ; i2++)
+		{
+			const T* from = mArray +
+				(static_cast<size_t>(f1 + i1) * mDim2 + (f2 + i2)) * mDim3 + f3;
+			std::copy(from, from + n3, &brick->data(i1, i2, 0));
+		}
+	return brick;
+}
+
+template <typename T>
+void Bricked3DArray<T>::forEachBrick(const std::function<void(const Brick&)>& f) const
+{
+	for (int b1=0 ; b1<getNumBricks1() ; b1++)
+		for (int b2=0 ; b2<getNumBricks2() ; b2++)
+			for (int b3=0 ; b3<getNumBricks3() ; b3++)
+			{
+				std::shared_ptr<const Brick> brick = getBrick(b1, b2, b3);
+				if (brick)
+					f(*brick);
+			}
+}
+
+template <typename T>
+T Bricked3DArray<T>::getDataElement(int i1, int i2, int i3) const
+{
+	if ( (i1 < 0) || (i1 >= mDim1) || (i2 < 0) || (i2 >= mDim2) ||
+	     (i3 < 0) || (i3 >= mDim3) )
+	{
+		std::cerr << "getDataElement: Invalid data element reference: ("
+		          << i1 << ", " << i2 << ", " << i3 << ')' << std::endl;
+		return T();
+	}
+	std::shared_ptr<const Brick> brick =
+		getBrick(i1 / mBrickSize, i2 / mBrickSize, i3 / mBrickSize);
+	if (!brick)
+		return T();
+	return brick->data(i1 - brick->first1, i2 - brick->first2, i3 - brick->first3);
+}
+
+template <typename T>
+size_t Bricked3DArray<T>::getNumBrickLoads() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mNumBrickLoads;
+}
+
+}
+
+#endif
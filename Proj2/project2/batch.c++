@@ -0,0 +1,79 @@
+// batch.c++: Benchmark of ImageReader::createAll. Reads the given images with
+// 1, 2, 4, ... worker threads (up to the number of hardware threads) and
+// reports the throughput in files per second for each thread count.
+// The files are first probed (ImageReader::probe) so that they can be handed
+// to the workers largest first, which keeps one big image from being left
+// until the end.
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "ImageReader.h"
+
+double filesPerSecond(const std::vector<std::string>& files, int nThreads)
+{
+	size_t nRead = 0;
+	auto start = std::chrono::steady_clock::now();
+	ImageReader::createAll(files, [&](int, ImageReader* ir)
+		{
+			if (ir != nullptr)
+				nRead++;
+			delete ir;
+		}, nThreads);
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+	if (nRead != files.size())
+		std::cerr << (files.size() - nRead) << " file(s) could not be read\n";
+	return files.size() / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " imageFileName ...\n";
+		return 1;
+	}
+	std::vector<std::string> files(argv + 1, argv + argc);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector< std::pair<long, std::string> > bySize;
+	long totalPixels = 0;
+	for (size_t i=0 ; i<files.size() ; i++)
+	{
+		ImageReader::Info info;
+		long nPixels = 0;
+		if (ImageReader::probe(files[i], info))
+			nPixels = static_cast<long>(info.width) * info.height;
+		bySize.push_back(std::make_pair(nPixels, files[i]));
+		totalPixels += nPixels;
+	}
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+	std::cout << "probed " << files.size() << " files (" << (totalPixels / 1.0e6)
+	          << " Mpixels) in " << (elapsed.count() * 1.0e3) << " ms\n";
+	std::sort(bySize.begin(), bySize.end(),
+		[](const std::pair<long, std::string>& a,
+		   const std::pair<long, std::string>& b) { return a.first > b.first; });
+	for (size_t i=0 ; i<files.size() ; i++)
+		files[i] = bySize[i].second;
+
+	int maxThreads = std::thread::hardware_concurrency();
+	if (maxThreads < 1)
+		maxThreads = 1;
+
+	// warm the file system cache so that all runs measure decoding
+	filesPerSecond(files, maxThreads);
+
+	for (int nThreads=1 ; ; nThreads*=2)
+	{
+		if (nThreads > maxThreads)
+			nThreads = maxThreads;
+		double rate = filesPerSecond(files, nThreads);
+		std::cout << "threads: " << nThreads << "\tfiles/sec: " << rate << '\n';
+		if (nThreads == maxThreads)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,136 @@
+// bricks.c++: Checks of Bricked3DArray against the raw file it reads. A small
+// file of unsigned short elements (with a header) is written whose size is
+// not a multiple of the brick size, and then every brick, the edge bricks,
+// the LRU cache, and getDataElement are compared with the file's contents.
+// Exits with status 1 if any check fails.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+
+#include "Bricked3DArray.h"
+#include "check.h"
+
+typedef cryph::Bricked3DArray<uint16_t> Bricked;
+
+static const int D1 = 37, D2 = 29, D3 = 23, BRICK = 8;
+static const size_t HEADER = 6;
+
+static char fileName[] = "/tmp/bricksXXXXXX";
+
+// The element [i1][i2][i3] as it is in the file (read back, not recomputed)
+static uint16_t fileElement(FILE* fp, int i1, int i2, int i3)
+{
+	size_t offset = HEADER + ((static_cast<size_t>(i1) * D2 + i2) * D3 + i3) * sizeof(uint16_t);
+	uint16_t v = 0;
+	if ((fseek(fp, offset, SEEK_SET) != 0) || (fread(&v, sizeof(v), 1, fp) != 1))
+	{
+		std::cerr << "could not read the raw file\n";
+		exit(1);
+	}
+	return v;
+}
+
+static void checkBricks(const Bricked& a, FILE* fp)
+{
+	check((a.getNumBricks1() == 5) && (a.getNumBricks2() == 4) && (a.getNumBricks3() == 3),
+		"number of bricks along each dimension");
+
+	// Every brick holds its part of the file, and together they cover it once
+	bool same = true, sized = true;
+	size_t nElements = 0;
+	a.forEachBrick([&](const Bricked::Brick& b)
+		{
+			int n1 = b.data.getDim1(), n2 = b.data.getDim2(), n3 = b.data.getDim3();
+			sized = sized && (n1 == std::min(BRICK, D1 - b.first1)) &&
+				(n2 == std::min(BRICK, D2 - b.first2)) && (n3 == std::min(BRICK, D3 - b.first3));
+			for (int i1=0 ; i1<n1 ; i1++)
+				for (int i2=0 ; i2<n2 ; i2++)
+					for (int i3=0 ; i3<n3 ; i3++)
+						same = same && (b.data(i1, i2, i3) ==
+							fileElement(fp, b.first1 + i1, b.first2 + i2, b.first3 + i3));
+			nElements += b.data.getTotalNumberElements();
+		});
+	check(same, "forEachBrick: every element matches the file");
+	check(sized, "forEachBrick: brick extents (edge bricks are smaller)");
+	check(nElements == static_cast<size_t>(D1) * D2 * D3, "forEachBrick: the bricks cover the array once");
+
+	// The far corner brick is 5 x 5 x 7
+	std::shared_ptr<const Bricked::Brick> corner = a.getBrick(4, 3, 2);
+	check(corner && (corner->first1 == 32) && (corner->first2 == 24) && (corner->first3 == 16) &&
+		(corner->data.getDim1() == 5) && (corner->data.getDim2() == 5) && (corner->data.getDim3() == 7),
+		"getBrick: the far corner brick");
+	check(corner && (corner->data(4, 4, 6) == fileElement(fp, D1-1, D2-1, D3-1)),
+		"getBrick: the last element");
+	check(!a.getBrick(5, 0, 0) && !a.getBrick(0, -1, 0) && !a.getBrick(0, 0, 3),
+		"getBrick: invalid brick indices");
+}
+
+static void checkCache(FILE* fp)
+{
+	Bricked a(fileName, D1, D2, D3, BRICK, 2, HEADER);
+	a.getBrick(0, 0, 0);
+	a.getBrick(0, 0, 1);
+	a.getBrick(0, 0, 0);
+	check(a.getNumBrickLoads() == 2, "cache: a resident brick is not loaded again");
+	std::shared_ptr<const Bricked::Brick> held = a.getBrick(0, 0, 1);
+	a.getBrick(0, 0, 2); // evicts the least recently used: (0, 0, 0)
+	check(a.getNumBrickLoads() == 3, "cache: a third brick is loaded");
+	a.getBrick(0, 0, 1);
+	check(a.getNumBrickLoads() == 3, "cache: the recently used brick stays resident");
+	a.getBrick(0, 0, 0);
+	check(a.getNumBrickLoads() == 4, "cache: the least recently used brick was evicted");
+	a.getBrick(0, 0, 2); // (0, 0, 1) is evicted now, but still held here
+	check(held->data(1, 2, 3) == fileElement(fp, 1, 2, BRICK + 3),
+		"cache: an evicted brick stays valid while it is held");
+
+	bool same = true;
+	for (int n=0 ; n<500 ; n++)
+	{
+		int i1 = rand() % D1, i2 = rand() % D2, i3 = rand() % D3;
+		same = same && (a.getDataElement(i1, i2, i3) == fileElement(fp, i1, i2, i3));
+	}
+	check(same, "getDataElement: random elements match the file");
+	check(a.getDataElement(D1-1, D2-1, D3-1) == fileElement(fp, D1-1, D2-1, D3-1),
+		"getDataElement: the last element");
+}
+
+int main()
+{
+	// The header is followed by D1 x D2 x D3 elements of a pattern that
+	// differs from element to element
+	std::vector<uint16_t> elements(static_cast<size_t>(D1) * D2 * D3);
+	for (size_t i=0 ; i<elements.size() ; i++)
+		elements[i] = static_cast<uint16_t>(i * 2654435761u >> 7);
+	int fd = mkstemp(fileName);
+	FILE* out = (fd < 0) ? nullptr : fdopen(fd, "wb");
+	char header[HEADER] = { 'B', 'R', 'I', 'C', 'K', 'S' };
+	if ((out == nullptr) || (fwrite(header, 1, HEADER, out) != HEADER) ||
+		(fwrite(elements.data(), sizeof(uint16_t), elements.size(), out) != elements.size()))
+	{
+		std::cerr << "could not write " << fileName << '\n';
+		return 1;
+	}
+	fclose(out);
+	FILE* fp = fopen(fileName, "rb");
+
+	Bricked a(fileName, D1, D2, D3, BRICK, 64, HEADER);
+	check(a.isValid(), "the file opens");
+	if (a.isValid())
+	{
+		checkBricks(a, fp);
+		checkCache(fp);
+	}
+	check(!Bricked(fileName, D1, D2, D3, BRICK, 64, HEADER + 1).isValid(),
+		"a misaligned header is rejected");
+	check(!Bricked(fileName, D1, D2, D3 + 1, BRICK, 64, HEADER).isValid(),
+		"a file that is too small is rejected");
+
+	fclose(fp);
+	unlink(fileName);
+	return checksPassed();
+}
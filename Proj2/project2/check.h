@@ -0,0 +1,30 @@
+// check.h: The assertion helper of the project2 check programs (largeArrays,
+// bricks). Each check prints one line; checksPassed reports the total and
+// gives main its exit status (1 if any check failed).
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+static int nFailed = 0;
+
+static void check(bool ok, const char* what)
+{
+	std::cout << (ok ? "ok      " : "FAILED  ") << what << '\n';
+	if (!ok)
+		nFailed++;
+}
+
+static int checksPassed()
+{
+	if (nFailed > 0)
+	{
+		std::cout << nFailed << " check(s) FAILED\n";
+		return 1;
+	}
+	std::cout << "all checks passed\n";
+	return 0;
+}
+
+#endif
@@ -0,0 +1,129 @@
+// largeArrays.c++: Checks of the 64-bit size and offset arithmetic of
+// Packed3DArray and of the Proj3 volume sizes, on arrays of more than 2^32
+// elements. The arrays are views of an anonymous mapping that is reserved
+// but never filled, so only the pages actually touched (those at the far
+// end) use memory. Exits with status 1 if any check fails.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "Packed3DArray.h"
+#include "check.h"
+#include "VolumeFile.hpp"
+#include "Voxel.hpp"
+
+// 'nBytes' of address space, zero until touched
+static unsigned char* reserve(size_t nBytes)
+{
+	void* p = mmap(nullptr, nBytes, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+	{
+		std::cerr << "could not reserve " << nBytes << " bytes\n";
+		exit(1);
+	}
+	return static_cast<unsigned char*>(p);
+}
+
+// An interleaved 2048 x 2048 x 1100 array: 4.6e9 elements
+static void checkInterleaved()
+{
+	const int d1 = 2048, d2 = 2048, d3 = 1100;
+	const size_t total = static_cast<size_t>(d1) * d2 * d3;
+	unsigned char* buf = reserve(total);
+	{
+		cryph::Packed3DArray<unsigned char> a(d1, d2, d3, buf, nullptr);
+		check(a.getTotalNumberElements() == total, "interleaved: getTotalNumberElements");
+		check(a.getTotalNumberElements() > (static_cast<size_t>(1) << 32),
+			"interleaved: more than 2^32 elements");
+		check(a.end() - a.begin() == static_cast<ptrdiff_t>(total), "interleaved: end - begin");
+
+		const unsigned char* last = a.getDataElementLoc(d1-1, d2-1, d3-1);
+		check(last == buf + total - 1, "interleaved: offset of the last element");
+		check(&a(d1-1, 0, 0) == buf + static_cast<size_t>(d1-1) * d2 * d3,
+			"interleaved: offset of the last row");
+
+		a.setDataElement(d1-1, d2-1, d3-1, 200);
+		check(buf[total-1] == 200, "interleaved: setDataElement at the far end");
+		check(a.getDataElement(d1-1, d2-1, d3-1) == 200, "interleaved: getDataElement at the far end");
+
+		cryph::ArraySpan<unsigned char> row = a.getSlice(d1-1);
+		check(row.size() == static_cast<size_t>(d2) * d3, "interleaved: getSlice(i1) size");
+		check(row.end() == buf + total, "interleaved: getSlice(i1) ends at the end");
+		cryph::ArraySpan<unsigned char> pixel = a.getSlice(d1-1, d2-1);
+		check(pixel.size() == d3 && pixel[d3-1] == 200, "interleaved: getSlice(i1, i2) at the far end");
+
+		cryph::StridedView<unsigned char> channel = a.getChannel(d3-1);
+		check(channel.size() == static_cast<size_t>(d1) * d2, "interleaved: getChannel size");
+		check(channel.stride() == d3, "interleaved: getChannel stride");
+		check(channel[channel.size()-1] == 200, "interleaved: getChannel at the far end");
+		check(&*(channel.end() - 1) == buf + total - 1, "interleaved: getChannel end");
+	}
+	munmap(buf, total);
+}
+
+// A planar 3 x 40000 x 36000 image (channel-major): 4.3e9 elements
+static void checkPlanar()
+{
+	const int d1 = 40000, d2 = 36000, d3 = 3;
+	const size_t total = static_cast<size_t>(d1) * d2 * d3;
+	const size_t plane = static_cast<size_t>(d1) * d2;
+	unsigned char* buf = reserve(total);
+	{
+		cryph::Packed3DArray<unsigned char, cryph::Planar> a(d1, d2, d3, buf, nullptr);
+		check(a.getTotalNumberElements() == total, "planar: getTotalNumberElements");
+		check(a.getDataElementLoc(d1-1, d2-1, d3-1) == buf + total - 1,
+			"planar: offset of the last element");
+		check(a.getDataElementLoc(d1-1, d2-1, 1) == buf + 2 * plane - 1,
+			"planar: offset of the last element of a middle plane");
+
+		a.setDataElement(d1-1, d2-1, d3-1, 77);
+		check(buf[total-1] == 77, "planar: setDataElement at the far end");
+		cryph::ArraySpan<unsigned char> last = a.getPlane(d3-1);
+		check(last.size() == plane && last.begin() == buf + 2 * plane, "planar: getPlane");
+		check(last[plane-1] == 77, "planar: getPlane at the far end");
+		cryph::StridedView<unsigned char> channel = a.getChannel(d3-1);
+		check(channel.size() == plane && channel.stride() == 1 && channel[plane-1] == 77,
+			"planar: getChannel at the far end");
+	}
+	munmap(buf, total);
+}
+
+// The sizes Proj3 computes for a 2048^3 volume: VolumeFile::getBytes (from
+// a sparse raw file) and the device buffer size of setVolume (volumeBytes)
+static void checkVolumeSizes()
+{
+	const int n = 2048;
+	const size_t voxels = static_cast<size_t>(n) * n * n;
+	check(volumeBytes(n, n, n, VOXEL_U8) == voxels, "volume: volumeBytes u8");
+	check(volumeBytes(n, n, n, VOXEL_U16) == 2 * voxels, "volume: volumeBytes u16");
+	check(volumeBytes(n, n, n, VOXEL_F32) == 4 * voxels, "volume: volumeBytes f32");
+
+	char fileName[] = "/tmp/largeArraysXXXXXX";
+	int fd = mkstemp(fileName);
+	if ((fd < 0) || (ftruncate(fd, 2 * voxels) != 0))
+	{
+		std::cerr << "could not make a sparse file of " << 2 * voxels << " bytes\n";
+		exit(1);
+	}
+	close(fd);
+	VolumeFile u8, u16;
+	check(u8.open(fileName, n, n, n) && (u8.getBytes() == voxels) && (u8.getVoxelCount() == voxels),
+		"volume: VolumeFile::getBytes u8 (the file has bytes to spare)");
+	check(u16.open(fileName, n, n, n, VOXEL_U16) && (u16.getBytes() == 2 * voxels),
+		"volume: VolumeFile::getBytes u16");
+	unlink(fileName);
+}
+
+int main()
+{
+	checkInterleaved();
+	checkPlanar();
+	checkVolumeSizes();
+	return checksPassed();
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <math.h>
 #include <stdlib.h>
@@ -5,6 +6,7 @@
 #include <mpi.h>
 
 #include "ImageReader.h"
+#include "MappedFile.h"
 
 #define DEBUG 1
 #define COLORS 3
@@ -107,14 +109,12 @@ int** ColorCount(cryph::Packed3DArray<unsigned char>* pa)
     for (int i = 0; i < COLORS; i++) {
         colorCount[i] = new int[RANGE]();
     }
-    // Tally color count
-    for (int r = 0; r < pa->getDim1(); r++) {
-        for (int c = 0; c < pa->getDim2(); c++) {
-            for (int rgb = 0; rgb < pa->getDim3(); rgb++) {
-                // calculate
-                auto el = (int)pa->getDataElement(r, c, rgb);
-                colorCount[rgb][el] += 1;
-            }
+    // Tally color count, one channel at a time (any alpha channel is ignored)
+    int nColors = std::min(pa->getDim3(), COLORS);
+    for (int rgb = 0; rgb < nColors; rgb++) {
+        auto count = colorCount[rgb];
+        for (auto el : pa->getChannel(rgb)) {
+            count[el] += 1;
         }
     }
     return colorCount;
@@ -131,7 +131,7 @@ float** CalculateHistogram(cryph::Packed3DArray<unsigned char>* pa)
     auto colorCount = ColorCount(pa);
     auto proportions = new float*[COLORS];
 
-    auto denominator = pa->getTotalNumberElements() / 3.0;
+    auto denominator = (double)pa->getDim1() * pa->getDim2(); // pixel count
 
     for (int i = 0; i < COLORS; i++) {
         proportions[i] = new float[RANGE]();
@@ -312,41 +312,29 @@ int main(int argc, char* argv[]) {
     int flatSize = RANGE  * COLORS;
     if (rank == 0) {
 
-        // Read in each image
-        cryph::Packed3DArray<unsigned char>* localImage;
-        for (int i = 0; i < imgCount; i++) {
+        // Send each of the other images to its rank as the compressed file
+        // contents; it is decoded there.
+        for (int i = 1; i < imgCount; i++) {
             auto file = argv[i + 1];
-            std::cout << "rank 0: Reading file: " << file << std::endl;
-            auto ir = ImageReader::create(file);
-            if (ir == nullptr) {
+            MappedFile bytes(file);
+            if (!bytes.isValid()) {
                 std::cerr << "Could not open image file " << file << std::endl;
-                exit(1);
-            }
-            auto pa = ir->getInternalPacked3DArrayImage();
-
-            // Save to local rank
-            if (i == 0) {
-                std::cout << "rank 0: assigning rank 0 image\n";
-                localImage = pa;
-            } else {
-                // Send data to other processes
-                auto dims = new int[3]();
-                auto a = pa->getDim1();
-                auto b = pa->getDim2();
-                auto c = pa->getDim3();
-                auto size = a * b * c;
-                dims[0] = a;
-                dims[1] = b;
-                dims[2] = c;
-                auto data = pa->getData();
-                std::cout << "rank 0: sending rank: " << i << " dimensions\n";
-                MPI_Send(dims, 3, MPI_INT, i, msgTag, MPI_COMM_WORLD);
-                std::cout << "rank 0: sending rank: " << i << " data of size: " << size << std::endl;
-                MPI_Send(data, size, MPI_UNSIGNED_CHAR, i, msgTag, MPI_COMM_WORLD);
-                delete[] dims;
-                delete[] data;
+                MPI_Abort(MPI_COMM_WORLD, 1);
             }
+            std::cout << "rank 0: sending rank: " << i << " file: " << file
+                      << " of size: " << bytes.getSize() << std::endl;
+            MPI_Send(bytes.getData(), bytes.getSize(), MPI_UNSIGNED_CHAR, i, msgTag, MPI_COMM_WORLD);
+        }
+
+        // Read the rank 0 image
+        auto file = argv[1];
+        std::cout << "rank 0: Reading file: " << file << std::endl;
+        auto ir = ImageReader::create(file);
+        if (ir == nullptr) {
+            std::cerr << "Could not open image file " << file << std::endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        auto localImage = ir->getInternalPacked3DArrayImage();
 
         /*
          * Do rank 0 calculations
@@ -410,25 +398,27 @@ int main(int argc, char* argv[]) {
     } else {
         MPI_Request req;
 
-        // Get dimensions
-        int recDims[3];
+        // Receive the compressed image file; its size is that of the message
         MPI_Status status;
-        std::cout << "rank " << rank << ": waiting on dimensions\n";
-        MPI_Recv(&recDims, 3, MPI_INT, 0, msgTag, MPI_COMM_WORLD, &status);
-        int totalSize = recDims[0] * recDims[1] * recDims[2];
-        std::cout << "rank " << rank << ": image size received: " << totalSize << std::endl;
-
-        // Read image data
-        auto dataBuffer = new unsigned char[totalSize];
-        std::cout << "rank " << rank << ": waiting on image data\n";
-        MPI_Recv(dataBuffer, totalSize, MPI_UNSIGNED_CHAR, 0, msgTag, MPI_COMM_WORLD, &status);
-        std::cout << "rank " << rank << ": image data received\n";
-
-        cryph::Packed3DArray<unsigned char> array(recDims[0], recDims[1], recDims[2], dataBuffer);
-        delete[] dataBuffer;
+        std::cout << "rank " << rank << ": waiting on image file\n";
+        MPI_Probe(0, msgTag, MPI_COMM_WORLD, &status);
+        int fileSize;
+        MPI_Get_count(&status, MPI_UNSIGNED_CHAR, &fileSize);
+        auto fileBuffer = new unsigned char[fileSize];
+        MPI_Recv(fileBuffer, fileSize, MPI_UNSIGNED_CHAR, 0, msgTag, MPI_COMM_WORLD, &status);
+        std::cout << "rank " << rank << ": image file of size: " << fileSize << " received\n";
+
+        // Decode it
+        auto ir = ImageReader::createFromMemory(fileBuffer, fileSize);
+        delete[] fileBuffer;
+        if (ir == nullptr) {
+            std::cerr << "rank " << rank << ": could not decode image\n";
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        auto image = ir->getInternalPacked3DArrayImage();
 
         // Do histogram calculations
-        auto hist = CalculateHistogram(&array); // 3 x 256
+        auto hist = CalculateHistogram(image); // 3 x 256
         auto flatHist = Flatten2D(hist, COLORS, RANGE); // 1 x 768
 
         // Send histograms back to rank 0
@@ -1,25 +1,34 @@
 // sample.c++: Code showing how to use ImageReader and Packed3DArray
 
+#include <algorithm>
+#include <numeric>
+
 #include "ImageReader.h"
 
 void count(const cryph::Packed3DArray<unsigned char>* pa)
 {
 	// This simple example shows counting the number of instances of 138
 	// in the provided image.
-	int count = 0;
-	// FOR EACH ROW OF THE IMAGE:
-	for (int r=0 ; r<pa->getDim1() ; r++)
+	// Packed3DArray provides begin/end, so standard algorithms can be used to
+	// visit every channel of every pixel.
+	long count = std::count(pa->begin(), pa->end(), 138);
+	std::cout << "There were " << count << " instances of 138 in the image.\n";
+}
+
+void channelMeans(const ImageReader* ir)
+{
+	// Per-channel computations are fastest on a planar copy of the image,
+	// in which all samples of a channel are contiguous.
+	cryph::Packed3DArray<unsigned char, cryph::Planar>* planar =
+		ir->createPlanarImage();
+	for (int ch=0 ; ch<planar->getDim3() ; ch++)
 	{
-		// FOR EACH COLUMN:
-		for (int c=0 ; c<pa->getDim2() ; c++)
-		{
-			// FOR EACH CHANNEL (r, g, b):
-			for (int rgb=0 ; rgb<pa->getDim3() ; rgb++)
-				if (pa->getDataElement(r, c, rgb) == 138)
-					count++;
-		}
+		cryph::ArraySpan<unsigned char> plane = planar->getPlane(ch);
+		long sum = std::accumulate(plane.begin(), plane.end(), 0L);
+		std::cout << "Mean of channel " << ch << ": "
+		          << (static_cast<double>(sum) / plane.size()) << '\n';
 	}
-	std::cout << "There were " << count << " instances of 138 in the image.\n";
+	delete planar;
 }
 
 int main(int argc, char* argv[])
@@ -32,7 +41,11 @@ int main(int argc, char* argv[])
 		if (ir == nullptr)
 			std::cerr << "Could not open image file: " << argv[1] << '\n';
 		else
+		{
 			count(ir->getInternalPacked3DArrayImage());
+			channelMeans(ir);
+			delete ir;
+		}
 	}
 	return 0;
 }
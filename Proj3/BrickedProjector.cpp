@@ -0,0 +1,209 @@
+#include "BrickedProjector.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+// The brick being projected and the next one, gathered from the file meanwhile
+static const size_t RESIDENT_BRICKS = 2;
+
+BrickedProjector::BrickedProjector(const std::string& fileName, size_t dataOffset, int rows, int cols,
+                                   int sheets, VoxelType type, int brickSize, int numThreads) :
+    rows(rows), cols(cols), sheets(sheets), brickSize(brickSize),
+    numThreads(threadCount(numThreads))
+{
+    if (type == VOXEL_U8) {
+        u8Volume.reset(new cryph::Bricked3DArray<unsigned char>(fileName, sheets, cols, rows, brickSize,
+                                                                RESIDENT_BRICKS, dataOffset));
+    }
+    else if (type == VOXEL_U16) {
+        u16Volume.reset(new cryph::Bricked3DArray<uint16_t>(fileName, sheets, cols, rows, brickSize,
+                                                            RESIDENT_BRICKS, dataOffset));
+    }
+    else {
+        f32Volume.reset(new cryph::Bricked3DArray<float>(fileName, sheets, cols, rows, brickSize,
+                                                         RESIDENT_BRICKS, dataOffset));
+    }
+}
+
+bool BrickedProjector::isValid() const
+{
+    if (u8Volume)
+        return u8Volume->isValid();
+    if (u16Volume)
+        return u16Volume->isValid();
+    return f32Volume->isValid();
+}
+
+void BrickedProjector::range(double& low, double& high) const
+{
+    if (u8Volume)
+        rangeOf(*u8Volume, low, high);
+    else if (u16Volume)
+        rangeOf(*u16Volume, low, high);
+    else
+        rangeOf(*f32Volume, low, high);
+}
+
+void BrickedProjector::project(const std::vector<Projection>& projections, const VoxelFormat& format,
+                               const std::vector<unsigned char*>& maxImgs,
+                               const std::vector<uint64_t*>& workSums) const
+{
+    if (u8Volume)
+        projectAll(*u8Volume, projections, format, maxImgs, workSums);
+    else if (u16Volume)
+        projectAll(*u16Volume, projections, format, maxImgs, workSums);
+    else
+        projectAll(*f32Volume, projections, format, maxImgs, workSums);
+}
+
+/** The bricks are gathered and reduced by the threads independently */
+template <typename T>
+void BrickedProjector::rangeOf(const cryph::Bricked3DArray<T>& volume, double& low, double& high) const
+{
+    int nb2 = volume.getNumBricks2(), nb3 = volume.getNumBricks3();
+    int numBricks = volume.getNumBricks1() * nb2 * nb3;
+    low = std::numeric_limits<double>::infinity();
+    high = -std::numeric_limits<double>::infinity();
+    std::mutex mutex;
+    parallelForEach(numBricks, numThreads, [&](int b) {
+        auto brick = volume.getBrick(b / (nb2 * nb3), (b / nb3) % nb2, b % nb3);
+        double brickLow = std::numeric_limits<double>::infinity();
+        double brickHigh = -std::numeric_limits<double>::infinity();
+        for (T voxel : brick->data) {
+            double v = voxel;
+            brickLow = std::min(brickLow, v); // NaNs are skipped
+            brickHigh = std::max(brickHigh, v);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        low = std::min(low, brickLow);
+        high = std::max(high, brickHigh);
+    });
+}
+
+// The voxels of a brick: sheets z0 to z0+nz-1, and so on
+struct BrickBox
+{
+    int z0, x0, y0;
+    int nz, nx, ny;
+};
+
+/**
+ * Accumulate part numParts of a brick of 8 bit values (element [z][x][y] at
+ * (z * nx + x) * ny + y) into projection p. Types 3 and 4 split the brick by
+ * sheets, which are columns of their images, and the others by columns x,
+ * so no two parts write the same pixel.
+ */
+static void projectBrick(const Projection& p, int rows, int cols, int sheets, const unsigned char* values,
+                         const BrickBox& box, int part, int numParts, unsigned char* maxImg,
+                         uint64_t* workSum)
+{
+    bool bySheets = (p.type == 3 || p.type == 4);
+    int n = bySheets ? box.nz : box.nx;
+    int begin = n * part / numParts, end = n * (part + 1) / numParts;
+    int zBegin = bySheets ? begin : 0, zEnd = bySheets ? end : box.nz;
+    int xBegin = bySheets ? 0 : begin, xEnd = bySheets ? box.nx : end;
+    const long W = p.outCols;
+
+    for (int z = zBegin; z < zEnd; z++) {
+        for (int x = xBegin; x < xEnd; x++) {
+            const unsigned char* run = values + (static_cast<size_t>(z) * box.nx + x) * box.ny;
+            int Z = box.z0 + z, X = box.x0 + x;
+            if (p.type <= 4) {
+                // The run is part of image column u (v = y), all at sample i
+                int u, i;
+                switch (p.type) {
+                    case 1: u = X; i = Z; break;
+                    case 2: u = cols - 1 - X; i = sheets - 1 - Z; break;
+                    case 3: u = sheets - 1 - Z; i = X; break;
+                    default: u = Z; i = cols - 1 - X; break;
+                }
+                const uint64_t weight = i + 1;
+                unsigned char* m = maxImg + box.y0 * W + u;
+                uint64_t* s = workSum + box.y0 * W + u;
+                for (int y = 0; y < box.ny; y++) {
+                    m[y * W] = std::max(m[y * W], run[y]);
+                    s[y * W] += weight * run[y];
+                }
+            }
+            else {
+                // The run is part of the ray of pixel (X, v): samples y0 on
+                // for type 5, and rows-1-y0 back for type 6
+                int v = (p.type == 5) ? sheets - 1 - Z : Z;
+                unsigned char m = 0;
+                uint64_t s = 0;
+                for (int y = 0; y < box.ny; y++) {
+                    uint64_t weight = (p.type == 5) ? box.y0 + y + 1 : rows - (box.y0 + y);
+                    m = std::max(m, run[y]);
+                    s += weight * run[y];
+                }
+                size_t ndx = static_cast<size_t>(v) * W + X;
+                maxImg[ndx] = std::max(maxImg[ndx], m);
+                workSum[ndx] += s;
+            }
+        }
+    }
+}
+
+/**
+ * The bricks are visited in file order, one at a time: each is windowed to 8
+ * bits, and then parts of it are accumulated into every view by the threads,
+ * while the next brick is gathered from the file
+ */
+template <typename T>
+void BrickedProjector::projectAll(const cryph::Bricked3DArray<T>& volume,
+                                  const std::vector<Projection>& projections, const VoxelFormat& format,
+                                  const std::vector<unsigned char*>& maxImgs,
+                                  const std::vector<uint64_t*>& workSums) const
+{
+    for (size_t k = 0; k < projections.size(); k++) {
+        size_t pixels = static_cast<size_t>(projections[k].outRows) * projections[k].outCols;
+        std::fill(maxImgs[k], maxImgs[k] + pixels, 0);
+        std::fill(workSums[k], workSums[k] + pixels, 0);
+    }
+
+    typedef std::shared_ptr<const typename cryph::Bricked3DArray<T>::Brick> BrickPtr;
+    int nb2 = volume.getNumBricks2(), nb3 = volume.getNumBricks3();
+    int numBricks = volume.getNumBricks1() * nb2 * nb3;
+    auto brickAt = [&](int b) { return volume.getBrick(b / (nb2 * nb3), (b / nb3) % nb2, b % nb3); };
+    std::vector<unsigned char> windowed(static_cast<size_t>(brickSize) * brickSize * brickSize);
+    int numParts = numThreads;
+    int numTasks = static_cast<int>(projections.size()) * numParts;
+
+    BrickPtr brick = brickAt(0);
+    for (int b = 0; b < numBricks; b++) {
+        BrickPtr next;
+        std::thread loader;
+        if (b + 1 < numBricks)
+            loader = std::thread([&] { next = brickAt(b + 1); });
+
+        const cryph::Packed3DArray<T>& data = brick->data;
+        BrickBox box = { brick->first1, brick->first2, brick->first3,
+                         data.getDim1(), data.getDim2(), data.getDim3() };
+        // Only 8 bit voxels may be unwindowed (see VoxelFormat)
+        const unsigned char* values = reinterpret_cast<const unsigned char*>(data.begin());
+        if (format.windowed) {
+            size_t sheetCount = static_cast<size_t>(box.nx) * box.ny;
+            parallelFor(box.nz, numThreads, [&](int begin, int end) {
+                for (size_t i = begin * sheetCount; i < end * sheetCount; i++) {
+                    windowed[i] = static_cast<unsigned char>(
+                        windowVoxel(static_cast<float>(data.begin()[i]), format.windowLow,
+                                    format.windowScale));
+                }
+            });
+            values = windowed.data();
+        }
+
+        parallelForEach(numTasks, numThreads, [&](int t) {
+            size_t k = t / numParts;
+            projectBrick(projections[k], rows, cols, sheets, values, box, t % numParts, numParts,
+                         maxImgs[k], workSums[k]);
+        });
+
+        if (loader.joinable())
+            loader.join();
+        brick = next;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef EECS690_BRICKEDPROJECTOR_HPP
+#define EECS690_BRICKEDPROJECTOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Bricked3DArray.h"
+#include "Projection.hpp"
+#include "Voxel.hpp"
+
+/**
+ * Computes the max and weighted sum projections of a raw or uncompressed
+ * volume file on the CPU one brick at a time (see Bricked3DArray), for
+ * volumes too large to hold in memory: only the bricks being projected are
+ * resident, however large the file. Every view is computed in one pass over
+ * the bricks, in file order, so each page of the file is read once.
+ *
+ * Voxel (y, x, z) of the volume is element [z][x][y] of the bricked array.
+ * Each brick is windowed to 8 bits (see windowVoxel) and then accumulated
+ * into every view while it is in cache, so traversals along x and z are as
+ * local as those along y. Sums are exact, so the results are identical to
+ * those of CPUProjector.
+ */
+class BrickedProjector
+{
+public:
+    /**
+     * @param dataOffset the bytes before the voxels in the file
+     * @param brickSize the extent of a brick along each axis
+     * @param numThreads 0 to use every hardware thread
+     */
+    BrickedProjector(const std::string& fileName, size_t dataOffset, int rows, int cols, int sheets,
+                     VoxelType type, int brickSize = 64, int numThreads = 0);
+
+    /** Whether the file was opened (a message was printed if not) */
+    bool isValid() const;
+
+    int getNumThreads() const { return numThreads; }
+    int getBrickSize() const { return brickSize; }
+
+    /** The smallest and largest voxels, for a default window (see voxelRange) */
+    void range(double& low, double& high) const;
+
+    /**
+     * Compute each of the projections (see makeProjection), through format,
+     * into the matching maxImgs and workSums, which each hold p.outRows *
+     * p.outCols values
+     */
+    void project(const std::vector<Projection>& projections, const VoxelFormat& format,
+                 const std::vector<unsigned char*>& maxImgs,
+                 const std::vector<uint64_t*>& workSums) const;
+
+private:
+    BrickedProjector(const BrickedProjector&); // cannot be copied
+    BrickedProjector& operator=(const BrickedProjector&);
+
+    template <typename T>
+    void rangeOf(const cryph::Bricked3DArray<T>& volume, double& low, double& high) const;
+    template <typename T>
+    void projectAll(const cryph::Bricked3DArray<T>& volume, const std::vector<Projection>& projections,
+                    const VoxelFormat& format, const std::vector<unsigned char*>& maxImgs,
+                    const std::vector<uint64_t*>& workSums) const;
+
+    int rows, cols, sheets;
+    int brickSize;
+    int numThreads;
+
+    // The volume, as an array of its type (the others are empty)
+    std::unique_ptr<cryph::Bricked3DArray<unsigned char>> u8Volume;
+    std::unique_ptr<cryph::Bricked3DArray<uint16_t>> u16Volume;
+    std::unique_ptr<cryph::Bricked3DArray<float>> f32Volume;
+};
+
+#endif //EECS690_BRICKEDPROJECTOR_HPP
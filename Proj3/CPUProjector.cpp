@@ -0,0 +1,264 @@
+#include "CPUProjector.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Columns of the image accumulated together by projectColumns are sized so
+// their running max and sum stay in cache (about 128 KB).
+static const size_t COLUMN_BLOCK_BYTES = 128 * 1024;
+
+CPUProjector::CPUProjector(int rows, int cols, int sheets,
+                           const unsigned char* voxels, int numThreads) :
+    rows(rows), cols(cols), sheets(sheets), voxels(voxels), numThreads(numThreads)
+{
+    if (this->numThreads <= 0)
+        this->numThreads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void CPUProjector::project(const Projection& p, unsigned char* maxImg,
+                           uint64_t* workSum) const
+{
+    if (p.iStride == 1 || p.iStride == -1) {
+        parallelFor(p.outRows, numThreads, [&](int begin, int end) {
+            projectRays(p, begin, end, maxImg, workSum);
+        });
+    }
+    else {
+        parallelFor(p.outCols, numThreads, [&](int begin, int end) {
+            projectColumns(p, begin, end, maxImg, workSum);
+        });
+    }
+}
+
+/**
+ * Types 1-4: a column u of the image is a run of outRows contiguous voxels in
+ * each of the depth samples. A block of columns is accumulated one sample at
+ * a time, then copied to its place in the image.
+ */
+void CPUProjector::projectColumns(const Projection& p, int uBegin, int uEnd,
+                                  unsigned char* maxImg, uint64_t* workSum) const
+{
+    const int H = p.outRows;
+    const int W = p.outCols;
+    int blockCols = static_cast<int>(std::max<size_t>(1,
+        COLUMN_BLOCK_BYTES / (H * (sizeof(unsigned char) + sizeof(uint64_t)))));
+    std::vector<unsigned char> colMax(static_cast<size_t>(blockCols) * H);
+    std::vector<uint64_t> colSum(static_cast<size_t>(blockCols) * H);
+
+    for (int u0 = uBegin; u0 < uEnd; u0 += blockCols) {
+        int nCols = std::min(blockCols, uEnd - u0);
+        std::fill(colMax.begin(), colMax.end(), 0);
+        std::fill(colSum.begin(), colSum.end(), 0);
+
+        for (int i = 0; i < p.depth; i++) {
+            const uint64_t weight = i + 1;
+            for (int b = 0; b < nCols; b++) {
+                const unsigned char* src = voxels + p.origin +
+                    (u0 + b) * p.uStride + i * p.iStride;
+                unsigned char* m = &colMax[static_cast<size_t>(b) * H];
+                uint64_t* s = &colSum[static_cast<size_t>(b) * H];
+                for (int v = 0; v < H; v++) {
+                    m[v] = std::max(m[v], src[v]);
+                    s[v] += weight * src[v];
+                }
+            }
+        }
+
+        for (int b = 0; b < nCols; b++)
+            for (int v = 0; v < H; v++) {
+                size_t ndx = static_cast<size_t>(v) * W + u0 + b;
+                maxImg[ndx] = colMax[static_cast<size_t>(b) * H + v];
+                workSum[ndx] = colSum[static_cast<size_t>(b) * H + v];
+            }
+    }
+}
+
+/**
+ * Types 5 and 6: each ray is a run of depth contiguous voxels, walked in
+ * memory order (backwards from sample 0 for type 6).
+ */
+void CPUProjector::projectRays(const Projection& p, int vBegin, int vEnd,
+                               unsigned char* maxImg, uint64_t* workSum) const
+{
+    const int W = p.outCols;
+    const int depth = p.depth;
+    for (int v = vBegin; v < vEnd; v++) {
+        for (int u = 0; u < W; u++) {
+            const unsigned char* ray = voxels + p.origin + u * p.uStride + v * p.vStride;
+            unsigned char m = 0;
+            uint64_t s = 0;
+            if (p.iStride == 1) {
+                for (int k = 0; k < depth; k++) {
+                    m = std::max(m, ray[k]);
+                    s += static_cast<uint64_t>(k + 1) * ray[k];
+                }
+            }
+            else {
+                // Memory position k holds sample depth-1-k
+                const unsigned char* first = ray - (depth - 1);
+                for (int k = 0; k < depth; k++) {
+                    m = std::max(m, first[k]);
+                    s += static_cast<uint64_t>(depth - k) * first[k];
+                }
+            }
+            size_t ndx = static_cast<size_t>(v) * W + u;
+            maxImg[ndx] = m;
+            workSum[ndx] = s;
+        }
+    }
+}
+
+/**
+ * Render samples [begin, end) of a ray of depth samples, sample(i) being the
+ * value of sample i, into the channels of one pixel (the arithmetic matches
+ * RenderKernel.cl exactly)
+ */
+template <typename Sample>
+static void renderSamples(Sample sample, int begin, int end, int depth, RenderMode mode,
+                          const RenderOptions& options, unsigned char* pixel)
+{
+    switch (mode) {
+        case RENDER_MIN: {
+            unsigned int m = 255;
+            for (int i = begin; i < end; i++)
+                m = std::min(m, sample(i));
+            pixel[0] = (end > begin) ? static_cast<unsigned char>(m) : 0;
+            break;
+        }
+        case RENDER_MEAN: {
+            uint64_t s = 0;
+            for (int i = begin; i < end; i++)
+                s += sample(i);
+            uint64_t count = end - begin;
+            pixel[0] = (count > 0) ? static_cast<unsigned char>((2 * s + count) / (2 * count)) : 0;
+            break;
+        }
+        case RENDER_FIRST_HIT: {
+            pixel[0] = 0;
+            for (int i = begin; i < end; i++) {
+                if (static_cast<int>(sample(i)) >= options.threshold) {
+                    pixel[0] = static_cast<unsigned char>(255 * (depth - i) / depth);
+                    break;
+                }
+            }
+            break;
+        }
+        case RENDER_COMPOSITE: {
+            const unsigned char* tf = options.transfer.data();
+            uint32_t T = FULL_TRANSMITTANCE;
+            uint32_t color[3] = { 0, 0, 0 };
+            for (int i = begin; i < end && T >= options.minTransmittance; i++) {
+                const unsigned char* rgba = tf + 4 * sample(i);
+                uint32_t w = (T * rgba[3] + 127) / 255;
+                for (int c = 0; c < 3; c++)
+                    color[c] += w * rgba[c];
+                T -= w;
+            }
+            for (int c = 0; c < 3; c++)
+                pixel[c] = static_cast<unsigned char>((color[c] + 32768) >> 16);
+            break;
+        }
+    }
+}
+
+void CPUProjector::render(const Projection& p, RenderMode mode, const RenderOptions& options,
+                          unsigned char* img) const
+{
+    const int channels = renderChannels(mode);
+    parallelFor(p.outRows, numThreads, [&](int begin, int end) {
+        for (int v = begin; v < end; v++) {
+            for (int u = 0; u < p.outCols; u++) {
+                const unsigned char* ray = voxels + p.origin + u * p.uStride + v * p.vStride;
+                size_t ndx = static_cast<size_t>(v) * p.outCols + u;
+                renderSamples([ray, &p](int i) { return static_cast<unsigned int>(ray[i * p.iStride]); },
+                              0, p.depth, p.depth, mode, options, img + ndx * channels);
+            }
+        }
+    });
+}
+
+/**
+ * The samples of one ray of an oblique view, for renderSamples: sample i is
+ * at base + i * view.iStep
+ */
+struct ObliqueRay
+{
+    const ObliqueView& view;
+    const unsigned char* voxels;
+    int rows, cols, sheets;
+    long base[3];
+
+    unsigned int operator()(int i) const
+    {
+        long p[3];
+        for (int a = 0; a < 3; a++)
+            p[a] = base[a] + i * view.iStep[a];
+        return sampleVolume(voxels, rows, cols, sheets, p);
+    }
+};
+
+/**
+ * Call f(ndx, ray, begin, end) for the rays of rows [vBegin, vEnd) of view,
+ * with the index of their pixel and the samples [begin, end) that clipRay
+ * keeps
+ */
+template <typename F>
+static void forEachObliqueRay(const ObliqueView& view, int vBegin, int vEnd,
+                              const unsigned char* voxels, int rows, int cols, int sheets, F f)
+{
+    const int dims[3] = { cols, rows, sheets };
+    ObliqueRay ray = { view, voxels, rows, cols, sheets, { 0, 0, 0 } };
+    for (int v = vBegin; v < vEnd; v++) {
+        for (int u = 0; u < view.outCols; u++) {
+            for (int a = 0; a < 3; a++)
+                ray.base[a] = view.origin[a] + u * view.uStep[a] + v * view.vStep[a];
+            int begin = 0, end = view.depth;
+            clipRay(ray.base, view.iStep, dims, begin, end);
+            f(static_cast<size_t>(v) * view.outCols + u, ray, begin, end);
+        }
+    }
+}
+
+void CPUProjector::projectOblique(const ObliqueView& view, unsigned char* maxImg,
+                                  uint64_t* workSum) const
+{
+    parallelFor(view.outRows, numThreads, [&](int vBegin, int vEnd) {
+        forEachObliqueRay(view, vBegin, vEnd, voxels, rows, cols, sheets,
+                          [&](size_t ndx, const ObliqueRay& ray, int begin, int end) {
+            unsigned int m = 0;
+            uint64_t s = 0;
+            for (int i = begin; i < end; i++) {
+                unsigned int val = ray(i);
+                m = std::max(m, val);
+                s += static_cast<uint64_t>(i + 1) * val;
+            }
+            maxImg[ndx] = static_cast<unsigned char>(m);
+            workSum[ndx] = s;
+        });
+    });
+}
+
+void CPUProjector::renderOblique(const ObliqueView& view, RenderMode mode,
+                                 const RenderOptions& options, unsigned char* img) const
+{
+    const int channels = renderChannels(mode);
+    parallelFor(view.outRows, numThreads, [&](int vBegin, int vEnd) {
+        forEachObliqueRay(view, vBegin, vEnd, voxels, rows, cols, sheets,
+                          [&](size_t ndx, const ObliqueRay& ray, int begin, int end) {
+            renderSamples(ray, begin, end, view.depth, mode, options, img + ndx * channels);
+        });
+    });
+}
+
+uint64_t CPUProjector::normalize(const uint64_t* workSum, size_t count,
+                                 unsigned char* sumImg)
+{
+    uint64_t maxSum = 0;
+    for (size_t i = 0; i < count; i++)
+        maxSum = std::max(maxSum, workSum[i]);
+    for (size_t i = 0; i < count; i++)
+        sumImg[i] = normalizeSum(workSum[i], maxSum);
+    return maxSum;
+}
@@ -0,0 +1,76 @@
+#ifndef EECS690_CPUPROJECTOR_HPP
+#define EECS690_CPUPROJECTOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Oblique.hpp"
+#include "Projection.hpp"
+#include "Render.hpp"
+
+/**
+ * Computes the max and weighted sum projections of a volume on the CPU.
+ * Results are identical to those of MaxKernel/SumKernel, so this is both the
+ * fallback when there is no OpenCL device and a reference to check them with.
+ *
+ * The work is split across threads, and each projection axis gets its own
+ * traversal so the inner loops run over contiguous voxels (and vectorize):
+ * types 1-4 accumulate whole columns of the image at a time, types 5 and 6
+ * reduce along rays that are contiguous in memory.
+ */
+class CPUProjector
+{
+public:
+    /**
+     * @param voxels rows * cols * sheets values; not copied, so they must
+     *        outlive the projector
+     * @param numThreads 0 to use every hardware thread
+     */
+    CPUProjector(int rows, int cols, int sheets, const unsigned char* voxels,
+                 int numThreads = 0);
+
+    int getNumThreads() const { return numThreads; }
+
+    /**
+     * Compute projection p (see makeProjection) into maxImg and workSum, which
+     * each hold p.outRows * p.outCols values
+     */
+    void project(const Projection& p, unsigned char* maxImg, uint64_t* workSum) const;
+
+    /**
+     * Scale workSum to 0-255 into sumImg (see normalizeSum)
+     * @return the largest sum
+     */
+    static uint64_t normalize(const uint64_t* workSum, size_t count, unsigned char* sumImg);
+
+    /**
+     * Render projection p with the given mode (see Render.hpp) into img, which
+     * holds p.outRows * p.outCols pixels of renderChannels(mode) values.
+     * Each ray is walked front to back, so compositing stops early.
+     */
+    void render(const Projection& p, RenderMode mode, const RenderOptions& options,
+                unsigned char* img) const;
+
+    /**
+     * The max and weighted sum projections along an oblique view (see
+     * Oblique.hpp) into maxImg and workSum, which each hold
+     * view.outRows * view.outCols values
+     */
+    void projectOblique(const ObliqueView& view, unsigned char* maxImg, uint64_t* workSum) const;
+
+    /** Render an oblique view with the given mode into img, as render does */
+    void renderOblique(const ObliqueView& view, RenderMode mode, const RenderOptions& options,
+                       unsigned char* img) const;
+
+private:
+    void projectColumns(const Projection& p, int uBegin, int uEnd,
+                        unsigned char* maxImg, uint64_t* workSum) const;
+    void projectRays(const Projection& p, int vBegin, int vEnd,
+                     unsigned char* maxImg, uint64_t* workSum) const;
+
+    int rows, cols, sheets;
+    const unsigned char* voxels;
+    int numThreads;
+};
+
+#endif //EECS690_CPUPROJECTOR_HPP
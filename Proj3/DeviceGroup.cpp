@@ -0,0 +1,202 @@
+#include "DeviceGroup.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+// The rows [v0, v1) of a view, as a view of their own
+static Projection rowBand(const Projection& p, int v0, int v1)
+{
+    Projection band = p;
+    band.outRows = v1 - v0;
+    band.origin = p.origin + v0 * p.vStride;
+    return band;
+}
+
+static ObliqueView rowBand(const ObliqueView& view, int v0, int v1)
+{
+    ObliqueView band = view;
+    band.outRows = v1 - v0;
+    for (int a = 0; a < 3; a++)
+        band.origin[a] = view.origin[a] + v0 * view.vStep[a];
+    return band;
+}
+
+/**
+ * Call enqueue(d, band, v0) for each device d that has rows of view, with
+ * the band of rows [v0, first[d + 1]) it computes
+ */
+template <typename View, typename F>
+static void forEachBand(const std::vector<int>& first, const View& view, F enqueue)
+{
+    for (size_t d = 0; d + 1 < first.size(); d++) {
+        if (first[d + 1] > first[d])
+            enqueue(d, rowBand(view, first[d], first[d + 1]), first[d]);
+    }
+}
+
+std::vector<std::string> DeviceGroup::allDeviceSpecs()
+{
+    std::vector<std::string> specs;
+    size_t count = ProjectionContext::allDevices().size();
+    for (size_t i = 0; i < count; i++)
+        specs.push_back(std::to_string(i));
+    return specs;
+}
+
+DeviceGroup::DeviceGroup(const std::vector<std::string>& deviceSpecs, bool tune, bool debug,
+                         Profiler* profiler)
+{
+    for (const auto& spec : deviceSpecs) {
+        devices.emplace_back(new ProjectionContext(spec, tune, debug, profiler));
+
+        // Bands are sized by compute units times clock rate: a rough guide,
+        // but one that needs no timing runs
+        cl_uint units = 1, clock = 1;
+        clGetDeviceInfo(devices.back()->getDevice(), CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, nullptr);
+        clGetDeviceInfo(devices.back()->getDevice(), CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(clock), &clock, nullptr);
+        speeds.push_back(static_cast<double>(std::max(1u, units)) * std::max(1u, clock));
+    }
+}
+
+void DeviceGroup::setUseImages(bool use)
+{
+    for (auto& device : devices)
+        device->setUseImages(use);
+}
+
+bool DeviceGroup::obliqueUsesImage() const
+{
+    for (const auto& device : devices) {
+        if (!device->obliqueUsesImage())
+            return false;
+    }
+    return true;
+}
+
+void DeviceGroup::setVolume(int rows, int cols, int sheets, const unsigned char* voxels, bool inPlace,
+                            const VoxelFormat& format)
+{
+    for (auto& device : devices)
+        device->setVolume(rows, cols, sheets, voxels, inPlace, format);
+}
+
+std::vector<int> DeviceGroup::bands(int outRows) const
+{
+    double total = std::accumulate(speeds.begin(), speeds.end(), 0.0);
+    std::vector<int> first(1, 0);
+    double sum = 0.0;
+    for (double speed : speeds) {
+        sum += speed;
+        first.push_back(static_cast<int>(outRows * sum / total + 0.5));
+    }
+    first.back() = outRows;
+    return first;
+}
+
+DeviceGroup::Pending& DeviceGroup::addPending(int outRows, int outCols, unsigned char* sumImg,
+                                              uint64_t* maxSum, uint64_t* workSum)
+{
+    pending.push_back(Pending());
+    Pending& job = pending.back();
+    job.count = static_cast<size_t>(outRows) * outCols;
+    job.sumImg = sumImg;
+    job.maxSum = maxSum;
+    if (workSum == nullptr) {
+        job.ownWorkSum.resize(job.count);
+        workSum = job.ownWorkSum.data();
+    }
+    job.workSum = workSum;
+    job.partMax.assign(devices.size(), 0);
+    return job;
+}
+
+void DeviceGroup::enqueueProjection(const Projection& p, unsigned char* maxImg, unsigned char* sumImg,
+                                    uint64_t* maxSum, uint64_t* workSum)
+{
+    if (devices.size() == 1) {
+        devices[0]->enqueueProjection(p, maxImg, sumImg, maxSum, workSum);
+        return;
+    }
+    Pending& job = addPending(p.outRows, p.outCols, sumImg, maxSum, workSum);
+    forEachBand(bands(p.outRows), p, [&](size_t d, const Projection& band, int v0) {
+        size_t offset = static_cast<size_t>(v0) * p.outCols;
+        devices[d]->enqueueProjection(band, maxImg + offset, nullptr, &job.partMax[d],
+                                      job.workSum + offset);
+    });
+}
+
+void DeviceGroup::enqueueOblique(const ObliqueView& view, unsigned char* maxImg, unsigned char* sumImg,
+                                 uint64_t* maxSum, uint64_t* workSum)
+{
+    if (devices.size() == 1) {
+        devices[0]->enqueueOblique(view, maxImg, sumImg, maxSum, workSum);
+        return;
+    }
+    Pending& job = addPending(view.outRows, view.outCols, sumImg, maxSum, workSum);
+    forEachBand(bands(view.outRows), view, [&](size_t d, const ObliqueView& band, int v0) {
+        size_t offset = static_cast<size_t>(v0) * view.outCols;
+        devices[d]->enqueueOblique(band, maxImg + offset, nullptr, &job.partMax[d],
+                                   job.workSum + offset);
+    });
+}
+
+void DeviceGroup::enqueueRender(const Projection& p, RenderMode mode, const RenderOptions& options,
+                                unsigned char* img)
+{
+    size_t rowBytes = static_cast<size_t>(p.outCols) * renderChannels(mode);
+    forEachBand(bands(p.outRows), p, [&](size_t d, const Projection& band, int v0) {
+        devices[d]->enqueueRender(band, mode, options, img + v0 * rowBytes);
+    });
+}
+
+void DeviceGroup::enqueueObliqueRender(const ObliqueView& view, RenderMode mode,
+                                       const RenderOptions& options, unsigned char* img)
+{
+    size_t rowBytes = static_cast<size_t>(view.outCols) * renderChannels(mode);
+    forEachBand(bands(view.outRows), view, [&](size_t d, const ObliqueView& band, int v0) {
+        devices[d]->enqueueObliqueRender(band, mode, options, img + v0 * rowBytes);
+    });
+}
+
+void DeviceGroup::projectFrames(const std::vector<ObliqueView>& views,
+                                const std::vector<ProjectionOutput>& outputs,
+                                const std::vector<RenderMode>& modes, const RenderOptions& options)
+{
+    if (devices.size() == 1) {
+        devices[0]->projectFrames(views, outputs, modes, options);
+        return;
+    }
+    for (size_t f = 0; f < views.size(); f++) {
+        const ProjectionOutput& out = outputs[f];
+        enqueueOblique(views[f], out.maxImg, out.sumImg, out.maxSum, out.workSum);
+        for (size_t k = 0; k < modes.size(); k++)
+            enqueueObliqueRender(views[f], modes[k], options, out.renders[k]);
+    }
+    finish();
+}
+
+uint64_t DeviceGroup::project(const Projection& p, unsigned char* maxImg, unsigned char* sumImg,
+                              uint64_t* workSum)
+{
+    uint64_t maxSum = 0;
+    enqueueProjection(p, maxImg, sumImg, &maxSum, workSum);
+    finish();
+    return maxSum;
+}
+
+void DeviceGroup::finish()
+{
+    // Every device starts on its queue before waiting for any of them
+    for (auto& device : devices)
+        device->flush();
+    for (auto& device : devices)
+        device->finish();
+
+    for (auto& job : pending) {
+        uint64_t maxSum = *std::max_element(job.partMax.begin(), job.partMax.end());
+        *job.maxSum = maxSum;
+        for (size_t i = 0; i < job.count; i++)
+            job.sumImg[i] = normalizeSum(job.workSum[i], maxSum);
+    }
+    pending.clear();
+}
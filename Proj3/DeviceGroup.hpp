@@ -0,0 +1,109 @@
+#ifndef EECS690_DEVICEGROUP_HPP
+#define EECS690_DEVICEGROUP_HPP
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Oblique.hpp"
+#include "Profiler.hpp"
+#include "Projection.hpp"
+#include "ProjectionContext.hpp"
+#include "Render.hpp"
+#include "Voxel.hpp"
+
+/**
+ * Projections computed on several OpenCL devices at once. Each device has
+ * its own ProjectionContext (its own queue and buffers) and a copy of the
+ * volume, and computes a band of rows of every view's image, sized by how
+ * fast the device is. The bands are read straight into their part of the
+ * host images. The weighted sums are normalized once every device has
+ * found its largest sum, so the images are identical to those of a single
+ * device.
+ *
+ * With one device, calls go straight to its ProjectionContext.
+ */
+class DeviceGroup
+{
+public:
+    /**
+     * @param deviceSpecs one ProjectionContext deviceSpec per device; {""}
+     *        for the default device, or allDeviceSpecs() for every device
+     */
+    DeviceGroup(const std::vector<std::string>& deviceSpecs, bool tune = false,
+                bool debug = false, Profiler* profiler = nullptr);
+
+    /** A deviceSpec for each device of every platform */
+    static std::vector<std::string> allDeviceSpecs();
+
+    size_t size() const { return devices.size(); }
+
+    /** The context of device i, for work that is not split (streaming) */
+    ProjectionContext& device(size_t i) { return *devices[i]; }
+
+    void setUseImages(bool use);
+
+    /** Whether every device samples oblique views from a 3D image */
+    bool obliqueUsesImage() const;
+
+    /** Copy a volume to every device, as ProjectionContext::setVolume does */
+    void setVolume(int rows, int cols, int sheets, const unsigned char* voxels, bool inPlace = false,
+                   const VoxelFormat& format = VoxelFormat());
+
+    /** As ProjectionContext::enqueueProjection; the results may be used after finish() */
+    void enqueueProjection(const Projection& p, unsigned char* maxImg, unsigned char* sumImg,
+                           uint64_t* maxSum, uint64_t* workSum = nullptr);
+
+    /** As ProjectionContext::enqueueOblique */
+    void enqueueOblique(const ObliqueView& view, unsigned char* maxImg, unsigned char* sumImg,
+                        uint64_t* maxSum, uint64_t* workSum = nullptr);
+
+    /** As ProjectionContext::enqueueRender */
+    void enqueueRender(const Projection& p, RenderMode mode, const RenderOptions& options,
+                       unsigned char* img);
+
+    /** As ProjectionContext::enqueueObliqueRender */
+    void enqueueObliqueRender(const ObliqueView& view, RenderMode mode, const RenderOptions& options,
+                              unsigned char* img);
+
+    /** As ProjectionContext::projectFrames */
+    void projectFrames(const std::vector<ObliqueView>& views,
+                       const std::vector<ProjectionOutput>& outputs,
+                       const std::vector<RenderMode>& modes = std::vector<RenderMode>(),
+                       const RenderOptions& options = RenderOptions());
+
+    /** Compute projection p and wait for it; returns the largest weighted sum */
+    uint64_t project(const Projection& p, unsigned char* maxImg, unsigned char* sumImg,
+                     uint64_t* workSum = nullptr);
+
+    /** Wait for every device, then finish the queued projections' sums */
+    void finish();
+
+private:
+    DeviceGroup(const DeviceGroup&); // cannot be copied
+    DeviceGroup& operator=(const DeviceGroup&);
+
+    /** The first row of each device's band of an image of outRows rows, and outRows */
+    std::vector<int> bands(int outRows) const;
+
+    // A projection whose sums are normalized by finish()
+    struct Pending
+    {
+        size_t count;
+        unsigned char* sumImg;
+        uint64_t* maxSum;
+        uint64_t* workSum;
+        std::vector<uint64_t> ownWorkSum; // when the caller did not want the sums
+        std::vector<uint64_t> partMax;    // each device's largest sum
+    };
+    Pending& addPending(int outRows, int outCols, unsigned char* sumImg, uint64_t* maxSum,
+                        uint64_t* workSum);
+
+    std::vector<std::unique_ptr<ProjectionContext>> devices;
+    std::vector<double> speeds; // relative, for sizing the bands
+    std::deque<Pending> pending; // a deque so that the partial maxima do not move
+};
+
+#endif //EECS690_DEVICEGROUP_HPP
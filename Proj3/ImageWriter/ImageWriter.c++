@@ -25,12 +25,14 @@ ImageWriter::~ImageWriter()
 {
 }
 
-ImageWriter* ImageWriter::create(std::string fileName, int xres, int yres, int numChannels)
+ImageWriter* ImageWriter::create(std::string fileName, int xres, int yres, int numChannels,
+	const ImageWriterOptions& options)
 {
-	return guessFileType(fileName, xres, yres, numChannels);
+	return guessFileType(fileName, xres, yres, numChannels, options);
 }
 
-ImageWriter* ImageWriter::guessFileType(const std::string& fileName, int xres, int yres, int numChannels)
+ImageWriter* ImageWriter::guessFileType(const std::string& fileName, int xres, int yres, int numChannels,
+	const ImageWriterOptions& options)
 {
 	int dotLoc = fileName.find_last_of('.');
 	if (dotLoc != std::string::npos)
@@ -39,11 +41,11 @@ ImageWriter* ImageWriter::guessFileType(const std::string& fileName, int xres, i
 		if ((extension.compare("bmp") == 0) || (extension.compare("BMP") == 0))
 			return new BMPImageWriter(fileName, xres, yres, numChannels);
 		if ((extension.compare("jpg") == 0) || (extension.compare("JPG") == 0))
-			return new JPEGImageWriter(fileName, xres, yres, numChannels);
+			return new JPEGImageWriter(fileName, xres, yres, numChannels, options);
 		if ((extension.compare("jpeg") == 0) || (extension.compare("JPEG") == 0))
-			return new JPEGImageWriter(fileName, xres, yres, numChannels);
+			return new JPEGImageWriter(fileName, xres, yres, numChannels, options);
 		if ((extension.compare("png") == 0) || (extension.compare("PNG") == 0))
-			return new PNGImageWriter(fileName, xres, yres, numChannels);
+			return new PNGImageWriter(fileName, xres, yres, numChannels, options);
 	}
 	
 	cerr << "ImageWriter::guessFileType cannot determine file type of: "
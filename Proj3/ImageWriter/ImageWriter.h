@@ -5,6 +5,28 @@
 
 #include <string>
 
+// Encoder settings for ImageWriter::create. Each writer uses the ones for
+// its format; the defaults are the settings the writers have always used.
+struct ImageWriterOptions
+{
+	// The row filters libpng may choose among for each row
+	enum PNGFilters { PNGFiltersDefault, PNGFiltersNone, PNGFiltersSub, PNGFiltersUp,
+		PNGFiltersAvg, PNGFiltersPaeth, PNGFiltersAll };
+
+	ImageWriterOptions() :
+		jpegQuality(90), jpegOptimize(false), jpegProgressive(false),
+		pngLevel(-1), pngFilters(PNGFiltersDefault), pngFast(false)
+	{
+	}
+
+	int			jpegQuality;     // 0-100
+	bool		jpegOptimize;    // optimal Huffman tables: smaller, a little slower
+	bool		jpegProgressive; // progressive rather than baseline
+	int			pngLevel;        // zlib level 0 (store) - 9; -1 for zlib's default
+	PNGFilters	pngFilters;
+	bool		pngFast;         // level 1 (0 if pngLevel is 0) and no row filters
+};
+
 class ImageWriter
 {
 public:
@@ -38,13 +60,15 @@ public:
 
 	// A factory method that will create an ImageWriter based on the file name suffix
 	//                                                 WIDTH    HEIGHT
-	static ImageWriter* create(std::string fileName, int xres, int yres, int numChannels=3);
+	static ImageWriter* create(std::string fileName, int xres, int yres, int numChannels=3,
+		const ImageWriterOptions& options=ImageWriterOptions());
 
 protected:
 	ImageWriter(std::string fName, int xres, int yres, int numChannels=3);
 	ImageWriter(const ImageWriter& iw); // disallow copy constructor
 
-	static ImageWriter* guessFileType(const std::string& fileName, int xres, int yres, int numChannels);
+	static ImageWriter* guessFileType(const std::string& fileName, int xres, int yres, int numChannels,
+		const ImageWriterOptions& options);
 
 	std::string			mImageFileName;
 	int					mXRes; // width
@@ -6,9 +6,10 @@ using namespace std;
 #include "JPEGImageWriter.h"
 
 JPEGImageWriter::JPEGImageWriter(string fName, int xres, int yres, int numChannels,
-		int quality) :
+		const ImageWriterOptions& options) :
 	ImageWriter(fName,xres,yres,numChannels),
-	mImageFile(nullptr), mCompInfo(nullptr), mQuality(quality), mScanLine(nullptr),
+	mImageFile(nullptr), mCompInfo(nullptr), mQuality(options.jpegQuality),
+	mOptimize(options.jpegOptimize), mProgressive(options.jpegProgressive), mScanLine(nullptr),
 	scanLineNoAlphaUC(nullptr),
 	mReportedOpenFailure(false)
 {
@@ -83,6 +84,7 @@ void JPEGImageWriter::closeImageFile()
 
 	jpeg_finish_compress(mCompInfo);
 	jpeg_destroy_compress(mCompInfo);
+	delete mCompInfo;
 	mCompInfo = nullptr;
 	if (mScanLine != nullptr)
 	{
@@ -97,6 +99,7 @@ void JPEGImageWriter::closeImageFile()
 	if (scanLineNoAlphaUC != nullptr)
 	{
 		delete [] scanLineNoAlphaUC;
+		scanLineNoAlphaUC = nullptr;
 	}
 }
 
@@ -116,8 +119,7 @@ bool JPEGImageWriter::openImageFile()
 
 	// Allocate and initialize the compression object
 	mCompInfo = new struct jpeg_compress_struct();
-	struct jpeg_error_mgr jerr;
-	mCompInfo->err = jpeg_std_error(&jerr);
+	mCompInfo->err = jpeg_std_error(&mErrorMgr);
 	jpeg_create_compress(mCompInfo);
 
 	// tell the object where the output jpeg file is to be written
@@ -135,6 +137,9 @@ bool JPEGImageWriter::openImageFile()
 	mCompInfo->X_density = 1;
 	mCompInfo->Y_density = 1;
 	jpeg_set_quality(mCompInfo,mQuality,TRUE);
+	mCompInfo->optimize_coding = mOptimize ? TRUE : FALSE;
+	if (mProgressive)
+		jpeg_simple_progression(mCompInfo);
 
 	// JSAMPLE is "unsigned char"
 	// 'mScanLine': only used when the "double*" version of addScanLine is used
@@ -13,7 +13,7 @@ class JPEGImageWriter : public ImageWriter
 {
 public:
 	JPEGImageWriter(std::string fName, int xres, int yres, int nChannels=3,
-		int quality=90);
+		const ImageWriterOptions& options=ImageWriterOptions());
 	~JPEGImageWriter();
 
 	void	closeImageFile();
@@ -39,7 +39,10 @@ private:
 
 	FILE*							mImageFile;
 	struct jpeg_compress_struct*	mCompInfo;
+	struct jpeg_error_mgr			mErrorMgr; // used by mCompInfo until it is destroyed
 	int								mQuality;
+	bool							mOptimize;
+	bool							mProgressive;
 	unsigned char*					mScanLine; // only used as a buffer for
 						                // "double*" version of addScanLine
 
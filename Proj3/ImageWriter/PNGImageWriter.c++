@@ -1,12 +1,29 @@
 // PNGImageWriter.c++ -- Simple class to build png files
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 using namespace std;
 
 #include "PNGImageWriter.h"
 
-PNGImageWriter::PNGImageWriter(string fName, int width, int height, int nChannels) :
+// The libpng filter mask for each ImageWriterOptions::PNGFilters
+static int filterMask(ImageWriterOptions::PNGFilters filters)
+{
+	switch (filters)
+	{
+		case ImageWriterOptions::PNGFiltersNone:  return PNG_FILTER_NONE;
+		case ImageWriterOptions::PNGFiltersSub:   return PNG_FILTER_SUB;
+		case ImageWriterOptions::PNGFiltersUp:    return PNG_FILTER_UP;
+		case ImageWriterOptions::PNGFiltersAvg:   return PNG_FILTER_AVG;
+		case ImageWriterOptions::PNGFiltersPaeth: return PNG_FILTER_PAETH;
+		case ImageWriterOptions::PNGFiltersAll:   return PNG_ALL_FILTERS;
+		default:                                  return -1;
+	}
+}
+
+PNGImageWriter::PNGImageWriter(string fName, int width, int height, int nChannels,
+	const ImageWriterOptions& options) :
 	ImageWriter(fName,width,height,nChannels), fp(nullptr), png_ptr(nullptr), info_ptr(nullptr),
 	theImage(nullptr), row_pointers(nullptr), nextScanLine(0)
 {
@@ -39,13 +56,24 @@ PNGImageWriter::PNGImageWriter(string fName, int width, int height, int nChannel
 	png_set_IHDR(png_ptr, info_ptr, width, height, bitDepth, color_type,
 				 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
 				 PNG_FILTER_TYPE_DEFAULT);
+	// encoder settings (libpng picks its own unless they are given)
+	int level = options.pngLevel;
+	int filters = filterMask(options.pngFilters);
+	if (options.pngFast)
+	{
+		level = (level == 0) ? 0 : 1;
+		filters = PNG_FILTER_NONE;
+	}
+	if (level >= 0)
+		png_set_compression_level(png_ptr, std::min(level, 9));
+	if (filters >= 0)
+		png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filters);
 	// need to flip order of the rows:
 	theImage = new cryph::Packed3DArray<unsigned char>(height, width, nChannels);
-	unsigned char* p = theImage->getModifiableData();
 	row_pointers = new png_byte*[height];
 	int rpi = height;
 	for (int i=0 ; i<height ; i++)
-		row_pointers[--rpi] = p + i*width*nChannels*sizeof(unsigned char);
+		row_pointers[--rpi] = theImage->getSlice(i).begin();
 	png_set_rows(png_ptr, info_ptr, row_pointers);
 }
 
@@ -67,26 +95,20 @@ PNGImageWriter::~PNGImageWriter()
 
 void PNGImageWriter::addScanLine(const double* sLine)
 {
-	if (theImage == nullptr)
+	if ((theImage == nullptr) || (nextScanLine >= mYRes))
 		return;
-	int pos = 0;
-	for (int col=0 ; col<mXRes ; col++)
-		for (int channel=0 ; channel<mNumChannels ; channel++)
-		{
-			unsigned char x = static_cast<unsigned char>(sLine[pos++]*255.0 + 0.5);
-			theImage->setDataElement(nextScanLine, col, channel, x);
-		}
+	unsigned char* row = theImage->getSlice(nextScanLine).begin();
+	for (int pos=0 ; pos<mXRes*mNumChannels ; pos++)
+		row[pos] = static_cast<unsigned char>(sLine[pos]*255.0 + 0.5);
 	nextScanLine++;
 }
 
 void PNGImageWriter::addScanLine(const unsigned char* sLine)
 {
-	if (theImage == nullptr)
+	if ((theImage == nullptr) || (nextScanLine >= mYRes))
 		return;
-	int pos = 0;
-	for (int col=0 ; col<mXRes ; col++)
-		for (int channel=0 ; channel<mNumChannels ; channel++)
-			theImage->setDataElement(nextScanLine, col, channel, sLine[pos++]);
+	cryph::ArraySpan<unsigned char> row = theImage->getSlice(nextScanLine);
+	std::copy(sLine, sLine + row.size(), row.begin());
 	nextScanLine++;
 }
 
@@ -113,9 +135,5 @@ void PNGImageWriter::writeImage(const unsigned char* fb)
 {
 	if (theImage == nullptr)
 		return;
-	int pos = 0;
-	for (int row=0 ; row<mYRes ; row++)
-		for (int col=0 ; col<mXRes ; col++)
-			for (int channel=0 ; channel<mNumChannels ; channel++)
-				theImage->setDataElement(row, col, channel, fb[pos++]);
+	std::copy(fb, fb + theImage->getTotalNumberElements(), theImage->begin());
 }
@@ -13,7 +13,8 @@
 class PNGImageWriter : public ImageWriter
 {
 public:
-	PNGImageWriter(std::string fName, int xres, int yres, int nChannels=3);
+	PNGImageWriter(std::string fName, int xres, int yres, int nChannels=3,
+		const ImageWriterOptions& options=ImageWriterOptions());
 	~PNGImageWriter();
 
 	void	closeImageFile();
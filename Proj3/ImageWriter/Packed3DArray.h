@@ -11,6 +11,18 @@
  *      (2.c) operator=
  *      and for which the standard I/O operators (operator>> and operator<<)
  *      are defined.
+ *  The storage is obtained from "Allocator" (std::allocator by default; use
+ *  AlignedAllocator for buffers suitably aligned for SIMD loads and stores)
+ *  unless the array is constructed on storage supplied by the caller.
+ *  Each dimension is an int, but element counts and offsets are computed as
+ *  size_t, so arrays may hold more than 2^31 elements (e.g., a 2048^3 volume).
+ *  "Layout" selects the storage order: Interleaved (the default) or Planar.
+ *  Indexing is the same for both; only getData/begin/end (and getSlice or
+ *  getPlane) expose the difference.
+ *  getDataElement and setDataElement validate their indices on every call.
+ *  Inner loops should instead use operator() (checked only when NDEBUG is not
+ *  defined), begin/end, getSlice, or getChannel, all of which reduce to plain
+ *  pointer arithmetic.
  *  @see Packed2DArray
  *  @see ArrayList
  *  @see ImageReader
@@ -19,12 +31,164 @@
 #ifndef PACKED3DARRAY_H
 #define PACKED3DARRAY_H
 
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
 
 namespace cryph
 {
 
+/** An allocator whose blocks start on an 'Alignment' byte boundary (64 by
+ *  default: a cache line, and enough for any SIMD register).
+ */
+template <typename T, size_t Alignment=64>
+class AlignedAllocator
+{
+public:
+	static_assert(((Alignment & (Alignment-1)) == 0) &&
+	              (Alignment % sizeof(void*) == 0),
+	              "Alignment must be a power of two multiple of sizeof(void*)");
+
+	typedef T value_type;
+	template <typename U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() {}
+	template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t n)
+	{
+		void* p = nullptr;
+		if (posix_memalign(&p, Alignment, n * sizeof(T)) != 0)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+	void deallocate(T* p, size_t) { free(p); }
+};
+
+template <typename T, typename U, size_t A>
+bool operator==(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) { return true; }
+template <typename T, typename U, size_t A>
+bool operator!=(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) { return false; }
+
+/** A contiguous run of elements of a Packed3DArray (see getSlice). */
+template <typename T>
+class ArraySpan
+{
+public:
+	typedef T* iterator;
+
+	ArraySpan(T* first, size_t size) : mFirst(first), mSize(size) {}
+
+	T*		begin() const { return mFirst; }
+	T*		end() const { return mFirst + mSize; }
+	T*		data() const { return mFirst; }
+	size_t	size() const { return mSize; }
+	T&		operator[](size_t i) const { assert(i < mSize); return mFirst[i]; }
+
+private:
+	T*		mFirst;
+	size_t	mSize;
+};
+
+/** A random access iterator that visits every 'stride'-th element of an
+ *  array (see StridedView).
+ */
+template <typename T>
+class StridedIterator
+{
+public:
+	typedef std::random_access_iterator_tag	iterator_category;
+	typedef typename std::remove_const<T>::type	value_type;
+	typedef ptrdiff_t	difference_type;
+	typedef T*	pointer;
+	typedef T&	reference;
+
+	StridedIterator() : mBase(nullptr), mIndex(0), mStride(1) {}
+	StridedIterator(T* base, ptrdiff_t index, ptrdiff_t stride) :
+		mBase(base), mIndex(index), mStride(stride) {}
+
+	T&	operator*() const { return mBase[mIndex * mStride]; }
+	T*	operator->() const { return mBase + mIndex * mStride; }
+	T&	operator[](ptrdiff_t n) const { return mBase[(mIndex + n) * mStride]; }
+
+	StridedIterator& operator++() { ++mIndex; return *this; }
+	StridedIterator& operator--() { --mIndex; return *this; }
+	StridedIterator operator++(int) { StridedIterator t(*this); ++mIndex; return t; }
+	StridedIterator operator--(int) { StridedIterator t(*this); --mIndex; return t; }
+	StridedIterator& operator+=(ptrdiff_t n) { mIndex += n; return *this; }
+	StridedIterator& operator-=(ptrdiff_t n) { mIndex -= n; return *this; }
+	StridedIterator operator+(ptrdiff_t n) const { return StridedIterator(mBase, mIndex + n, mStride); }
+	StridedIterator operator-(ptrdiff_t n) const { return StridedIterator(mBase, mIndex - n, mStride); }
+	ptrdiff_t operator-(const StridedIterator& rhs) const { return mIndex - rhs.mIndex; }
+
+	bool operator==(const StridedIterator& rhs) const { return mIndex == rhs.mIndex; }
+	bool operator!=(const StridedIterator& rhs) const { return mIndex != rhs.mIndex; }
+	bool operator<(const StridedIterator& rhs) const { return mIndex < rhs.mIndex; }
+	bool operator>(const StridedIterator& rhs) const { return mIndex > rhs.mIndex; }
+	bool operator<=(const StridedIterator& rhs) const { return mIndex <= rhs.mIndex; }
+	bool operator>=(const StridedIterator& rhs) const { return mIndex >= rhs.mIndex; }
+
+private:
+	// Positions are kept as indices so that end() never forms a pointer
+	// beyond the end of the array.
+	T*			mBase;
+	ptrdiff_t	mIndex;
+	ptrdiff_t	mStride;
+};
+
+template <typename T>
+StridedIterator<T> operator+(ptrdiff_t n, const StridedIterator<T>& it) { return it + n; }
+
+/** 'size' elements of an array, 'stride' elements apart (see getChannel). */
 template <typename T>
+class StridedView
+{
+public:
+	typedef StridedIterator<T> iterator;
+
+	StridedView(T* first, size_t size, ptrdiff_t stride) :
+		mFirst(first), mSize(size), mStride(stride) {}
+
+	iterator	begin() const { return iterator(mFirst, 0, mStride); }
+	iterator	end() const { return iterator(mFirst, mSize, mStride); }
+	size_t		size() const { return mSize; }
+	ptrdiff_t	stride() const { return mStride; }
+	T&	operator[](size_t i) const { assert(i < mSize); return mFirst[i * mStride]; }
+
+private:
+	T*			mFirst;
+	size_t		mSize;
+	ptrdiff_t	mStride;
+};
+
+/** Storage orders for Packed3DArray. Interleaved stores [i1][i2][i3], so the
+ *  dim3 elements at [i1][i2] (e.g., the channels of a pixel) are adjacent.
+ *  Planar stores [i3][i1][i2], so each "plane" of elements sharing a third
+ *  index (e.g., one color channel of an image) is contiguous, which lets
+ *  per-channel loops run at full vector width.
+ */
+struct Interleaved
+{
+	static size_t offset(int i1, int i2, int i3, int dim1, int dim2, int dim3)
+		{ return (static_cast<size_t>(i1) * dim2 + i2) * dim3 + i3; }
+};
+
+struct Planar
+{
+	static size_t offset(int i1, int i2, int i3, int dim1, int dim2, int dim3)
+		{ return (static_cast<size_t>(i3) * dim1 + i1) * dim2 + i2; }
+};
+
+template <typename T, typename Layout = Interleaved,
+          typename Allocator = std::allocator<T> >
 class Packed3DArray
 {
 public:
@@ -36,14 +200,46 @@ public:
      */
 	Packed3DArray(int dim1=2, int dim2=2, int dim3=2, const T* initBuf=nullptr);
 
-	/** The copy constructor.
+	/** A constructor that uses storage supplied by the caller instead of
+	 *  allocating (and copying into) its own: e.g., an MPI receive buffer, a
+	 *  memory mapped file, or the output buffer of a decoder.
+	 *  @param dim1 the first dimension
+	 *  @param dim2 the second dimension
+	 *  @param dim3 the third dimension
+	 *  @param buf dim1*dim2*dim3 elements, laid out as described for getData
+	 *  @param deleter if non-empty, the array takes ownership of buf and calls
+	 *         deleter(buf) when it is destroyed. If empty, the array is just a
+	 *         view: buf is not released and must outlive the array.
+	 */
+	Packed3DArray(int dim1, int dim2, int dim3, T* buf,
+		std::function<void(T*)> deleter);
+
+	/** The copy constructor. The copy always has its own storage, even if
+	 *  t3da is a view of (or adopted) storage supplied by a caller.
+	 *  @param t3da the Packed3DArray instance to be copied
+	 */
+	Packed3DArray(const Packed3DArray<T, Layout, Allocator>& t3da);
+
+	/** The move constructor. The storage of t3da (however it was obtained) is
+	 *  transferred without copying; t3da is left as an empty (0x0x0) array.
+	 *  @param t3da the Packed3DArray instance to be moved from
+	 */
+	Packed3DArray(Packed3DArray<T, Layout, Allocator>&& t3da);
+
+	/** Construct a copy of an array with a different layout (or allocator),
+	 *  e.g., a Planar copy of an Interleaved image.
 	 *  @param t3da the Packed3DArray instance to be copied
 	 */
-	Packed3DArray(const Packed3DArray<T>& t3da);
+	template <typename L2, typename A2>
+	explicit Packed3DArray(const Packed3DArray<T, L2, A2>& t3da);
 
 	/** The destructor */
 	virtual ~Packed3DArray();
 
+	/** Copy and move assignment; see the copy and move constructors. */
+	Packed3DArray<T, Layout, Allocator>& operator=(const Packed3DArray<T, Layout, Allocator>& rhs);
+	Packed3DArray<T, Layout, Allocator>& operator=(Packed3DArray<T, Layout, Allocator>&& rhs);
+
 	/** Returns a pointer to the actual internal array for read-only access
 	 *  @return a read-only pointer to the start of the actual internal array
 	 */
@@ -83,6 +279,70 @@ public:
 	 */
 	int getDim3() const { return mDim3; }
 
+	/** Unchecked element access: the indices are only validated (by assert)
+	 *  when NDEBUG is not defined.
+	 *  @param i1 the first index
+	 *  @param i2 the second index
+	 *  @param i3 the third index
+	 *  @return a reference to the element at [i1][i2][i3]
+	 */
+	T& operator()(int i1, int i2, int i3)
+		{ return mData[uncheckedOffset(i1, i2, i3)]; }
+	const T& operator()(int i1, int i2, int i3) const
+		{ return mData[uncheckedOffset(i1, i2, i3)]; }
+
+	/** Random access iterators (plain pointers) over all elements in storage
+	 *  order, for use with the standard algorithms.
+	 */
+	T* begin() { return mData; }
+	T* end() { return mData + getTotalNumberElements(); }
+	const T* begin() const { return mData; }
+	const T* end() const { return mData + getTotalNumberElements(); }
+
+	/** Return the dim2*dim3 elements whose first index is i1 (e.g., one row
+	 *  of an image), which are contiguous. Interleaved layout only.
+	 *  @param i1 the first index
+	 */
+	ArraySpan<T> getSlice(int i1)
+		{ requireLayout<Interleaved>(); return ArraySpan<T>(&(*this)(i1, 0, 0), size23()); }
+	ArraySpan<const T> getSlice(int i1) const
+		{ requireLayout<Interleaved>(); return ArraySpan<const T>(&(*this)(i1, 0, 0), size23()); }
+
+	/** Return the dim3 elements at [i1][i2] (e.g., the channels of one pixel).
+	 *  Interleaved layout only.
+	 *  @param i1 the first index
+	 *  @param i2 the second index
+	 */
+	ArraySpan<T> getSlice(int i1, int i2)
+		{ requireLayout<Interleaved>(); return ArraySpan<T>(&(*this)(i1, i2, 0), mDim3); }
+	ArraySpan<const T> getSlice(int i1, int i2) const
+		{ requireLayout<Interleaved>(); return ArraySpan<const T>(&(*this)(i1, i2, 0), mDim3); }
+
+	/** Return the dim1*dim2 elements whose third index is i3 (e.g., one color
+	 *  channel of an image), which are contiguous. Planar layout only.
+	 *  @param i3 the third index
+	 */
+	ArraySpan<T> getPlane(int i3)
+		{ requireLayout<Planar>(); return ArraySpan<T>(&(*this)(0, 0, i3), size12()); }
+	ArraySpan<const T> getPlane(int i3) const
+		{ requireLayout<Planar>(); return ArraySpan<const T>(&(*this)(0, 0, i3), size12()); }
+
+	/** Return the dim1*dim2 elements whose third index is i3 (e.g., all the
+	 *  red samples of an image) in any layout; with Planar layout, this is
+	 *  the same as getPlane.
+	 *  @param i3 the third index
+	 */
+	StridedView<T> getChannel(int i3)
+		{ return StridedView<T>(&(*this)(0, 0, i3), size12(), channelStride()); }
+	StridedView<const T> getChannel(int i3) const
+		{ return StridedView<const T>(&(*this)(0, 0, i3), size12(), channelStride()); }
+
+	/** Return whether this array is a view of storage it does not own
+	 *  @return true if the array was constructed on caller-supplied storage
+	 *          with an empty deleter
+	 */
+	bool isView() const { return (mData != nullptr) && !mAllocated && !mDeleter; }
+
 	/** Return a pointer to the actual internal array for RW access
 	 *  @return a RW pointer to the start of the actual internal array
 	 */
@@ -92,7 +352,7 @@ public:
 	 *  @return the total number of elements computed as the product of
 	 *          the three dimensions
 	 */
-	int getTotalNumberElements() const { return mDim1 * mDim2 * mDim3; }
+	size_t getTotalNumberElements() const { return size12() * mDim3; }
 
 	/** Set a specific element of the array. If the indices are not valid,
 	 *  no change is made to the array.
@@ -114,70 +374,164 @@ public:
 
 private:
 
-	void copyDataFrom(const T* from);
-	int		getOffset(const char* routine, int i1, int i2, int i3) const;
+	void	allocateData();
+	void	copyDataFrom(const T* from);
+	void	releaseData();
+	ptrdiff_t	getOffset(const char* routine, int i1, int i2, int i3) const;
+	size_t	size12() const { return static_cast<size_t>(mDim1) * mDim2; }
+	size_t	size23() const { return static_cast<size_t>(mDim2) * mDim3; }
+	size_t	uncheckedOffset(int i1, int i2, int i3) const
+	{
+		assert((i1 >= 0) && (i1 < mDim1) && (i2 >= 0) && (i2 < mDim2) &&
+		       (i3 >= 0) && (i3 < mDim3));
+		return Layout::offset(i1, i2, i3, mDim1, mDim2, mDim3);
+	}
+	// distance between consecutive elements of a channel (see getChannel)
+	ptrdiff_t	channelStride() const
+		{ return Layout::offset(0, 1, 0, mDim1, mDim2, mDim3) - Layout::offset(0, 0, 0, mDim1, mDim2, mDim3); }
+	template <typename L> static void requireLayout()
+	{
+		static_assert(std::is_same<Layout, L>::value,
+			"this accessor is not available for the array's layout");
+	}
 
 	T*		mData;
 	int		mDim1;
 	int		mDim2;
 	int		mDim3;
 
+	Allocator	mAllocator;
+	bool		mAllocated; // true => mData came from mAllocator
+	std::function<void(T*)>	mDeleter; // releases caller-supplied storage
+
 	static	bool	sReportErrors;
 	static	T		sOutOfBoundsValue;
 };
 
-template <typename T>
-bool	Packed3DArray<T>::sReportErrors = true;
+template <typename T, typename Layout, typename Allocator>
+bool	Packed3DArray<T, Layout, Allocator>::sReportErrors = true;
 
-template <typename T>
-T		Packed3DArray<T>::sOutOfBoundsValue;
+template <typename T, typename Layout, typename Allocator>
+T		Packed3DArray<T, Layout, Allocator>::sOutOfBoundsValue;
 
-template <typename T>
-Packed3DArray<T>::Packed3DArray(int dim1, int dim2, int dim3, const T* initBuf) :
-		mData(nullptr), mDim1(dim1), mDim2(dim2), mDim3(dim3)
+template <typename T, typename Layout, typename Allocator>
+Packed3DArray<T, Layout, Allocator>::Packed3DArray(int dim1, int dim2, int dim3,
+	const T* initBuf) :
+		mData(nullptr), mDim1(dim1), mDim2(dim2), mDim3(dim3), mAllocated(false)
 {
-	if ( (dim1 < 1) || (dim2 < 1) || (dim3 < 1) )
+	if ( (dim1 < 1) || (dim2 < 1) || (dim3 < 1) ||
+	     (static_cast<size_t>(dim1) * dim2 >
+	      std::allocator_traits<Allocator>::max_size(mAllocator) / dim3) )
 	{
 		mDim1 = 0; mDim2 = 0; mDim3 = 0;
-		if (Packed3DArray<T>::sReportErrors)
+		if (Packed3DArray<T, Layout, Allocator>::sReportErrors)
 			std::cerr << "Invalid dimensions in constructor: ("
 			     << dim1 << ", " << dim2 << ", " << dim3 << ')' << std::endl;
 	}
 	else
 	{
-		mData = new T[dim1*dim2*dim3];
+		allocateData();
 		if (initBuf != nullptr)
 			copyDataFrom(initBuf);
 	}
 }
 
-template <typename T>
-Packed3DArray<T>::Packed3DArray(const Packed3DArray<T>& t3da) :
-		mData(nullptr), mDim1(t3da.mDim1), mDim2(t3da.mDim2), mDim3(t3da.mDim3)
+template <typename T, typename Layout, typename Allocator>
+Packed3DArray<T, Layout, Allocator>::Packed3DArray(int dim1, int dim2, int dim3, T* buf,
+	std::function<void(T*)> deleter) :
+		mData(buf), mDim1(dim1), mDim2(dim2), mDim3(dim3), mAllocated(false),
+		mDeleter(deleter)
 {
-	mData = new T[mDim1 * mDim2 * mDim3];
-	copyDataFrom(t3da.mData);
+	if ( (dim1 < 1) || (dim2 < 1) || (dim3 < 1) || (buf == nullptr) )
+	{
+		mDim1 = 0; mDim2 = 0; mDim3 = 0;
+		if (Packed3DArray<T, Layout, Allocator>::sReportErrors)
+			std::cerr << "Invalid dimensions or buffer in constructor: ("
+			     << dim1 << ", " << dim2 << ", " << dim3 << ')' << std::endl;
+		releaseData();
+	}
 }
 
-template <typename T>
-Packed3DArray<T>::~Packed3DArray()
+template <typename T, typename Layout, typename Allocator>
+Packed3DArray<T, Layout, Allocator>::Packed3DArray(const Packed3DArray<T, Layout, Allocator>& t3da) :
+		mData(nullptr), mDim1(t3da.mDim1), mDim2(t3da.mDim2), mDim3(t3da.mDim3),
+		mAllocator(t3da.mAllocator), mAllocated(false)
 {
-	if (mData != nullptr)
+	if (t3da.mData != nullptr)
 	{
-		delete [] mData;
-		mData = nullptr;
-		mDim1 = 0;
-		mDim2 = 0;
-		mDim3 = 0;
+		allocateData();
+		copyDataFrom(t3da.mData);
 	}
 }
 
-template <typename T>
-std::ostream& operator<<(std::ostream& os, const Packed3DArray<T>& t3da)
+template <typename T, typename Layout, typename Allocator>
+Packed3DArray<T, Layout, Allocator>::Packed3DArray(Packed3DArray<T, Layout, Allocator>&& t3da) :
+		mData(t3da.mData), mDim1(t3da.mDim1), mDim2(t3da.mDim2),
+		mDim3(t3da.mDim3), mAllocator(std::move(t3da.mAllocator)),
+		mAllocated(t3da.mAllocated), mDeleter(std::move(t3da.mDeleter))
+{
+	t3da.mData = nullptr;
+	t3da.mDim1 = 0; t3da.mDim2 = 0; t3da.mDim3 = 0;
+	t3da.mAllocated = false;
+	t3da.mDeleter = nullptr;
+}
+
+template <typename T, typename Layout, typename Allocator>
+template <typename L2, typename A2>
+Packed3DArray<T, Layout, Allocator>::Packed3DArray(const Packed3DArray<T, L2, A2>& t3da) :
+		mData(nullptr), mDim1(t3da.getDim1()), mDim2(t3da.getDim2()),
+		mDim3(t3da.getDim3()), mAllocated(false)
+{
+	if (t3da.getData() == nullptr)
+		return;
+	allocateData();
+	for (int i1=0 ; i1<mDim1 ; i1++)
+		for (int i2=0 ; i2<mDim2 ; i2++)
+			for (int i3=0 ; i3<mDim3 ; i3++)
+				(*this)(i1, i2, i3) = t3da(i1, i2, i3);
+}
+
+template <typename T, typename Layout, typename Allocator>
+Packed3DArray<T, Layout, Allocator>::~Packed3DArray()
+{
+	releaseData();
+}
+
+template <typename T, typename Layout, typename Allocator>
+Packed3DArray<T, Layout, Allocator>& Packed3DArray<T, Layout, Allocator>::operator=(
+	const Packed3DArray<T, Layout, Allocator>& rhs)
+{
+	if (this != &rhs)
+		*this = Packed3DArray<T, Layout, Allocator>(rhs);
+	return *this;
+}
+
+template <typename T, typename Layout, typename Allocator>
+Packed3DArray<T, Layout, Allocator>& Packed3DArray<T, Layout, Allocator>::operator=(
+	Packed3DArray<T, Layout, Allocator>&& rhs)
+{
+	if (this != &rhs)
+	{
+		releaseData();
+		mData = rhs.mData;
+		mDim1 = rhs.mDim1; mDim2 = rhs.mDim2; mDim3 = rhs.mDim3;
+		mAllocator = std::move(rhs.mAllocator);
+		mAllocated = rhs.mAllocated;
+		mDeleter = std::move(rhs.mDeleter);
+		rhs.mData = nullptr;
+		rhs.mDim1 = 0; rhs.mDim2 = 0; rhs.mDim3 = 0;
+		rhs.mAllocated = false;
+		rhs.mDeleter = nullptr;
+	}
+	return *this;
+}
+
+template <typename T, typename Layout, typename Allocator>
+std::ostream& operator<<(std::ostream& os, const Packed3DArray<T, Layout, Allocator>& t3da)
 {
-	int size = t3da.getTotalNumberElements();
+	size_t size = t3da.getTotalNumberElements();
 	const T* Tarr = t3da.getData();
-	for (int i=0 ; i<size ; i++)
+	for (size_t i=0 ; i<size ; i++)
 	{
 		// WARNING: Assuming integral type for now, hence cast to integer
 		//          first. For example, if "typename T" is GLubyte, this ensures
@@ -193,13 +547,13 @@ std::ostream& operator<<(std::ostream& os, const Packed3DArray<T>& t3da)
 	return os;
 }
 
-template <typename T>
-std::istream& operator>>(std::istream& is, Packed3DArray<T>& t3da)
+template <typename T, typename Layout, typename Allocator>
+std::istream& operator>>(std::istream& is, Packed3DArray<T, Layout, Allocator>& t3da)
 {
-	int size = t3da.getTotalNumberElements();
+	size_t size = t3da.getTotalNumberElements();
 	int temp = 0;
 	T* Tarr = t3da.getModifiableData();
-	for (int i=0 ; i<size ; i++)
+	for (size_t i=0 ; i<size ; i++)
 	{
 		// WARNING: See 'WARNING' in "operator<<" above.
 		is >> temp;
@@ -208,54 +562,83 @@ std::istream& operator>>(std::istream& is, Packed3DArray<T>& t3da)
 	return is;
 }
 
-template <typename T>
-void Packed3DArray<T>::copyDataFrom(const T* from)
+// Elements of trivial types are left uninitialized, as with "new T[n]".
+template <typename T, typename Layout, typename Allocator>
+void Packed3DArray<T, Layout, Allocator>::allocateData()
 {
-	int	size = mDim1 * mDim2 * mDim3;
-	for (int i=0 ; i<size ; i++)
-		mData[i] = from[i];
+	size_t	size = getTotalNumberElements();
+	mData = mAllocator.allocate(size);
+	mAllocated = true;
+	if (!std::is_trivial<T>::value)
+		for (size_t i=0 ; i<size ; i++)
+			std::allocator_traits<Allocator>::construct(mAllocator, mData + i);
 }
 
-template <typename T>
-T Packed3DArray<T>::getDataElement(int i1, int i2, int i3) const
+template <typename T, typename Layout, typename Allocator>
+void Packed3DArray<T, Layout, Allocator>::copyDataFrom(const T* from)
 {
-	int loc = getOffset("getDataElement",i1,i2,i3);
+	std::copy(from, from + getTotalNumberElements(), mData);
+}
+
+template <typename T, typename Layout, typename Allocator>
+void Packed3DArray<T, Layout, Allocator>::releaseData()
+{
+	if (mAllocated)
+	{
+		size_t	size = getTotalNumberElements();
+		if (!std::is_trivial<T>::value)
+			for (size_t i=0 ; i<size ; i++)
+				std::allocator_traits<Allocator>::destroy(mAllocator, mData + i);
+		mAllocator.deallocate(mData, size);
+	}
+	else if (mDeleter && (mData != nullptr))
+		mDeleter(mData);
+	mData = nullptr;
+	mDim1 = 0; mDim2 = 0; mDim3 = 0;
+	mAllocated = false;
+	mDeleter = nullptr;
+}
+
+template <typename T, typename Layout, typename Allocator>
+T Packed3DArray<T, Layout, Allocator>::getDataElement(int i1, int i2, int i3) const
+{
+	ptrdiff_t loc = getOffset("getDataElement",i1,i2,i3);
 	if (loc < 0)
 	{
-		return Packed3DArray<T>::sOutOfBoundsValue;
+		return Packed3DArray<T, Layout, Allocator>::sOutOfBoundsValue;
 	}
 	return mData[loc];
 }
 
-template <typename T>
-const T* Packed3DArray<T>::getDataElementLoc(int i1, int i2, int i3) const
+template <typename T, typename Layout, typename Allocator>
+const T* Packed3DArray<T, Layout, Allocator>::getDataElementLoc(int i1, int i2, int i3) const
 {
-	int loc = getOffset("getDataElementLoc",i1,i2,i3);
+	ptrdiff_t loc = getOffset("getDataElementLoc",i1,i2,i3);
 	if (loc < 0)
 		return nullptr;
 	return &mData[loc];
 }
 
-template <typename T>
-int Packed3DArray<T>::getOffset(const char* routine, int i1, int i2, int i3)
+template <typename T, typename Layout, typename Allocator>
+ptrdiff_t Packed3DArray<T, Layout, Allocator>::getOffset(const char* routine, int i1, int i2, int i3)
 	const
 {
 	if ( (i1 < 0) || (i1 >= mDim1) ||
 	     (i2 < 0) || (i2 >= mDim2) ||
 	     (i3 < 0) || (i3 >= mDim3) )
 	{
-		if (Packed3DArray<T>::sReportErrors)
+		if (Packed3DArray<T, Layout, Allocator>::sReportErrors)
 			std::cerr << routine << ": Invalid data element reference: ("
 			     << i1 << ", " << i2 << ", " << i3 << ')' << std::endl;
 		return -1;
 	}
-	return (i1 * mDim2 * mDim3) + (i2 * mDim3) + i3;
+	return Layout::offset(i1, i2, i3, mDim1, mDim2, mDim3);
 }
 
-template <typename T>
-void Packed3DArray<T>::setDataElement(int i1, int i2, int i3, const T& elem)
+template <typename T, typename Layout, typename Allocator>
+void Packed3DArray<T, Layout, Allocator>::setDataElement(int i1, int i2, int i3, const T& elem)
 {
-	int loc = getOffset("setDataElement",i1,i2,i3);
+	ptrdiff_t loc = getOffset("setDataElement",i1,i2,i3);
 	if (loc >= 0)
 		mData[loc] = elem;
 }
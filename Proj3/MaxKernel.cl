@@ -1,86 +1,172 @@
 /*
-    Calculates the max image by getting the max value in the voxelf fore the specific
+    Calculates the max image by getting the max value in the voxels for the specific
     pixel as well as calculates the working sum of our weighted scoring calculation.
+
+    Sample i of the ray through pixel (u, v) is the voxel at
+    origin + u * uStride + v * vStride + i * iStride (see Projection.hpp), and
+    it is weighted by (i + 1). Sums are exact integers so that the results match
+    CPUProjector on every device.
+
+    When a volume is streamed, each launch computes one slab (see Slab in
+    Projection.hpp): (u, v) is a pixel of a window of the image whose pixel
+    (0, 0) is outOrigin, sample i has weight firstSample + i + 1, and if
+    accumulate is set the results are combined with those already in maxArr
+    and workSum. A whole projection is one slab with firstSample 0, outOrigin
+    0, outStride outCols and accumulate 0.
+
+    Neighbouring work items (along dimension 0) should read neighbouring voxels.
+    When vStride is +-1 the host sets vMajor and swaps the NDRange, so that
+    dimension 0 walks v instead of u. (When only iStride is +-1, the host uses
+    MaxRaysKernel.)
+
+    Each work group also reduces its sums to their max in groupMaxArr[group],
+    the first step in finding the largest sum (see ReduceMaxKernel). scratch
+    must hold one ulong per work item.
+
+    Voxels are VOXELs: unsigned char, unless the program is built with
+    -D VOXEL=ushort or float. When it is also built with WINDOWED, every
+    voxel is windowed to 0-255 as it is read (see Voxel.hpp), with the
+    windowLow and windowScale arguments that end the argument list of each
+    kernel that reads the volume.
 */
+
+#ifndef VOXEL
+#define VOXEL unsigned char
+#endif
+
+// The 0-255 value of a voxel
+uint voxelValue(VOXEL voxel, float windowLow, float windowScale)
+{
+#ifdef WINDOWED
+    return (uint)rint(clamp(((float)voxel - windowLow) * windowScale, 0.0f, 255.0f));
+#else
+    return voxel;
+#endif
+}
+
+// Store the results of pixel (u, v) of the window
+void storePixel(long ndx, uint maxVal, ulong sum, int accumulate,
+                __global unsigned char* maxArr, __global ulong* workSum)
+{
+    if (accumulate) {
+        maxVal = max(maxVal, (uint)maxArr[ndx]);
+        sum += workSum[ndx];
+    }
+    maxArr[ndx] = (unsigned char)maxVal;
+    workSum[ndx] = sum;
+}
+
+// Reduce the group's sums to groupMaxArr; the group size need not be a power of two
+void groupMax(ulong sum, __global ulong* groupMaxArr, __local ulong* scratch)
+{
+    uint lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    scratch[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (uint active = get_local_size(0) * get_local_size(1); active > 1; ) {
+        uint half = (active + 1) / 2;
+        if (lid < active - half)
+            scratch[lid] = max(scratch[lid], scratch[lid + half]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+        active = half;
+    }
+    if (lid == 0)
+        groupMaxArr[get_group_id(1) * get_num_groups(0) + get_group_id(0)] = scratch[0];
+}
+
 __kernel
-void MaxKernel(int depth, int cols, int rows, int projType, __global const unsigned char* img, __global unsigned char* maxArr, __global float* workSum)
+void MaxKernel(int outCols, int outRows, int depth,
+               long origin, long uStride, long vStride, long iStride,
+               int firstSample, long outOrigin, int outStride, int accumulate, int vMajor,
+               __global const VOXEL* img, __global unsigned char* maxArr, __global ulong* workSum,
+               __global ulong* groupMaxArr, __local ulong* scratch, float windowLow, float windowScale)
 {
-    int x, y, z, rowCount, colCount, sheetCount, maxOffset;
-    int idx = get_global_id(0);
-    int idy = get_global_id(1);
-
-    switch (projType) {
-        case 1:
-        case 2:
-            colCount = cols;
-            rowCount = rows;
-            sheetCount = depth;
-            break;
-        case 3:
-        case 4:
-            colCount = depth;
-            rowCount = rows;
-            sheetCount = cols;
-            break;
-        case 5:
-        case 6:
-            colCount = cols;
-            rowCount = depth;
-            sheetCount = rows;
-            break;
+    int u = get_global_id(vMajor ? 1 : 0);
+    int v = get_global_id(vMajor ? 0 : 1);
+
+    // The NDRange is rounded up to whole work groups; work items outside the
+    // image still take part in the reduction
+    ulong sum = 0;
+    if (u < outCols && v < outRows) {
+        // Calculate max and sum
+        __global const VOXEL* ray = img + (origin + u * uStride + v * vStride);
+        uint maxVal = 0;
+        for (int i = 0; i < depth; i++) {
+            uint val = voxelValue(ray[i * iStride], windowLow, windowScale);
+
+            // See if value is max
+            if (val > maxVal) {
+                maxVal = val;
+            }
+            sum += (ulong)(firstSample + i + 1) * val;
+        }
+
+        storePixel(outOrigin + (long)v * outStride + u, maxVal, sum, accumulate, maxArr, workSum);
     }
 
-    // Calculate max and sum
-    int max = 0;
-    float sum = 0.00;
-    for (int i = 0; i < sheetCount; i++) {
-        // Map x', y', z', rows', and cols' to calculate index;
-        switch (projType) {
-            case 1:
-                x = idx;
-                y = idy;
-                z = i;
-                break;
-            case 2:
-                x = (colCount - idx);
-                y = idy;
-                z = (sheetCount - i);
-                break;
-            case 3:
-                x = i;
-                y = idy;
-                z = (colCount - idx);
-                break;
-            case 4:
-                x = (sheetCount - i);
-                y = idy;
-                z = idx;
-                break;
-            case 5:
-                x = idx;
-                y = i;
-                z = (rowCount - idy);
-                break;
-            case 6:
-                x = idx;
-                y = (sheetCount - i);
-                z = idy;
-                break;
-            default: // TODO: exit Kernel?
-                break;
+    groupMax(sum, groupMaxArr, scratch);
+}
+
+// Samples of each ray staged in local memory at a time (a power of two)
+#define TILE_DEPTH 64
+
+/*
+    MaxKernel for projections whose rays are contiguous (iStride is +-1), where
+    neighbouring pixels are a whole row or plane apart. The work group copies
+    the next TILE_DEPTH samples of all of its rays into tile, with neighbouring
+    work items reading neighbouring voxels of the same ray, and then each work
+    item walks its own ray in local memory. tile must hold
+    (TILE_DEPTH + 1) bytes per work item; the padding byte spreads the rays
+    over the local memory banks. Voxels are windowed as they are staged.
+*/
+__kernel
+void MaxRaysKernel(int outCols, int outRows, int depth,
+                   long origin, long uStride, long vStride, long iStride,
+                   int firstSample, long outOrigin, int outStride, int accumulate,
+                   __global const VOXEL* img, __global unsigned char* maxArr, __global ulong* workSum,
+                   __global ulong* groupMaxArr, __local ulong* scratch, __local unsigned char* tile,
+                   float windowLow, float windowScale)
+{
+    int u = get_global_id(0);
+    int v = get_global_id(1);
+    bool inside = (u < outCols && v < outRows);
+
+    uint groupSize = get_local_size(0) * get_local_size(1);
+    uint lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    int u0 = get_group_id(0) * get_local_size(0);
+    int v0 = get_group_id(1) * get_local_size(1);
+    __local const unsigned char* myRay = tile + lid * (TILE_DEPTH + 1);
+
+    ulong sum = 0;
+    uint maxVal = 0;
+    for (int i0 = 0; i0 < depth; i0 += TILE_DEPTH) {
+        int count = min(TILE_DEPTH, depth - i0);
+
+        // Load sample i0 + k of the ray of work item r into tile[r][k]
+        for (uint n = lid; n < groupSize * TILE_DEPTH; n += groupSize) {
+            uint r = n / TILE_DEPTH;
+            int k = n % TILE_DEPTH;
+            int ru = u0 + r % get_local_size(0);
+            int rv = v0 + r / get_local_size(0);
+            if (k < count && ru < outCols && rv < outRows)
+                tile[r * (TILE_DEPTH + 1) + k] = voxelValue(
+                    img[origin + ru * uStride + rv * vStride + (i0 + k) * iStride], windowLow, windowScale);
         }
-        // Calculate the offset and get the value
-        int offset = y + rowCount * (z * colCount + x);
-        int val = (int)img[offset];
+        barrier(CLK_LOCAL_MEM_FENCE);
 
-        // See if value is max
-        if (val > max) {
-            max = val;
+        if (inside) {
+            for (int k = 0; k < count; k++) {
+                uint val = myRay[k];
+                if (val > maxVal) {
+                    maxVal = val;
+                }
+                sum += (ulong)(firstSample + i0 + k + 1) * val;
+            }
         }
-        sum += ((i + 1) / sheetCount) * val;
+        barrier(CLK_LOCAL_MEM_FENCE);
     }
 
-    int ndx = idx * colCount + idy;
-    maxArr[ndx] = (unsigned char)max;
-    workSum[ndx] = sum;
+    if (inside)
+        storePixel(outOrigin + (long)v * outStride + u, maxVal, sum, accumulate, maxArr, workSum);
+
+    groupMax(sum, groupMaxArr, scratch);
 }
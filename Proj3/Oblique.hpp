@@ -0,0 +1,169 @@
+#ifndef EECS690_OBLIQUE_HPP
+#define EECS690_OBLIQUE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * An orthographic view of the volume from any direction. Positions are in
+ * voxels along (x = col, y = row, z = sheet), with voxel centers at whole
+ * numbers, in 16.16 fixed point so that the CPU (CPUProjector) and every
+ * device (ObliqueKernel.cl) march exactly the same samples.
+ *
+ * Sample i of the ray through pixel (u, v) is at
+ *
+ *     origin + u * uStep + v * vStep + i * iStep
+ *
+ * and its value is interpolated trilinearly from the 8 voxels around it
+ * (voxels outside the volume are 0) with 8 bit weights, as texture hardware
+ * does: see sampleVolume.
+ */
+struct ObliqueView
+{
+    int outCols, outRows, depth;
+    long origin[3], uStep[3], vStep[3], iStep[3];
+};
+
+const int FIXED_SHIFT = 16;
+const long FIXED_ONE = 1L << FIXED_SHIFT;
+
+/**
+ * The rotation of a turntable: yaw degrees about the volume's vertical (row)
+ * axis, then pitch degrees about the image's horizontal axis. Rows 0-2 of
+ * rotation are the directions of the image's u and v axes and of the rays.
+ * Yaw 0 and pitch 0 is projection type 1.
+ */
+inline void turntableRotation(double yawDegrees, double pitchDegrees, double rotation[9])
+{
+    const double radians = 3.14159265358979323846 / 180.0;
+    double cy = std::cos(yawDegrees * radians), sy = std::sin(yawDegrees * radians);
+    double cp = std::cos(pitchDegrees * radians), sp = std::sin(pitchDegrees * radians);
+    double u[3] = { cy, 0.0, -sy };
+    double v[3] = { 0.0, 1.0, 0.0 };
+    double d[3] = { sy, 0.0, cy };
+    for (int a = 0; a < 3; a++) {
+        rotation[a] = u[a];
+        rotation[3 + a] = v[a] * cp - d[a] * sp;
+        rotation[6 + a] = v[a] * sp + d[a] * cp;
+    }
+}
+
+/**
+ * The view of a rows x cols x sheets volume with the given rotation (see
+ * turntableRotation), centered on the volume. The image and the rays are as
+ * long as the volume's diagonal, so every rotation gives the same image size
+ * and sees the whole volume.
+ */
+inline void makeObliqueView(int rows, int cols, int sheets, const double rotation[9],
+                            ObliqueView& view)
+{
+    int size = static_cast<int>(std::ceil(std::sqrt(
+        static_cast<double>(rows) * rows + static_cast<double>(cols) * cols +
+        static_cast<double>(sheets) * sheets)));
+    view.outCols = view.outRows = view.depth = size;
+
+    double center[3] = { (cols - 1) / 2.0, (rows - 1) / 2.0, (sheets - 1) / 2.0 };
+    double half = (size - 1) / 2.0;
+    for (int a = 0; a < 3; a++) {
+        double origin = center[a] - half * (rotation[a] + rotation[3 + a] + rotation[6 + a]);
+        view.origin[a] = std::lround(origin * FIXED_ONE);
+        view.uStep[a] = std::lround(rotation[a] * FIXED_ONE);
+        view.vStep[a] = std::lround(rotation[3 + a] * FIXED_ONE);
+        view.iStep[a] = std::lround(rotation[6 + a] * FIXED_ONE);
+    }
+}
+
+/** The views of a turntable of frames frames, each turned 360 / frames degrees */
+inline std::vector<ObliqueView> turntableViews(int rows, int cols, int sheets, int frames,
+                                               double pitchDegrees)
+{
+    std::vector<ObliqueView> views(frames);
+    for (int f = 0; f < frames; f++) {
+        double rotation[9];
+        turntableRotation(360.0 * f / frames, pitchDegrees, rotation);
+        makeObliqueView(rows, cols, sheets, rotation, views[f]);
+    }
+    return views;
+}
+
+// a / b rounded down, for b != 0
+inline long floorDiv(long a, long b)
+{
+    long q = a / b;
+    if (a % b != 0 && ((a < 0) != (b < 0)))
+        q--;
+    return q;
+}
+
+/**
+ * Narrow the samples [begin, end) of a ray, whose sample i is at
+ * base + i * step, to those within one voxel of the volume (dims are the
+ * cols, rows, and sheets), where sampleVolume can be nonzero
+ */
+inline void clipRay(const long base[3], const long step[3], const int dims[3],
+                    int& begin, int& end)
+{
+    for (int a = 0; a < 3; a++) {
+        // -FIXED_ONE < base + i * step < dims[a] * FIXED_ONE
+        long lo = -FIXED_ONE - base[a];
+        long hi = dims[a] * FIXED_ONE - base[a];
+        long first, last; // first and one past the last i
+        if (step[a] == 0) {
+            if (lo < 0 && hi > 0)
+                continue;
+            first = last = 0;
+        }
+        else if (step[a] > 0) {
+            first = floorDiv(lo, step[a]) + 1;
+            last = -floorDiv(-hi, step[a]);
+        }
+        else {
+            first = floorDiv(hi, step[a]) + 1;
+            last = -floorDiv(-lo, step[a]);
+        }
+        begin = static_cast<int>(std::max<long>(begin, first));
+        end = static_cast<int>(std::min<long>(end, last));
+    }
+    end = std::max(begin, end);
+}
+
+/**
+ * The trilinearly interpolated value (0-255) at position p (16.16 fixed
+ * point, within one voxel of the volume, see clipRay) of a rows x cols x
+ * sheets volume
+ */
+inline unsigned int sampleVolume(const unsigned char* voxels, int rows, int cols, int sheets,
+                                 const long p[3])
+{
+    // p is more than -1, so p + 1 is positive and shifts round down
+    long x0 = ((p[0] + FIXED_ONE) >> FIXED_SHIFT) - 1;
+    long y0 = ((p[1] + FIXED_ONE) >> FIXED_SHIFT) - 1;
+    long z0 = ((p[2] + FIXED_ONE) >> FIXED_SHIFT) - 1;
+    uint32_t fx = ((p[0] + FIXED_ONE) >> 8) & 255;
+    uint32_t fy = ((p[1] + FIXED_ONE) >> 8) & 255;
+    uint32_t fz = ((p[2] + FIXED_ONE) >> 8) & 255;
+
+    uint32_t total = 0;
+    for (int dz = 0; dz < 2; dz++) {
+        long z = z0 + dz;
+        if (z < 0 || z >= sheets)
+            continue;
+        uint32_t wz = dz ? fz : 256 - fz;
+        for (int dx = 0; dx < 2; dx++) {
+            long x = x0 + dx;
+            if (x < 0 || x >= cols)
+                continue;
+            uint32_t wxz = (dx ? fx : 256 - fx) * wz;
+            const unsigned char* column = voxels + rows * (x + static_cast<long>(cols) * z);
+            if (y0 >= 0)
+                total += (256 - fy) * wxz * column[y0];
+            if (y0 + 1 < rows)
+                total += fy * wxz * column[y0 + 1];
+        }
+    }
+    return (total + (1u << 23)) >> 24;
+}
+
+#endif //EECS690_OBLIQUE_HPP
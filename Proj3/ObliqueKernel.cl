@@ -0,0 +1,228 @@
+/*
+    Marches the ray through pixel (u, v) of an oblique view of the volume (see
+    Oblique.hpp): sample i is at (x, y, z) = origin + u * uStep + v * vStep +
+    i * iStep, in 16.16 fixed point, and is interpolated trilinearly from the
+    rows x cols x sheets volume. Only the samples within one voxel of the
+    volume are visited (clipRay); the rest are 0.
+
+    mode -1 computes the max and the weighted sum (sample i weighted by i + 1)
+    into maxArr and workSum, as MaxKernel does for a whole projection,
+    including the max of the work group's sums in groupMaxArr (scratch holds
+    one ulong per work item). Modes 0-3 render the ray into out, as
+    RenderKernel does.
+
+    As in MaxKernel, the host sets vMajor (and swaps the NDRange) when
+    neighbouring pixels along v read closer voxels than those along u.
+
+    ObliqueKernel reads the volume from a buffer with the same integer
+    arithmetic as CPUProjector, so the results are identical. Windowed voxels
+    (see MaxKernel.cl) are windowed before they are interpolated.
+    ObliqueImageKernel (built with HAVE_IMAGES on devices that support images)
+    reads an 8 bit volume from a 3D image through the texture units' linear
+    filtering, which is faster but rounds its weights differently, so its
+    values can differ slightly.
+*/
+
+// a / b rounded down, for b != 0
+long floorDiv(long a, long b)
+{
+    long q = a / b;
+    if (a % b != 0 && ((a < 0) != (b < 0)))
+        q--;
+    return q;
+}
+
+// Narrow the samples [*begin, *end) of the ray at base + i * step to those
+// within one voxel of the volume (dims are the cols, rows, and sheets)
+void clipRay(const long* base, const long* step, const int* dims, int* begin, int* end)
+{
+    for (int a = 0; a < 3; a++) {
+        long lo = -65536 - base[a];
+        long hi = (long)dims[a] * 65536 - base[a];
+        long first, last;
+        if (step[a] == 0) {
+            if (lo < 0 && hi > 0)
+                continue;
+            first = last = 0;
+        }
+        else if (step[a] > 0) {
+            first = floorDiv(lo, step[a]) + 1;
+            last = -floorDiv(-hi, step[a]);
+        }
+        else {
+            first = floorDiv(hi, step[a]) + 1;
+            last = -floorDiv(-lo, step[a]);
+        }
+        *begin = (int)max((long)*begin, first);
+        *end = (int)min((long)*end, last);
+    }
+    *end = max(*begin, *end);
+}
+
+// Sample the volume at p (x, y, z) with 8 bit trilinear weights
+uint sampleVolume(__global const VOXEL* vol, int rows, int cols, int sheets, const long* p,
+                  float windowLow, float windowScale)
+{
+    long x0 = ((p[0] + 65536) >> 16) - 1;
+    long y0 = ((p[1] + 65536) >> 16) - 1;
+    long z0 = ((p[2] + 65536) >> 16) - 1;
+    uint fx = ((p[0] + 65536) >> 8) & 255;
+    uint fy = ((p[1] + 65536) >> 8) & 255;
+    uint fz = ((p[2] + 65536) >> 8) & 255;
+
+    uint total = 0;
+    for (int dz = 0; dz < 2; dz++) {
+        long z = z0 + dz;
+        if (z < 0 || z >= sheets)
+            continue;
+        uint wz = dz ? fz : 256 - fz;
+        for (int dx = 0; dx < 2; dx++) {
+            long x = x0 + dx;
+            if (x < 0 || x >= cols)
+                continue;
+            uint wxz = (dx ? fx : 256 - fx) * wz;
+            __global const VOXEL* column = vol + rows * (x + (long)cols * z);
+            if (y0 >= 0)
+                total += (256 - fy) * wxz * voxelValue(column[y0], windowLow, windowScale);
+            if (y0 + 1 < rows)
+                total += fy * wxz * voxelValue(column[y0 + 1], windowLow, windowScale);
+        }
+    }
+    return (total + (1u << 23)) >> 24;
+}
+
+// Running state of one ray: the max and sum (mode -1) or a rendering
+typedef struct
+{
+    uint maxVal;
+    ulong sum;
+    RenderState render;
+} ObliqueState;
+
+void obliqueSample(ObliqueState* st, int mode, int i, int depth, uint val,
+                   int threshold, __constant unsigned char* transfer)
+{
+    if (mode < 0) {
+        st->maxVal = max(st->maxVal, val);
+        st->sum += (ulong)(i + 1) * val;
+    }
+    else {
+        renderSample(&st->render, mode, i, depth, val, threshold, transfer);
+    }
+}
+
+// Set up the ray through pixel (u, v); false if it is outside the image
+bool obliqueRay(int u, int v, int outCols, int outRows, int depth, const long* origin,
+                const long* uStep, const long* vStep, const long* iStep, const int* dims,
+                long* base, int* begin, int* end, ObliqueState* st)
+{
+    if (u >= outCols || v >= outRows)
+        return false;
+    for (int a = 0; a < 3; a++)
+        base[a] = origin[a] + u * uStep[a] + v * vStep[a];
+    *begin = 0;
+    *end = depth;
+    clipRay(base, iStep, dims, begin, end);
+    st->maxVal = 0;
+    st->sum = 0;
+    beginRender(&st->render);
+    return true;
+}
+
+void storeOblique(const ObliqueState* st, int mode, int count, long ndx,
+                  __global unsigned char* maxArr, __global ulong* workSum, __global unsigned char* out)
+{
+    if (mode < 0) {
+        maxArr[ndx] = (unsigned char)st->maxVal;
+        workSum[ndx] = st->sum;
+    }
+    else {
+        storeRender(&st->render, mode, count, ndx, out);
+    }
+}
+
+__kernel
+void ObliqueKernel(int outCols, int outRows, int depth, int rows, int cols, int sheets,
+                   long ox, long oy, long oz, long ux, long uy, long uz,
+                   long vx, long vy, long vz, long ix, long iy, long iz, int vMajor,
+                   int mode, int threshold, uint minTransmittance, __constant unsigned char* transfer,
+                   __global const VOXEL* vol, __global unsigned char* maxArr, __global ulong* workSum,
+                   __global ulong* groupMaxArr, __local ulong* scratch, __global unsigned char* out,
+                   float windowLow, float windowScale)
+{
+    int u = get_global_id(vMajor ? 1 : 0);
+    int v = get_global_id(vMajor ? 0 : 1);
+    const long origin[3] = { ox, oy, oz };
+    const long uStep[3] = { ux, uy, uz };
+    const long vStep[3] = { vx, vy, vz };
+    const long iStep[3] = { ix, iy, iz };
+    const int dims[3] = { cols, rows, sheets };
+
+    long base[3];
+    int begin, end;
+    ObliqueState st;
+    if (obliqueRay(u, v, outCols, outRows, depth, origin, uStep, vStep, iStep, dims,
+                   base, &begin, &end, &st)) {
+        for (int i = begin; i < end && (mode < 0 || renderWants(&st.render, mode, minTransmittance)); i++) {
+            long p[3] = { base[0] + i * ix, base[1] + i * iy, base[2] + i * iz };
+            obliqueSample(&st, mode, i, depth,
+                          sampleVolume(vol, rows, cols, sheets, p, windowLow, windowScale),
+                          threshold, transfer);
+        }
+        storeOblique(&st, mode, end - begin, (long)v * outCols + u, maxArr, workSum, out);
+    }
+    else {
+        st.sum = 0;
+    }
+
+    if (mode < 0)
+        groupMax(st.sum, groupMaxArr, scratch);
+}
+
+#ifdef HAVE_IMAGES
+
+// Image x, y, z are the volume's rows, cols, sheets; outside it, voxels are 0
+__constant sampler_t volumeSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP | CLK_FILTER_LINEAR;
+
+__kernel
+void ObliqueImageKernel(int outCols, int outRows, int depth, int rows, int cols, int sheets,
+                        long ox, long oy, long oz, long ux, long uy, long uz,
+                        long vx, long vy, long vz, long ix, long iy, long iz, int vMajor,
+                        int mode, int threshold, uint minTransmittance, __constant unsigned char* transfer,
+                        __read_only image3d_t vol, __global unsigned char* maxArr, __global ulong* workSum,
+                        __global ulong* groupMaxArr, __local ulong* scratch, __global unsigned char* out)
+{
+    int u = get_global_id(vMajor ? 1 : 0);
+    int v = get_global_id(vMajor ? 0 : 1);
+    const long origin[3] = { ox, oy, oz };
+    const long uStep[3] = { ux, uy, uz };
+    const long vStep[3] = { vx, vy, vz };
+    const long iStep[3] = { ix, iy, iz };
+    const int dims[3] = { cols, rows, sheets };
+
+    long base[3];
+    int begin, end;
+    ObliqueState st;
+    if (obliqueRay(u, v, outCols, outRows, depth, origin, uStep, vStep, iStep, dims,
+                   base, &begin, &end, &st)) {
+        for (int i = begin; i < end && (mode < 0 || renderWants(&st.render, mode, minTransmittance)); i++) {
+            // Texel centers are at whole numbers + 0.5
+            float4 coord;
+            coord.x = (base[1] + i * iy) / 65536.0f + 0.5f;
+            coord.y = (base[0] + i * ix) / 65536.0f + 0.5f;
+            coord.z = (base[2] + i * iz) / 65536.0f + 0.5f;
+            coord.w = 0.0f;
+            uint val = (uint)(read_imagef(vol, volumeSampler, coord).x * 255.0f + 0.5f);
+            obliqueSample(&st, mode, i, depth, val, threshold, transfer);
+        }
+        storeOblique(&st, mode, end - begin, (long)v * outCols + u, maxArr, workSum, out);
+    }
+    else {
+        st.sum = 0;
+    }
+
+    if (mode < 0)
+        groupMax(st.sum, groupMaxArr, scratch);
+}
+
+#endif
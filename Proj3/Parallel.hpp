@@ -0,0 +1,48 @@
+#ifndef EECS690_PARALLEL_HPP
+#define EECS690_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/** numThreads, or every hardware thread if it is 0 */
+inline int threadCount(int numThreads)
+{
+    return numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * Run f(begin, end) over [0, n) split into contiguous ranges, one per thread
+ */
+template <typename F>
+void parallelFor(int n, int numThreads, F f)
+{
+    int nThreads = std::max(1, std::min(numThreads, n));
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nThreads; t++) {
+        int begin = static_cast<int>(static_cast<long>(n) * t / nThreads);
+        int end = static_cast<int>(static_cast<long>(n) * (t + 1) / nThreads);
+        threads.emplace_back(f, begin, end);
+    }
+    f(0, static_cast<int>(static_cast<long>(n) / nThreads));
+    for (auto& thread : threads)
+        thread.join();
+}
+
+/**
+ * Run f(i) for each i in [0, n) on a pool of threads, each taking the next i
+ * when it finishes the last, for items whose cost varies
+ */
+template <typename F>
+void parallelForEach(int n, int numThreads, F f)
+{
+    std::atomic<int> next(0);
+    int nThreads = std::max(1, std::min(numThreads, n));
+    parallelFor(nThreads, nThreads, [&](int, int) {
+        for (int i = next++; i < n; i = next++)
+            f(i);
+    });
+}
+
+#endif //EECS690_PARALLEL_HPP
@@ -0,0 +1,152 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <vector>
+
+Profiler::Profiler() : created(std::chrono::steady_clock::now())
+{
+}
+
+Profiler::~Profiler()
+{
+    for (const auto& e : entries) {
+        if (e.event != nullptr)
+            clReleaseEvent(e.event);
+    }
+}
+
+int Profiler::addDevice(const std::string& name)
+{
+    devices.push_back(name);
+    return static_cast<int>(devices.size()) - 1;
+}
+
+cl_event* Profiler::track(const std::string& stage, int projection, size_t bytes, int device)
+{
+    Entry e = { stage, projection, bytes, false, 0.0, 0.0, nullptr, device };
+    entries.push_back(e);
+    return &entries.back().event;
+}
+
+void Profiler::addEvent(const std::string& stage, cl_event event, int projection, size_t bytes,
+                        int device)
+{
+    clRetainEvent(event);
+    *track(stage, projection, bytes, device) = event;
+}
+
+void Profiler::addHost(const std::string& stage, double ms, size_t bytes)
+{
+    double endMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - created).count();
+    Entry e = { stage, 0, bytes, true, endMs - ms, endMs, nullptr, 0 };
+    entries.push_back(e);
+}
+
+static std::string jsonString(const std::string& s)
+{
+    std::string quoted = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        if (static_cast<unsigned char>(c) >= ' ')
+            quoted += c;
+    }
+    return quoted + '"';
+}
+
+void Profiler::writeJson(std::ostream& out) const
+{
+    // Device times are in nanoseconds on each device's own clock; they are
+    // reported in milliseconds from the start of that device's first command
+    std::vector<double> startMs(entries.size()), endMs(entries.size());
+    size_t numDevices = std::max<size_t>(devices.size(), 1);
+    std::vector<cl_ulong> first(numDevices, 0);
+    std::vector<bool> anyCommand(numDevices, false);
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& e = entries[i];
+        if (e.host) {
+            startMs[i] = e.startMs;
+            endMs[i] = e.endMs;
+            continue;
+        }
+        cl_ulong start = 0, end = 0;
+        if (e.event != nullptr) {
+            clGetEventProfilingInfo(e.event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr);
+            clGetEventProfilingInfo(e.event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+        }
+        startMs[i] = static_cast<double>(start);
+        endMs[i] = static_cast<double>(end);
+        size_t d = static_cast<size_t>(e.device);
+        if (!anyCommand[d] || start < first[d])
+            first[d] = start;
+        anyCommand[d] = true;
+    }
+    double deviceEnd = 0.0; // of the device that took longest
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!entries[i].host) {
+            double deviceFirst = static_cast<double>(first[entries[i].device]);
+            startMs[i] = (startMs[i] - deviceFirst) / 1.0e6;
+            endMs[i] = (endMs[i] - deviceFirst) / 1.0e6;
+            deviceEnd = std::max(deviceEnd, endMs[i]);
+        }
+    }
+
+    // Totals by stage, in the order the stages first appear
+    struct Stage
+    {
+        std::string name;
+        bool host;
+        int count;
+        double ms;
+        size_t bytes;
+    };
+    std::vector<Stage> stages;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& e = entries[i];
+        auto s = std::find_if(stages.begin(), stages.end(), [&e](const Stage& st) {
+            return st.name == e.stage && st.host == e.host;
+        });
+        if (s == stages.end()) {
+            Stage st = { e.stage, e.host, 0, 0.0, 0 };
+            stages.push_back(st);
+            s = stages.end() - 1;
+        }
+        s->count++;
+        s->ms += endMs[i] - startMs[i];
+        s->bytes += e.bytes;
+    }
+
+    std::string deviceNames;
+    for (size_t d = 0; d < devices.size(); d++)
+        deviceNames += (d > 0 ? ", " : "") + devices[d];
+    out << "{\n  \"device\": " << jsonString(deviceNames) << ",\n";
+    out << "  \"device_span_ms\": " << deviceEnd << ",\n";
+    out << "  \"stages\": [";
+    for (size_t i = 0; i < stages.size(); i++) {
+        const Stage& s = stages[i];
+        out << (i > 0 ? ",\n" : "\n") << "    { \"stage\": " << jsonString(s.name)
+            << ", \"where\": \"" << (s.host ? "host" : "device") << "\""
+            << ", \"count\": " << s.count << ", \"total_ms\": " << s.ms;
+        if (s.bytes > 0) {
+            out << ", \"bytes\": " << s.bytes;
+            if (s.ms > 0.0)
+                out << ", \"GB_per_s\": " << s.bytes / (s.ms * 1.0e6);
+        }
+        out << " }";
+    }
+    out << "\n  ],\n  \"commands\": [";
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& e = entries[i];
+        out << (i > 0 ? ",\n" : "\n") << "    { \"stage\": " << jsonString(e.stage)
+            << ", \"where\": \"" << (e.host ? "host" : "device") << "\"";
+        if (!e.host && devices.size() > 1)
+            out << ", \"device\": " << e.device;
+        if (e.projection > 0)
+            out << ", \"projection\": " << e.projection;
+        if (e.bytes > 0)
+            out << ", \"bytes\": " << e.bytes;
+        out << ", \"start_ms\": " << startMs[i] << ", \"end_ms\": " << endMs[i] << " }";
+    }
+    out << "\n  ]\n}\n";
+}
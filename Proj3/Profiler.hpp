@@ -0,0 +1,73 @@
+#ifndef EECS690_PROFILER_HPP
+#define EECS690_PROFILER_HPP
+
+#include <chrono>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+    #include <OpenCL/opencl.h>
+
+#else
+    #include <CL/opencl.h>
+#endif
+
+/**
+ * Collects the time taken by each stage of a run: OpenCL commands (from the
+ * events of queues created with CL_QUEUE_PROFILING_ENABLE) and host work such
+ * as reading the volume and writing the images. The report, written as JSON,
+ * lists every command and the total, count, and bytes of each stage. Each
+ * device's commands are timed on that device's own clock.
+ */
+class Profiler
+{
+public:
+    Profiler();
+    ~Profiler();
+
+    /**
+     * The event to pass to an enqueue call for a command of the given stage
+     * (and projection type, if it belongs to one) on the device addDevice
+     * numbered. It is read once the command has finished, in writeJson.
+     */
+    cl_event* track(const std::string& stage, int projection = 0, size_t bytes = 0, int device = 0);
+
+    /** Track a command whose event the caller already has (it is retained) */
+    void addEvent(const std::string& stage, cl_event event, int projection = 0, size_t bytes = 0,
+                  int device = 0);
+
+    /** Record host work that took ms milliseconds */
+    void addHost(const std::string& stage, double ms, size_t bytes = 0);
+
+    /**
+     * Add a device the commands run on
+     * @return its number, to pass to track and addEvent for its commands
+     */
+    int addDevice(const std::string& name);
+
+    /** Write the report; every tracked command must have finished */
+    void writeJson(std::ostream& out) const;
+
+private:
+    Profiler(const Profiler&); // cannot be copied
+    Profiler& operator=(const Profiler&);
+
+    struct Entry
+    {
+        std::string stage;
+        int projection;
+        size_t bytes;
+        bool host;
+        double startMs, endMs;  // host entries, since the profiler was created
+        cl_event event;         // device entries
+        int device;             // device entries: the addDevice number
+    };
+
+    std::chrono::steady_clock::time_point created;
+    std::vector<std::string> devices;
+    std::deque<Entry> entries; // a deque so that tracked events do not move
+};
+
+#endif //EECS690_PROFILER_HPP
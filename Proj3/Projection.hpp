@@ -0,0 +1,153 @@
+#ifndef EECS690_PROJECTION_HPP
+#define EECS690_PROJECTION_HPP
+
+#include <cstdint>
+
+/**
+ * Geometry of the six projection types. This is shared by the CPU engine
+ * (CPUProjector) and the OpenCL kernels, so both walk exactly the same voxels.
+ *
+ * The volume has rows x cols x sheets voxels, and voxel (row y, col x, sheet z)
+ * is stored at offset y + rows * (x + cols * z). Output pixel (u, v) (column u,
+ * row v) is stored at v * outCols + u and is computed from the `depth` voxels
+ * along its ray. Sample i of that ray (0 <= i < depth) is the voxel at
+ *
+ *     origin + u * uStride + v * vStride + i * iStride
+ *
+ * Type   image (outCols x outRows)   voxel for sample i of pixel (u, v)
+ *   1    cols x rows                 x = u,          y = v,          z = i
+ *   2    cols x rows                 x = cols-1-u,   y = v,          z = sheets-1-i
+ *   3    sheets x rows               x = i,          y = v,          z = sheets-1-u
+ *   4    sheets x rows               x = cols-1-i,   y = v,          z = u
+ *   5    cols x sheets               x = u,          y = i,          z = sheets-1-v
+ *   6    cols x sheets               x = u,          y = rows-1-i,   z = v
+ */
+struct Projection
+{
+    int type;
+    int outRows, outCols, depth;
+    long origin, uStride, vStride, iStride;
+};
+
+/**
+ * Fill in the geometry of projection `type` of a rows x cols x sheets volume
+ * @return false if type is not 1-6
+ */
+inline bool makeProjection(int type, int rows, int cols, int sheets, Projection& p)
+{
+    long R = rows;
+    long RC = R * cols;
+    p.type = type;
+    switch (type) {
+        case 1:
+            p.outCols = cols; p.outRows = rows; p.depth = sheets;
+            p.origin = 0;
+            p.uStride = R; p.vStride = 1; p.iStride = RC;
+            break;
+        case 2:
+            p.outCols = cols; p.outRows = rows; p.depth = sheets;
+            p.origin = R * (cols - 1) + RC * (sheets - 1);
+            p.uStride = -R; p.vStride = 1; p.iStride = -RC;
+            break;
+        case 3:
+            p.outCols = sheets; p.outRows = rows; p.depth = cols;
+            p.origin = RC * (sheets - 1);
+            p.uStride = -RC; p.vStride = 1; p.iStride = R;
+            break;
+        case 4:
+            p.outCols = sheets; p.outRows = rows; p.depth = cols;
+            p.origin = R * (cols - 1);
+            p.uStride = RC; p.vStride = 1; p.iStride = -R;
+            break;
+        case 5:
+            p.outCols = cols; p.outRows = sheets; p.depth = rows;
+            p.origin = RC * (sheets - 1);
+            p.uStride = R; p.vStride = -RC; p.iStride = 1;
+            break;
+        case 6:
+            p.outCols = cols; p.outRows = sheets; p.depth = rows;
+            p.origin = R - 1;
+            p.uStride = R; p.vStride = RC; p.iStride = -1;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+/**
+ * The part of a projection that depends only on sheets z0 <= z < z1 of the
+ * volume, used to stream a volume one slab of sheets at a time. Sheets are
+ * the outermost dimension, so a slab is one contiguous range of voxels.
+ *
+ * For types 1 and 2 the slab holds a range of samples of every ray, and its
+ * results are combined with those of the earlier slabs. For types 3-6 it
+ * holds every sample of a window of whole columns (types 3 and 4) or rows
+ * (5 and 6) of the image.
+ */
+struct Slab
+{
+    Projection proj;   // the window: geometry relative to the slab's first voxel
+    int firstSample;   // the index along the rays of the window's sample 0
+    long outOrigin;    // the index in the whole image of the window's pixel (0, 0)
+    int outStride;     // the number of columns of the whole image
+    bool accumulate;   // combine with the results of earlier slabs
+};
+
+/**
+ * Fill in slab s: the part of projection p of a rows x cols x sheets volume
+ * that depends on sheets z0 <= z < z1 only
+ */
+inline void makeSlab(const Projection& p, int rows, int cols, int sheets, int z0, int z1, Slab& s)
+{
+    s.proj = p;
+    s.proj.origin -= static_cast<long>(rows) * cols * z0;
+    s.firstSample = 0;
+    s.outOrigin = 0;
+    s.outStride = p.outCols;
+    s.accumulate = false;
+
+    // The axis of the image or the rays that runs along the sheets, and
+    // whether it runs from the last sheet (z = sheets - 1 - index)
+    bool reversed = (p.type == 2 || p.type == 3 || p.type == 5);
+    int first = reversed ? sheets - z1 : z0;
+    int count = z1 - z0;
+    if (p.type == 1 || p.type == 2) {
+        s.proj.origin += first * p.iStride;
+        s.proj.depth = count;
+        s.firstSample = first;
+        s.accumulate = (z0 > 0);
+    }
+    else if (p.type == 3 || p.type == 4) {
+        s.proj.origin += first * p.uStride;
+        s.proj.outCols = count;
+        s.outOrigin = first;
+    }
+    else {
+        s.proj.origin += first * p.vStride;
+        s.proj.outRows = count;
+        s.outOrigin = static_cast<long>(first) * p.outCols;
+    }
+}
+
+/** The whole of projection p as a single slab */
+inline Slab wholeSlab(const Projection& p)
+{
+    Slab s = { p, 0, 0, p.outCols, false };
+    return s;
+}
+
+/**
+ * The weighted sum of a ray is sum((i + 1) * voxel(i)): deeper samples count
+ * more. Sums are kept as exact 64-bit integers (they are only ever compared
+ * to the largest sum), so every device and the CPU get identical results.
+ * Pixel p of the normalized image is sum[p] * 255 / maxSum, rounded to nearest.
+ */
+inline unsigned char normalizeSum(uint64_t sum, uint64_t maxSum)
+{
+    if (maxSum == 0)
+        return 0;
+    return static_cast<unsigned char>((sum * 510 + maxSum) / (2 * maxSum));
+}
+
+#endif //EECS690_PROJECTION_HPP
@@ -0,0 +1,1013 @@
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "ProjectionContext.hpp"
+#include "helpers.hpp"
+
+// Directory of cached program binaries
+static const char* PROGRAM_CACHE_DIR = "clcache";
+
+// Work group sizes found by tuning
+static const char* WORK_SIZE_CACHE = "worksize.cache";
+
+// In order: the later files use functions of the earlier ones
+static const char* KERNEL_FILES[] = { "MaxKernel.cl", "SumKernel.cl", "RenderKernel.cl",
+                                      "ObliqueKernel.cl" };
+static const int NUM_KERNEL_FILES = 4;
+
+// 64 bit FNV-1a: a hash that is the same on every platform and run
+static uint64_t fnv1a(const std::string& s, uint64_t hash = 14695981039346656037ULL)
+{
+    for (unsigned char c : s) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static std::string deviceInfoString(cl_device_id device, cl_device_info what)
+{
+    size_t size = 0;
+    clGetDeviceInfo(device, what, 0, nullptr, &size);
+    std::vector<char> buf(size + 1, '\0');
+    clGetDeviceInfo(device, what, size, buf.data(), nullptr);
+    return std::string(buf.data());
+}
+
+std::vector<cl_device_id> ProjectionContext::allDevices()
+{
+    std::vector<cl_device_id> devices;
+    cl_uint numPlatforms = 0;
+    if (clGetPlatformIDs(0, nullptr, &numPlatforms) != CL_SUCCESS || numPlatforms == 0)
+        return devices;
+    std::vector<cl_platform_id> platforms(numPlatforms);
+    clGetPlatformIDs(numPlatforms, platforms.data(), nullptr);
+    for (auto platform : platforms) {
+        cl_uint numDevices = 0;
+        if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, nullptr, &numDevices) != CL_SUCCESS)
+            continue;
+        std::vector<cl_device_id> platformDevices(numDevices);
+        clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, numDevices, platformDevices.data(), nullptr);
+        devices.insert(devices.end(), platformDevices.begin(), platformDevices.end());
+    }
+    return devices;
+}
+
+static bool supportsImages(cl_device_id device)
+{
+    cl_bool images = CL_FALSE;
+    clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(images), &images, nullptr);
+    return images == CL_TRUE;
+}
+
+// Whether the context can make the read-only CL_R, CL_UNORM_INT8 3D images
+// of ObliqueImageKernel (a format OpenCL requires only from version 2.0)
+static bool supportsVolumeImages(cl_context context)
+{
+    cl_uint count = 0;
+    if (clGetSupportedImageFormats(context, CL_MEM_READ_ONLY, CL_MEM_OBJECT_IMAGE3D, 0, nullptr,
+                                   &count) != CL_SUCCESS || count == 0)
+        return false;
+    std::vector<cl_image_format> formats(count);
+    if (clGetSupportedImageFormats(context, CL_MEM_READ_ONLY, CL_MEM_OBJECT_IMAGE3D, count,
+                                   formats.data(), nullptr) != CL_SUCCESS)
+        return false;
+    for (const cl_image_format& f : formats) {
+        if (f.image_channel_order == CL_R && f.image_channel_data_type == CL_UNORM_INT8)
+            return true;
+    }
+    return false;
+}
+
+static cl_device_id selectDevice(std::string spec)
+{
+    std::vector<cl_device_id> devices = ProjectionContext::allDevices();
+    if (devices.empty()) {
+        std::cerr << "No OpenCL devices\n";
+        exit(1);
+    }
+    if (spec.empty() && getenv("PROJ3_DEVICE") != nullptr)
+        spec = getenv("PROJ3_DEVICE");
+
+    if (spec.empty()) {
+        for (auto d : devices) {
+            cl_device_type type;
+            clGetDeviceInfo(d, CL_DEVICE_TYPE, sizeof(type), &type, nullptr);
+            if (type & CL_DEVICE_TYPE_GPU)
+                return d;
+        }
+        return devices[0];
+    }
+
+    if (spec.find_first_not_of("0123456789") == std::string::npos) {
+        size_t index = std::stoul(spec);
+        if (index < devices.size())
+            return devices[index];
+    }
+    else {
+        for (auto d : devices) {
+            if (deviceInfoString(d, CL_DEVICE_NAME).find(spec) != std::string::npos)
+                return d;
+        }
+    }
+    std::cerr << "No OpenCL device matches \"" << spec << "\"\n";
+    exit(1);
+}
+
+ProjectionContext::ProjectionContext(const std::string& deviceSpec, bool tune, bool debug,
+                                     Profiler* profiler) :
+    tune(tune), debug(debug), profiler(profiler), profileDevice(0), device(selectDevice(deviceSpec)),
+    context(nullptr), cmdQueue(nullptr), transferQueue(nullptr), program(nullptr),
+    maxKernel(nullptr), maxRaysKernel(nullptr), reduceMaxKernel(nullptr), sumKernel(nullptr),
+    renderKernel(nullptr), obliqueKernel(nullptr), obliqueImageKernel(nullptr), reduceSize(1),
+    useImages(true), imageFormatSupported(false), volumeRows(0), volumeCols(0), volumeSheets(0),
+    volumeImage(nullptr), volumeImageFailed(false),
+    imgBuffer(nullptr), maxBuffer(nullptr), sumBuffer(nullptr), workingBuffer(nullptr),
+    groupMaxBuffer(nullptr), maxSumBuffer(nullptr), renderBuffer(nullptr), transferBuffer(nullptr),
+    imgCapacity(0), maxCapacity(0), sumCapacity(0), workCapacity(0), groupMaxCapacity(0),
+    renderCapacity(0)
+{
+    cl_int status;
+    std::cout << "Using OpenCL device: " << getDeviceName() << '\n';
+
+    // Create context
+    context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &status);
+    checkStatus("clCreateContext", status, true, debug);
+    imageFormatSupported = supportsImages(device) && supportsVolumeImages(context);
+
+    // Create command queue for the device
+    cl_command_queue_properties properties = 0;
+    if (profiler != nullptr) {
+        properties = CL_QUEUE_PROFILING_ENABLE;
+        profileDevice = profiler->addDevice(getDeviceName());
+    }
+    cmdQueue = clCreateCommandQueue(context, device, properties, &status);
+    checkStatus("clCreateCommandQueue", status, true, debug);
+
+    // A second queue copies streamed slabs while the first runs the kernels
+    transferQueue = clCreateCommandQueue(context, device, properties, &status);
+    checkStatus("clCreateCommandQueue-transferQueue", status, true, debug);
+
+    // Create buffer for the largest sum, found on the device
+    maxSumBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_ulong), nullptr, &status);
+    checkStatus("clCreateBuffer-maxSumBuffer", status, true, debug);
+
+    // The transfer function argument is bound for every rendering, so it
+    // exists (zeroed) before any composite loads it; it is small enough for
+    // any device's __constant space
+    std::vector<unsigned char> noTransfer(4 * 256, 0);
+    transferBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, noTransfer.size(),
+                                    noTransfer.data(), &status);
+    checkStatus("clCreateBuffer-transferBuffer", status, true, debug);
+
+    buildProgram();
+    createKernels();
+}
+
+ProjectionContext::~ProjectionContext()
+{
+    cl_mem buffers[] = { imgBuffer, maxBuffer, sumBuffer, workingBuffer, groupMaxBuffer, maxSumBuffer,
+                         renderBuffer, transferBuffer, volumeImage };
+    for (auto buffer : buffers) {
+        if (buffer != nullptr)
+            clReleaseMemObject(buffer);
+    }
+    releaseKernels();
+    clReleaseCommandQueue(cmdQueue);
+    clReleaseCommandQueue(transferQueue);
+    clReleaseContext(context);
+}
+
+void ProjectionContext::createKernels()
+{
+    cl_int status;
+    maxKernel = clCreateKernel(program, "MaxKernel", &status);
+    checkStatus("clCreateKernel-MaxKernel", status, true, debug);
+    maxRaysKernel = clCreateKernel(program, "MaxRaysKernel", &status);
+    checkStatus("clCreateKernel-MaxRaysKernel", status, true, debug);
+    reduceMaxKernel = clCreateKernel(program, "ReduceMaxKernel", &status);
+    checkStatus("clCreateKernel-ReduceMaxKernel", status, true, debug);
+    sumKernel = clCreateKernel(program, "SumKernel", &status);
+    checkStatus("clCreateKernel-SumKernel", status, true, debug);
+    renderKernel = clCreateKernel(program, "RenderKernel", &status);
+    checkStatus("clCreateKernel-RenderKernel", status, true, debug);
+    obliqueKernel = clCreateKernel(program, "ObliqueKernel", &status);
+    checkStatus("clCreateKernel-ObliqueKernel", status, true, debug);
+    if (supportsImages(device)) {
+        obliqueImageKernel = clCreateKernel(program, "ObliqueImageKernel", &status);
+        checkStatus("clCreateKernel-ObliqueImageKernel", status, true, debug);
+    }
+
+    reduceSize = chooseReductionSize(reduceMaxKernel, device);
+    status = clSetKernelArg(reduceMaxKernel, 2, sizeof(cl_mem), &maxSumBuffer);
+    checkStatus("clSetKernelArg-2", status, true, debug);
+    status = clSetKernelArg(reduceMaxKernel, 3, reduceSize * sizeof(cl_ulong), nullptr);
+    checkStatus("clSetKernelArg-3", status, true, debug);
+    status = clSetKernelArg(sumKernel, 2, sizeof(cl_mem), &maxSumBuffer);
+    checkStatus("clSetKernelArg-2", status, true, debug);
+    setWindowArgs();
+}
+
+// The window arguments end the argument lists of the kernels that read voxels
+void ProjectionContext::setWindowArgs()
+{
+    const std::pair<cl_kernel, cl_uint> windowed[] = {
+        { maxKernel, 17 }, { maxRaysKernel, 17 }, { renderKernel, 14 }, { obliqueKernel, 29 }
+    };
+    cl_int status;
+    for (const auto& k : windowed) {
+        status = clSetKernelArg(k.first, k.second, sizeof(float), &programFormat.windowLow);
+        checkStatus("clSetKernelArg-windowLow", status, true, debug);
+        status = clSetKernelArg(k.first, k.second + 1, sizeof(float), &programFormat.windowScale);
+        checkStatus("clSetKernelArg-windowScale", status, true, debug);
+    }
+}
+
+void ProjectionContext::releaseKernels()
+{
+    clReleaseKernel(maxKernel);
+    clReleaseKernel(maxRaysKernel);
+    clReleaseKernel(reduceMaxKernel);
+    clReleaseKernel(sumKernel);
+    clReleaseKernel(renderKernel);
+    clReleaseKernel(obliqueKernel);
+    if (obliqueImageKernel != nullptr)
+        clReleaseKernel(obliqueImageKernel);
+    obliqueImageKernel = nullptr;
+    clReleaseProgram(program);
+}
+
+// Each voxel type, windowed or not, has its own build of the program
+void ProjectionContext::useFormat(const VoxelFormat& format)
+{
+    bool rebuild = format.type != programFormat.type || format.windowed != programFormat.windowed;
+    programFormat = format;
+    if (!rebuild) {
+        setWindowArgs();
+        return;
+    }
+    releaseKernels();
+    buildProgram();
+    createKernels();
+
+    // The work sizes were chosen for the old kernels
+    workSizes.clear();
+    tuned.clear();
+}
+
+std::string ProjectionContext::getDeviceName() const
+{
+    return deviceInfoString(device, CL_DEVICE_NAME);
+}
+
+/**
+ * Build the program from the cached binary for this device and these
+ * sources if there is one, else from the sources (and cache the binary).
+ * ObliqueImageKernel is only built (HAVE_IMAGES) for devices with images,
+ * and the kernels read the voxels of programFormat (see MaxKernel.cl).
+ */
+void ProjectionContext::buildProgram()
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string options = supportsImages(device) ? "-D HAVE_IMAGES" : "";
+    if (programFormat.type == VOXEL_U16)
+        options += " -D VOXEL=ushort";
+    else if (programFormat.type == VOXEL_F32)
+        options += " -D VOXEL=float";
+    if (programFormat.windowed)
+        options += " -D WINDOWED";
+    const char* sources[NUM_KERNEL_FILES];
+    uint64_t hash = fnv1a(deviceInfoString(device, CL_DEVICE_NAME) + '|' +
+                          deviceInfoString(device, CL_DEVICE_VENDOR) + '|' +
+                          deviceInfoString(device, CL_DRIVER_VERSION) + '|' + options);
+    for (int i = 0; i < NUM_KERNEL_FILES; i++) {
+        sources[i] = readSource(KERNEL_FILES[i]);
+        hash = fnv1a(sources[i], hash);
+    }
+    std::ostringstream cacheFile;
+    cacheFile << PROGRAM_CACHE_DIR << '/' << std::hex << hash << ".bin";
+
+    cl_int status = CL_BUILD_PROGRAM_FAILURE;
+    std::ifstream in(cacheFile.str(), std::ios::binary);
+    if (in) {
+        std::vector<unsigned char> binary((std::istreambuf_iterator<char>(in)),
+                                          std::istreambuf_iterator<char>());
+        const unsigned char* binaryData = binary.data();
+        size_t binarySize = binary.size();
+        cl_int binaryStatus;
+        program = clCreateProgramWithBinary(context, 1, &device, &binarySize, &binaryData,
+                                            &binaryStatus, &status);
+        if (status == CL_SUCCESS)
+            status = binaryStatus;
+        if (status == CL_SUCCESS)
+            status = clBuildProgram(program, 1, &device, options.c_str(), nullptr, nullptr);
+        if (status != CL_SUCCESS && program != nullptr) {
+            clReleaseProgram(program); // stale or corrupt: rebuild from source
+            program = nullptr;
+        }
+    }
+
+    bool fromCache = (status == CL_SUCCESS);
+    if (!fromCache) {
+        program = clCreateProgramWithSource(context, NUM_KERNEL_FILES, sources, nullptr, &status);
+        checkStatus("clCreateProgramWithSource", status, true, debug);
+        status = clBuildProgram(program, 1, &device, options.c_str(), nullptr, nullptr);
+        if (status != 0)
+            showProgramBuildLog(program, device);
+        checkStatus("clBuildProgram", status, true, debug);
+
+        size_t binarySize = 0;
+        clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, nullptr);
+        if (binarySize > 0) {
+            std::vector<unsigned char> binary(binarySize);
+            unsigned char* binaryData = binary.data();
+            clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binaryData, nullptr);
+            mkdir(PROGRAM_CACHE_DIR, 0755);
+            std::ofstream out(cacheFile.str(), std::ios::binary);
+            out.write(reinterpret_cast<const char*>(binary.data()), binarySize);
+        }
+    }
+    for (int i = 0; i < NUM_KERNEL_FILES; i++)
+        free(const_cast<char*>(sources[i])); // readSource allocates with malloc
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Program " << (fromCache ? "loaded from " + cacheFile.str() : std::string("built"))
+              << " in " << ms << " ms\n";
+    if (profiler != nullptr)
+        profiler->addHost(fromCache ? "load program" : "build program", ms);
+}
+
+// The event argument for a command: the profiler's, when profiling
+cl_event* ProjectionContext::track(const std::string& stage, int projection, size_t bytes)
+{
+    return profiler != nullptr ? profiler->track(stage, projection, bytes, profileDevice) : nullptr;
+}
+
+void ProjectionContext::ensureBuffer(cl_mem& buffer, size_t& capacity, size_t bytes, const char* name)
+{
+    if (bytes <= capacity)
+        return;
+    if (buffer != nullptr)
+        clReleaseMemObject(buffer);
+    cl_int status;
+    buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, nullptr, &status);
+    checkStatus(std::string("clCreateBuffer-") + name, status, true, debug);
+    capacity = bytes;
+}
+
+void ProjectionContext::setVolume(int rows, int cols, int sheets, const unsigned char* voxels,
+                                  bool inPlace, const VoxelFormat& format)
+{
+    useFormat(format);
+    size_t buffSize = volumeBytes(rows, cols, sheets, format.type);
+    cl_bool unifiedMemory = CL_FALSE;
+    clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unifiedMemory), &unifiedMemory, nullptr);
+    cl_int status;
+    if (inPlace && unifiedMemory) {
+        // The buffer belongs to these voxels, so the next volume needs a new one
+        if (imgBuffer != nullptr)
+            clReleaseMemObject(imgBuffer);
+        imgBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, buffSize,
+                                   const_cast<unsigned char*>(voxels), &status);
+        checkStatus("clCreateBuffer-imgBuffer", status, true, debug);
+        imgCapacity = 0;
+    }
+    else {
+        ensureBuffer(imgBuffer, imgCapacity, buffSize, "imgBuffer");
+        status = clEnqueueWriteBuffer(cmdQueue, imgBuffer, CL_TRUE, 0, buffSize, voxels,
+                                      0, nullptr, track("write volume", 0, buffSize));
+        checkStatus("clEnqueueWriteBuffer-imgBuffer", status, true, debug);
+    }
+
+    volumeRows = rows;
+    volumeCols = cols;
+    volumeSheets = sheets;
+    if (volumeImage != nullptr) {
+        clReleaseMemObject(volumeImage);
+        volumeImage = nullptr;
+    }
+    volumeImageFailed = false;
+}
+
+// Local memory per work item of each kernel: MaxKernel, MaxRaysKernel and
+// the oblique kernels reduce their sums in one ulong each, and MaxRaysKernel
+// stages TILE_DEPTH + 1 samples of its ray (see MaxKernel.cl)
+static const size_t TILE_DEPTH = 64;
+
+size_t ProjectionContext::localBytesPerItem(cl_kernel kernel) const
+{
+    if (kernel == maxRaysKernel)
+        return sizeof(cl_ulong) + TILE_DEPTH + 1;
+    if (kernel == maxKernel || kernel == obliqueKernel || kernel == obliqueImageKernel)
+        return sizeof(cl_ulong);
+    return 0;
+}
+
+// The per-group maxima and the group's local memory depend on the work size
+void ProjectionContext::prepareMaxKernel(cl_kernel kernel, const WorkSize& ws)
+{
+    size_t numGroups = (ws.global[0] / ws.local[0]) * (ws.global[1] / ws.local[1]);
+    size_t groupSize = ws.local[0] * ws.local[1];
+    cl_uint groupMaxArg = (kernel == maxKernel) ? 15 : (kernel == maxRaysKernel) ? 14 : 26;
+    ensureBuffer(groupMaxBuffer, groupMaxCapacity, numGroups * sizeof(cl_ulong), "groupMaxBuffer");
+    cl_int status = clSetKernelArg(kernel, groupMaxArg, sizeof(cl_mem), &groupMaxBuffer);
+    checkStatus("clSetKernelArg-groupMaxArr", status, true, debug);
+    status = clSetKernelArg(kernel, groupMaxArg + 1, groupSize * sizeof(cl_ulong), nullptr);
+    checkStatus("clSetKernelArg-scratch", status, true, debug);
+    if (kernel == maxRaysKernel) {
+        status = clSetKernelArg(kernel, groupMaxArg + 2, groupSize * (TILE_DEPTH + 1), nullptr);
+        checkStatus("clSetKernelArg-tile", status, true, debug);
+    }
+
+    cl_int numGroupsArg = static_cast<cl_int>(numGroups);
+    status = clSetKernelArg(reduceMaxKernel, 0, sizeof(cl_int), &numGroupsArg);
+    checkStatus("clSetKernelArg-0", status, true, debug);
+    status = clSetKernelArg(reduceMaxKernel, 1, sizeof(cl_mem), &groupMaxBuffer);
+    checkStatus("clSetKernelArg-1", status, true, debug);
+}
+
+// Choose (or, the first time a kernel is used when tuning, time) the work
+// size of a kernel for an NDRange of cols x rows. The arguments of the
+// kernel must be set.
+WorkSize ProjectionContext::workSizeFor(cl_kernel kernel, int cols, int rows)
+{
+    auto key = std::make_tuple(kernel, cols, rows);
+    auto found = workSizes.find(key);
+    if (found != workSizes.end())
+        return found->second;
+
+    WorkSize ws;
+    if (tune && tuned.insert(kernel).second) {
+        std::function<void(const WorkSize&)> prepare;
+        if (localBytesPerItem(kernel) > 0)
+            prepare = [this, kernel](const WorkSize& w) { prepareMaxKernel(kernel, w); };
+        ws = tuneWorkSize(cmdQueue, kernel, device, cols, rows, WORK_SIZE_CACHE, prepare,
+                          localBytesPerItem(kernel));
+    }
+    else {
+        ws = cachedWorkSize(kernel, device, cols, rows, WORK_SIZE_CACHE, localBytesPerItem(kernel));
+    }
+    if (debug) {
+        std::cout << "Work size: " << ws.global[0] << " x " << ws.global[1]
+                  << " in groups of " << ws.local[0] << " x " << ws.local[1] << '\n';
+    }
+    workSizes[key] = ws;
+    return ws;
+}
+
+uint64_t ProjectionContext::project(const Projection& p, unsigned char* maxImg,
+                                    unsigned char* sumImg, uint64_t* workSum)
+{
+    uint64_t maxSum = 0;
+    enqueueProjection(p, maxImg, sumImg, &maxSum, workSum);
+    finish();
+    return maxSum;
+}
+
+// The queue is in order, so the buffers of one projection may be reused by
+// the next as soon as it is queued: its kernels run after the reads before it
+void ProjectionContext::enqueueProjection(const Projection& p, unsigned char* maxImg,
+                                          unsigned char* sumImg, uint64_t* maxSum,
+                                          uint64_t* workSum)
+{
+    size_t projSize = static_cast<size_t>(p.outRows) * p.outCols;
+    ensureBuffer(maxBuffer, maxCapacity, projSize * sizeof(unsigned char), "maxBuffer");
+    ensureBuffer(workingBuffer, workCapacity, projSize * sizeof(cl_ulong), "workingBuffer");
+
+    enqueueSlab(wholeSlab(p), imgBuffer, maxBuffer, workingBuffer, nullptr, nullptr);
+    ProjectionOutput out = { maxImg, sumImg, maxSum, workSum };
+    enqueueResults(p, maxBuffer, workingBuffer, false, out);
+}
+
+/**
+ * Queue MaxKernel or MaxRaysKernel for slab s of a projection, reading the
+ * voxels from img and writing to maxBuf and workBuf. The kernel waits for
+ * waitEvent if it is not null, and its own event is returned in done if
+ * that is not null.
+ */
+void ProjectionContext::enqueueSlab(const Slab& s, cl_mem img, cl_mem maxBuf, cl_mem workBuf,
+                                    cl_event waitEvent, cl_event* done)
+{
+    const Projection& p = s.proj;
+    int outCols = p.outCols;
+    int outRows = p.outRows;
+
+    // Neighbouring work items must read neighbouring voxels. That is along u
+    // or v for types 1-4 (MaxKernel, with the NDRange swapped when it is v),
+    // but only along the rays for types 5 and 6 (MaxRaysKernel).
+    cl_kernel kernel = maxKernel;
+    cl_int vMajor = 0;
+    if (p.uStride != 1 && p.uStride != -1) {
+        if (p.vStride == 1 || p.vStride == -1)
+            vMajor = 1;
+        else if (p.iStride == 1 || p.iStride == -1)
+            kernel = maxRaysKernel;
+    }
+
+    // MaxKernel args: the projection geometry (see Projection.hpp) and the slab
+    cl_long origin = p.origin;
+    cl_long uStride = p.uStride;
+    cl_long vStride = p.vStride;
+    cl_long iStride = p.iStride;
+    cl_long outOrigin = s.outOrigin;
+    cl_int accumulate = s.accumulate ? 1 : 0;
+    cl_int status = clSetKernelArg(kernel, 0, sizeof(int), &outCols);
+    checkStatus("clSetKernelArg-0", status, true, debug);
+    status = clSetKernelArg(kernel, 1, sizeof(int), &outRows);
+    checkStatus("clSetKernelArg-1", status, true, debug);
+    status = clSetKernelArg(kernel, 2, sizeof(int), &p.depth);
+    checkStatus("clSetKernelArg-2", status, true, debug);
+    status = clSetKernelArg(kernel, 3, sizeof(cl_long), &origin);
+    checkStatus("clSetKernelArg-3", status, true, debug);
+    status = clSetKernelArg(kernel, 4, sizeof(cl_long), &uStride);
+    checkStatus("clSetKernelArg-4", status, true, debug);
+    status = clSetKernelArg(kernel, 5, sizeof(cl_long), &vStride);
+    checkStatus("clSetKernelArg-5", status, true, debug);
+    status = clSetKernelArg(kernel, 6, sizeof(cl_long), &iStride);
+    checkStatus("clSetKernelArg-6", status, true, debug);
+    status = clSetKernelArg(kernel, 7, sizeof(int), &s.firstSample);
+    checkStatus("clSetKernelArg-7", status, true, debug);
+    status = clSetKernelArg(kernel, 8, sizeof(cl_long), &outOrigin);
+    checkStatus("clSetKernelArg-8", status, true, debug);
+    status = clSetKernelArg(kernel, 9, sizeof(int), &s.outStride);
+    checkStatus("clSetKernelArg-9", status, true, debug);
+    status = clSetKernelArg(kernel, 10, sizeof(cl_int), &accumulate);
+    checkStatus("clSetKernelArg-10", status, true, debug);
+    cl_uint bufferArg = 11;
+    if (kernel == maxKernel) {
+        status = clSetKernelArg(kernel, bufferArg++, sizeof(cl_int), &vMajor);
+        checkStatus("clSetKernelArg-vMajor", status, true, debug);
+    }
+    status = clSetKernelArg(kernel, bufferArg, sizeof(cl_mem), &img);
+    checkStatus("clSetKernelArg-img", status, true, debug);
+    status = clSetKernelArg(kernel, bufferArg + 1, sizeof(cl_mem), &maxBuf);
+    checkStatus("clSetKernelArg-maxArr", status, true, debug);
+    status = clSetKernelArg(kernel, bufferArg + 2, sizeof(cl_mem), &workBuf);
+    checkStatus("clSetKernelArg-workSum", status, true, debug);
+
+    WorkSize maxWork = vMajor ? workSizeFor(kernel, outRows, outCols)
+                              : workSizeFor(kernel, outCols, outRows);
+    prepareMaxKernel(kernel, maxWork);
+
+    // The bytes are the voxels read
+    std::string name = (kernel == maxKernel) ? "MaxKernel" : "MaxRaysKernel";
+    size_t voxels = static_cast<size_t>(outCols) * outRows * p.depth;
+    status = clEnqueueNDRangeKernel(cmdQueue, kernel, 2, nullptr, maxWork.global, maxWork.local,
+                                    waitEvent != nullptr ? 1 : 0,
+                                    waitEvent != nullptr ? &waitEvent : nullptr,
+                                    done != nullptr ? done : track(name, p.type, voxels));
+    checkStatus("clEnqueueNDRangeKernel-MaxKernel", status, true, debug);
+    if (done != nullptr && profiler != nullptr)
+        profiler->addEvent(name, *done, p.type, voxels, profileDevice);
+}
+
+/**
+ * Queue the rest of projection p once its max image and working sums are
+ * in maxBuf and workBuf: finding the largest sum, normalizing, and reading
+ * the results back. The largest sum is reduced from MaxKernel's per-group
+ * maxima, or if reduceSums is set (after streaming, when those are partial),
+ * from all the working sums. If out.sumImg is null the sums are not
+ * normalized (DeviceGroup does that once it has every device's largest sum).
+ */
+void ProjectionContext::enqueueResults(const Projection& p, cl_mem maxBuf, cl_mem workBuf,
+                                       bool reduceSums, const ProjectionOutput& out)
+{
+    int outCols = p.outCols;
+    int outRows = p.outRows;
+    size_t projSize = static_cast<size_t>(outRows) * outCols;
+    size_t projBuffSize = projSize * sizeof(unsigned char);
+    size_t workBuffSize = projSize * sizeof(cl_ulong);
+    ensureBuffer(sumBuffer, sumCapacity, projBuffSize, "sumBuffer");
+
+    cl_int status;
+    if (reduceSums) {
+        cl_int n = static_cast<cl_int>(projSize);
+        status = clSetKernelArg(reduceMaxKernel, 0, sizeof(cl_int), &n);
+        checkStatus("clSetKernelArg-0", status, true, debug);
+        status = clSetKernelArg(reduceMaxKernel, 1, sizeof(cl_mem), &workBuf);
+        checkStatus("clSetKernelArg-1", status, true, debug);
+    }
+
+    // SumKernel args (arg 2, the max sum, is set once)
+    status = clSetKernelArg(sumKernel, 0, sizeof(int), &outCols);
+    checkStatus("clSetKernelArg-0", status, true, debug);
+    status = clSetKernelArg(sumKernel, 1, sizeof(int), &outRows);
+    checkStatus("clSetKernelArg-1", status, true, debug);
+    status = clSetKernelArg(sumKernel, 3, sizeof(cl_mem), &workBuf);
+    checkStatus("clSetKernelArg-3", status, true, debug);
+    status = clSetKernelArg(sumKernel, 4, sizeof(cl_mem), &sumBuffer);
+    checkStatus("clSetKernelArg-4", status, true, debug);
+    WorkSize sumWork = workSizeFor(sumKernel, outCols, outRows);
+
+    // The whole pipeline is queued without waiting: the working sums stay on
+    // the device, and only the two images (and the max sum) are read back
+    status = clEnqueueNDRangeKernel(cmdQueue, reduceMaxKernel, 1, nullptr,
+                                    &reduceSize, &reduceSize, 0, nullptr, track("ReduceMaxKernel", p.type));
+    checkStatus("clEnqueueNDRangeKernel-ReduceMaxKernel", status, true, debug);
+    if (out.sumImg != nullptr) {
+        status = clEnqueueNDRangeKernel(cmdQueue, sumKernel, 2, nullptr,
+                                        sumWork.global, sumWork.local, 0, nullptr, track("SumKernel", p.type));
+        checkStatus("clEnqueueNDRangeKernel-SumKernel", status, true, debug);
+    }
+
+    // Read data back
+    status = clEnqueueReadBuffer(cmdQueue, maxBuf, CL_FALSE, 0, projBuffSize, out.maxImg,
+                                 0, nullptr, track("read images", p.type, projBuffSize));
+    checkStatus("clEnqueueReadBuffer-maxBuffer", status, true, debug);
+    if (out.sumImg != nullptr) {
+        status = clEnqueueReadBuffer(cmdQueue, sumBuffer, CL_FALSE, 0, projBuffSize, out.sumImg,
+                                     0, nullptr, track("read images", p.type, projBuffSize));
+        checkStatus("clEnqueueReadBuffer-sumBuffer", status, true, debug);
+    }
+    status = clEnqueueReadBuffer(cmdQueue, maxSumBuffer, CL_FALSE, 0, sizeof(cl_ulong), out.maxSum,
+                                 0, nullptr, track("read max sum", p.type, sizeof(cl_ulong)));
+    checkStatus("clEnqueueReadBuffer-maxSumBuffer", status, true, debug);
+    if (out.workSum != nullptr) {
+        status = clEnqueueReadBuffer(cmdQueue, workBuf, CL_FALSE, 0, workBuffSize, out.workSum,
+                                     0, nullptr, track("read working sums", p.type, workBuffSize));
+        checkStatus("clEnqueueReadBuffer-workingBuffer", status, true, debug);
+    }
+}
+
+void ProjectionContext::flush()
+{
+    // Submit the queued commands to the device without waiting for them
+    cl_int status = clFlush(cmdQueue);
+    checkStatus("clFlush", status, true, debug);
+}
+
+void ProjectionContext::finish()
+{
+    // Block until finished
+    cl_int status = clFinish(cmdQueue);
+    checkStatus("clFinish", status, true, debug);
+}
+
+void ProjectionContext::enqueueRender(const Projection& p, RenderMode mode,
+                                      const RenderOptions& options, unsigned char* img)
+{
+    int outCols = p.outCols;
+    int outRows = p.outRows;
+    size_t imgBytes = static_cast<size_t>(outRows) * outCols * renderChannels(mode);
+    ensureBuffer(renderBuffer, renderCapacity, imgBytes, "renderBuffer");
+    cl_mem transfer = loadTransfer(mode, options);
+
+    // As for MaxKernel, dimension 0 walks v when v is the contiguous axis
+    cl_int vMajor = (p.uStride != 1 && p.uStride != -1 && (p.vStride == 1 || p.vStride == -1));
+    cl_long origin = p.origin;
+    cl_long uStride = p.uStride;
+    cl_long vStride = p.vStride;
+    cl_long iStride = p.iStride;
+    cl_int modeArg = mode;
+    cl_int threshold = options.threshold;
+    cl_uint minTransmittance = options.minTransmittance;
+    cl_int status = clSetKernelArg(renderKernel, 0, sizeof(int), &outCols);
+    checkStatus("clSetKernelArg-0", status, true, debug);
+    status = clSetKernelArg(renderKernel, 1, sizeof(int), &outRows);
+    checkStatus("clSetKernelArg-1", status, true, debug);
+    status = clSetKernelArg(renderKernel, 2, sizeof(int), &p.depth);
+    checkStatus("clSetKernelArg-2", status, true, debug);
+    status = clSetKernelArg(renderKernel, 3, sizeof(cl_long), &origin);
+    checkStatus("clSetKernelArg-3", status, true, debug);
+    status = clSetKernelArg(renderKernel, 4, sizeof(cl_long), &uStride);
+    checkStatus("clSetKernelArg-4", status, true, debug);
+    status = clSetKernelArg(renderKernel, 5, sizeof(cl_long), &vStride);
+    checkStatus("clSetKernelArg-5", status, true, debug);
+    status = clSetKernelArg(renderKernel, 6, sizeof(cl_long), &iStride);
+    checkStatus("clSetKernelArg-6", status, true, debug);
+    status = clSetKernelArg(renderKernel, 7, sizeof(cl_int), &vMajor);
+    checkStatus("clSetKernelArg-7", status, true, debug);
+    status = clSetKernelArg(renderKernel, 8, sizeof(cl_int), &modeArg);
+    checkStatus("clSetKernelArg-8", status, true, debug);
+    status = clSetKernelArg(renderKernel, 9, sizeof(cl_int), &threshold);
+    checkStatus("clSetKernelArg-9", status, true, debug);
+    status = clSetKernelArg(renderKernel, 10, sizeof(cl_uint), &minTransmittance);
+    checkStatus("clSetKernelArg-10", status, true, debug);
+    status = clSetKernelArg(renderKernel, 11, sizeof(cl_mem), &transfer);
+    checkStatus("clSetKernelArg-11", status, true, debug);
+    status = clSetKernelArg(renderKernel, 12, sizeof(cl_mem), &imgBuffer);
+    checkStatus("clSetKernelArg-12", status, true, debug);
+    status = clSetKernelArg(renderKernel, 13, sizeof(cl_mem), &renderBuffer);
+    checkStatus("clSetKernelArg-13", status, true, debug);
+
+    WorkSize ws = vMajor ? workSizeFor(renderKernel, outRows, outCols)
+                         : workSizeFor(renderKernel, outCols, outRows);
+    status = clEnqueueNDRangeKernel(cmdQueue, renderKernel, 2, nullptr, ws.global, ws.local,
+                                    0, nullptr, track(std::string("RenderKernel ") + renderModeName(mode),
+                                                      p.type, static_cast<size_t>(outCols) * outRows * p.depth));
+    checkStatus("clEnqueueNDRangeKernel-RenderKernel", status, true, debug);
+    status = clEnqueueReadBuffer(cmdQueue, renderBuffer, CL_FALSE, 0, imgBytes, img,
+                                 0, nullptr, track("read images", p.type, imgBytes));
+    checkStatus("clEnqueueReadBuffer-renderBuffer", status, true, debug);
+}
+
+/**
+ * The transfer function argument of a rendering with options; the transfer
+ * function is only copied to the device when it changes. Modes that do not
+ * use it get transferBuffer as it is.
+ */
+cl_mem ProjectionContext::loadTransfer(RenderMode mode, const RenderOptions& options)
+{
+    if (mode == RENDER_COMPOSITE && options.transfer != transferLoaded) {
+        cl_int status = clEnqueueWriteBuffer(cmdQueue, transferBuffer, CL_TRUE, 0, 4 * 256,
+                                             options.transfer.data(), 0, nullptr, nullptr);
+        checkStatus("clEnqueueWriteBuffer-transferBuffer", status, true, debug);
+        transferLoaded = options.transfer;
+    }
+    return transferBuffer;
+}
+
+bool ProjectionContext::obliqueUsesImage() const
+{
+    // The image holds 8 bit voxels as they are
+    if (!useImages || !imageFormatSupported || volumeImageFailed || obliqueImageKernel == nullptr ||
+        programFormat.windowed)
+        return false;
+    size_t maxWidth = 0, maxHeight = 0, maxDepth = 0;
+    clGetDeviceInfo(device, CL_DEVICE_IMAGE3D_MAX_WIDTH, sizeof(size_t), &maxWidth, nullptr);
+    clGetDeviceInfo(device, CL_DEVICE_IMAGE3D_MAX_HEIGHT, sizeof(size_t), &maxHeight, nullptr);
+    clGetDeviceInfo(device, CL_DEVICE_IMAGE3D_MAX_DEPTH, sizeof(size_t), &maxDepth, nullptr);
+    return static_cast<size_t>(volumeRows) <= maxWidth && static_cast<size_t>(volumeCols) <= maxHeight &&
+           static_cast<size_t>(volumeSheets) <= maxDepth;
+}
+
+// How far apart in memory the voxels of a step of an oblique view are
+static double stepDistance(const long* step, int rows, int cols)
+{
+    return std::abs(static_cast<double>(step[1])) + rows * std::abs(static_cast<double>(step[0])) +
+           static_cast<double>(rows) * cols * std::abs(static_cast<double>(step[2]));
+}
+
+/**
+ * Queue ObliqueKernel or ObliqueImageKernel for an oblique view in the given
+ * mode: -1 for the max and sums (into maxBuffer and workingBuffer), or a
+ * RenderMode (into renderBuffer)
+ */
+void ProjectionContext::enqueueObliqueKernel(const ObliqueView& view, int mode,
+                                             const RenderOptions& options)
+{
+    cl_int status;
+    cl_kernel kernel = obliqueKernel;
+    cl_mem volume = imgBuffer;
+    // The image is made from the volume's buffer the first time it is needed;
+    // if the device cannot make it, ObliqueKernel reads the buffer instead
+    if (obliqueUsesImage() && volumeImage == nullptr) {
+        cl_image_format format = { CL_R, CL_UNORM_INT8 };
+        cl_image_desc desc = {};
+        desc.image_type = CL_MEM_OBJECT_IMAGE3D;
+        desc.image_width = volumeRows;
+        desc.image_height = volumeCols;
+        desc.image_depth = volumeSheets;
+        volumeImage = clCreateImage(context, CL_MEM_READ_ONLY, &format, &desc, nullptr, &status);
+        checkStatus("clCreateImage-volumeImage", status, false, debug);
+        if (status != CL_SUCCESS) {
+            volumeImage = nullptr;
+            volumeImageFailed = true;
+        }
+        else {
+            size_t origin[3] = { 0, 0, 0 };
+            size_t region[3] = { desc.image_width, desc.image_height, desc.image_depth };
+            size_t bytes = region[0] * region[1] * region[2];
+            status = clEnqueueCopyBufferToImage(cmdQueue, imgBuffer, volumeImage, 0, origin, region,
+                                                0, nullptr, track("copy volume to image", 0, bytes));
+            checkStatus("clEnqueueCopyBufferToImage", status, true, debug);
+        }
+    }
+    if (obliqueUsesImage()) {
+        kernel = obliqueImageKernel;
+        volume = volumeImage;
+    }
+
+    size_t projSize = static_cast<size_t>(view.outRows) * view.outCols;
+    ensureBuffer(maxBuffer, maxCapacity, projSize * sizeof(unsigned char), "maxBuffer");
+    ensureBuffer(workingBuffer, workCapacity, projSize * sizeof(cl_ulong), "workingBuffer");
+    if (mode >= 0) {
+        ensureBuffer(renderBuffer, renderCapacity,
+                     projSize * renderChannels(static_cast<RenderMode>(mode)), "renderBuffer");
+    }
+    else {
+        // Not read, but it must be a buffer
+        ensureBuffer(renderBuffer, renderCapacity, 1, "renderBuffer");
+    }
+    // Max and sum views (mode -1) bind the transfer buffer without reading it
+    cl_mem transfer = (mode >= 0) ? loadTransfer(static_cast<RenderMode>(mode), options) : transferBuffer;
+
+    // ObliqueKernel args: the view (see Oblique.hpp), the mode, and the buffers
+    cl_int dims[6] = { view.outCols, view.outRows, view.depth, volumeRows, volumeCols, volumeSheets };
+    for (cl_uint i = 0; i < 6; i++) {
+        status = clSetKernelArg(kernel, i, sizeof(cl_int), &dims[i]);
+        checkStatus("clSetKernelArg-" + std::to_string(i), status, true, debug);
+    }
+    const long* vectors[4] = { view.origin, view.uStep, view.vStep, view.iStep };
+    for (cl_uint i = 0; i < 12; i++) {
+        cl_long value = vectors[i / 3][i % 3];
+        status = clSetKernelArg(kernel, 6 + i, sizeof(cl_long), &value);
+        checkStatus("clSetKernelArg-" + std::to_string(6 + i), status, true, debug);
+    }
+    cl_int vMajor = stepDistance(view.vStep, volumeRows, volumeCols) <
+                    stepDistance(view.uStep, volumeRows, volumeCols);
+    cl_int modeArg = mode;
+    cl_int threshold = options.threshold;
+    cl_uint minTransmittance = options.minTransmittance;
+    status = clSetKernelArg(kernel, 18, sizeof(cl_int), &vMajor);
+    checkStatus("clSetKernelArg-18", status, true, debug);
+    status = clSetKernelArg(kernel, 19, sizeof(cl_int), &modeArg);
+    checkStatus("clSetKernelArg-19", status, true, debug);
+    status = clSetKernelArg(kernel, 20, sizeof(cl_int), &threshold);
+    checkStatus("clSetKernelArg-20", status, true, debug);
+    status = clSetKernelArg(kernel, 21, sizeof(cl_uint), &minTransmittance);
+    checkStatus("clSetKernelArg-21", status, true, debug);
+    status = clSetKernelArg(kernel, 22, sizeof(cl_mem), &transfer);
+    checkStatus("clSetKernelArg-22", status, true, debug);
+    status = clSetKernelArg(kernel, 23, sizeof(cl_mem), &volume);
+    checkStatus("clSetKernelArg-23", status, true, debug);
+    status = clSetKernelArg(kernel, 24, sizeof(cl_mem), &maxBuffer);
+    checkStatus("clSetKernelArg-24", status, true, debug);
+    status = clSetKernelArg(kernel, 25, sizeof(cl_mem), &workingBuffer);
+    checkStatus("clSetKernelArg-25", status, true, debug);
+    status = clSetKernelArg(kernel, 28, sizeof(cl_mem), &renderBuffer);
+    checkStatus("clSetKernelArg-28", status, true, debug);
+
+    WorkSize ws = vMajor ? workSizeFor(kernel, view.outRows, view.outCols)
+                         : workSizeFor(kernel, view.outCols, view.outRows);
+    prepareMaxKernel(kernel, ws);
+
+    std::string name = (kernel == obliqueKernel) ? "ObliqueKernel" : "ObliqueImageKernel";
+    if (mode >= 0)
+        name += std::string(" ") + renderModeName(static_cast<RenderMode>(mode));
+    status = clEnqueueNDRangeKernel(cmdQueue, kernel, 2, nullptr, ws.global, ws.local, 0, nullptr,
+                                    track(name, 0, projSize * view.depth));
+    checkStatus("clEnqueueNDRangeKernel-" + name, status, true, debug);
+}
+
+void ProjectionContext::enqueueOblique(const ObliqueView& view, unsigned char* maxImg,
+                                       unsigned char* sumImg, uint64_t* maxSum, uint64_t* workSum)
+{
+    RenderOptions none = { 0, 0, TransferFunction() };
+    enqueueObliqueKernel(view, -1, none);
+
+    // The rest is as for an axis aligned projection of the same size
+    Projection p = { 0, view.outRows, view.outCols, view.depth, 0, 0, 0, 0 };
+    ProjectionOutput out = { maxImg, sumImg, maxSum, workSum };
+    enqueueResults(p, maxBuffer, workingBuffer, false, out);
+}
+
+void ProjectionContext::enqueueObliqueRender(const ObliqueView& view, RenderMode mode,
+                                             const RenderOptions& options, unsigned char* img)
+{
+    enqueueObliqueKernel(view, mode, options);
+    size_t imgBytes = static_cast<size_t>(view.outRows) * view.outCols * renderChannels(mode);
+    cl_int status = clEnqueueReadBuffer(cmdQueue, renderBuffer, CL_FALSE, 0, imgBytes, img,
+                                        0, nullptr, track("read images", 0, imgBytes));
+    checkStatus("clEnqueueReadBuffer-renderBuffer", status, true, debug);
+}
+
+void ProjectionContext::projectFrames(const std::vector<ObliqueView>& views,
+                                      const std::vector<ProjectionOutput>& outputs,
+                                      const std::vector<RenderMode>& modes,
+                                      const RenderOptions& options)
+{
+    for (size_t f = 0; f < views.size(); f++) {
+        const ProjectionOutput& out = outputs[f];
+        enqueueOblique(views[f], out.maxImg, out.sumImg, out.maxSum, out.workSum);
+        for (size_t k = 0; k < modes.size(); k++)
+            enqueueObliqueRender(views[f], modes[k], options, out.renders[k]);
+    }
+    finish();
+}
+
+size_t ProjectionContext::getMaxAllocSize() const
+{
+    cl_ulong size = 0;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(size), &size, nullptr);
+    return static_cast<size_t>(size);
+}
+
+int ProjectionContext::chooseSlabSheets(int rows, int cols, VoxelType type) const
+{
+    // Slabs of about 64 MB keep the transfers efficient; four of them (two
+    // on the device and two staging buffers) must fit comfortably
+    size_t sheetBytes = static_cast<size_t>(rows) * cols * voxelBytes(type);
+    size_t slabBytes = std::min<size_t>(64 << 20, getMaxAllocSize() / 4);
+    return static_cast<int>(std::max<size_t>(1, slabBytes / sheetBytes));
+}
+
+void ProjectionContext::projectStreamed(std::istream& in, int rows, int cols, int sheets,
+                                        int slabSheets, const std::vector<Projection>& projections,
+                                        const std::vector<ProjectionOutput>& outputs,
+                                        const VoxelFormat& format)
+{
+    useFormat(format);
+    size_t sheetBytes = static_cast<size_t>(rows) * cols * voxelBytes(format.type);
+    size_t slabBytes = sheetBytes * std::min(slabSheets, sheets);
+    cl_int status;
+
+    // Timing launches would add to the running sums of the slabs
+    bool wasTuning = tune;
+    tune = false;
+
+    // Two slabs on the device, each filled from its own pinned (host
+    // allocated, mapped) staging buffer, so that one slab is read from the
+    // file and copied while the kernels work on the other
+    cl_mem slabBuffer[2], stagingBuffer[2];
+    unsigned char* staging[2];
+    cl_event uploaded[2] = { nullptr, nullptr };
+    cl_event computed[2] = { nullptr, nullptr };
+    for (int b = 0; b < 2; b++) {
+        slabBuffer[b] = clCreateBuffer(context, CL_MEM_READ_ONLY, slabBytes, nullptr, &status);
+        checkStatus("clCreateBuffer-slabBuffer", status, true, debug);
+        stagingBuffer[b] = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                          slabBytes, nullptr, &status);
+        checkStatus("clCreateBuffer-stagingBuffer", status, true, debug);
+        staging[b] = static_cast<unsigned char*>(clEnqueueMapBuffer(
+            transferQueue, stagingBuffer[b], CL_TRUE, CL_MAP_WRITE, 0, slabBytes,
+            0, nullptr, nullptr, &status));
+        checkStatus("clEnqueueMapBuffer-stagingBuffer", status, true, debug);
+    }
+
+    // Each projection accumulates in its own buffers until the last slab
+    std::vector<cl_mem> maxBufs, workBufs;
+    for (const auto& p : projections) {
+        size_t projSize = static_cast<size_t>(p.outRows) * p.outCols;
+        maxBufs.push_back(clCreateBuffer(context, CL_MEM_READ_WRITE, projSize, nullptr, &status));
+        checkStatus("clCreateBuffer-maxBuffer", status, true, debug);
+        workBufs.push_back(clCreateBuffer(context, CL_MEM_READ_WRITE, projSize * sizeof(cl_ulong),
+                                          nullptr, &status));
+        checkStatus("clCreateBuffer-workingBuffer", status, true, debug);
+    }
+
+    int slab = 0;
+    for (int z0 = 0; z0 < sheets; z0 += slabSheets, slab++) {
+        int z1 = std::min(sheets, z0 + slabSheets);
+        int b = slab % 2;
+        size_t bytes = sheetBytes * (z1 - z0);
+
+        // The staging buffer is free once its last copy has finished
+        if (uploaded[b] != nullptr) {
+            clWaitForEvents(1, &uploaded[b]);
+            clReleaseEvent(uploaded[b]);
+        }
+        auto start = std::chrono::steady_clock::now();
+        in.read(reinterpret_cast<char*>(staging[b]), bytes);
+        if (static_cast<size_t>(in.gcount()) != bytes) {
+            std::cerr << "File is smaller than " << rows << " x " << cols
+                      << " x " << sheets << " voxels\n";
+            exit(1);
+        }
+        if (profiler != nullptr) {
+            profiler->addHost("read file", std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count(), bytes);
+        }
+
+        // The slab buffer is free once the kernels of two slabs ago have finished
+        status = clEnqueueWriteBuffer(transferQueue, slabBuffer[b], CL_FALSE, 0, bytes, staging[b],
+                                      computed[b] != nullptr ? 1 : 0,
+                                      computed[b] != nullptr ? &computed[b] : nullptr, &uploaded[b]);
+        checkStatus("clEnqueueWriteBuffer-slabBuffer", status, true, debug);
+        if (profiler != nullptr)
+            profiler->addEvent("write slab", uploaded[b], 0, bytes, profileDevice);
+        clFlush(transferQueue);
+
+        for (size_t j = 0; j < projections.size(); j++) {
+            Slab s;
+            makeSlab(projections[j], rows, cols, sheets, z0, z1, s);
+            cl_event done;
+            enqueueSlab(s, slabBuffer[b], maxBufs[j], workBufs[j],
+                        j == 0 ? uploaded[b] : nullptr, &done);
+            if (computed[b] != nullptr)
+                clReleaseEvent(computed[b]);
+            computed[b] = done;
+        }
+        clFlush(cmdQueue);
+    }
+
+    for (size_t j = 0; j < projections.size(); j++)
+        enqueueResults(projections[j], maxBufs[j], workBufs[j], true, outputs[j]);
+    finish();
+
+    for (int b = 0; b < 2; b++) {
+        clEnqueueUnmapMemObject(transferQueue, stagingBuffer[b], staging[b], 0, nullptr, nullptr);
+        if (uploaded[b] != nullptr)
+            clReleaseEvent(uploaded[b]);
+        if (computed[b] != nullptr)
+            clReleaseEvent(computed[b]);
+    }
+    status = clFinish(transferQueue);
+    checkStatus("clFinish-transferQueue", status, true, debug);
+    for (int b = 0; b < 2; b++) {
+        clReleaseMemObject(slabBuffer[b]);
+        clReleaseMemObject(stagingBuffer[b]);
+    }
+    for (size_t j = 0; j < projections.size(); j++) {
+        clReleaseMemObject(maxBufs[j]);
+        clReleaseMemObject(workBufs[j]);
+    }
+    tune = wasTuning;
+}
@@ -0,0 +1,223 @@
+#ifndef EECS690_PROJECTIONCONTEXT_HPP
+#define EECS690_PROJECTIONCONTEXT_HPP
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#ifdef __APPLE__
+    #include <OpenCL/opencl.h>
+
+#else
+    #include <CL/opencl.h>
+#endif
+
+#include "Oblique.hpp"
+#include "Profiler.hpp"
+#include "Projection.hpp"
+#include "Render.hpp"
+#include "Voxel.hpp"
+#include "WorkSize.hpp"
+
+/**
+ * Where the results of one projection are written (workSum may be null). For
+ * projectFrames, renders holds an image for each render mode.
+ */
+struct ProjectionOutput
+{
+    unsigned char* maxImg;
+    unsigned char* sumImg;
+    uint64_t* maxSum;
+    uint64_t* workSum;
+    std::vector<unsigned char*> renders;
+};
+
+/**
+ * Everything needed to compute projections on one OpenCL device: the
+ * context, queue, built kernels, and the device buffers. It is set up once,
+ * and then any number of projections of any number of volumes can be
+ * computed with it.
+ *
+ * MaxKernel or MaxRaysKernel is chosen for each projection so that
+ * neighbouring work items read neighbouring voxels.
+ *
+ * Oblique views (see Oblique.hpp) are sampled from a 3D image, through the
+ * texture units, on devices that support images (unless setUseImages(false)),
+ * and otherwise from the volume's buffer.
+ *
+ * The program (MaxKernel.cl, SumKernel.cl, RenderKernel.cl and
+ * ObliqueKernel.cl) is built only for the chosen device. The binary is saved in the clcache directory under a hash of the
+ * device, its driver, and the kernel sources, so later runs skip compiling.
+ * Volumes of other voxel types (see Voxel.hpp) have their own builds of the
+ * program, which window each voxel as they read it.
+ */
+class ProjectionContext
+{
+public:
+    /**
+     * @param deviceSpec the device to use: an index into allDevices(), or
+     *        part of its name. If empty, the PROJ3_DEVICE environment variable
+     *        is used; if that is not set either, the first GPU (or else the
+     *        first device) is used.
+     * @param tune time each work group size (see tuneWorkSize) on first use
+     * @param debug report the status of every OpenCL call
+     * @param profiler if not null, every command is timed and added to it
+     */
+    explicit ProjectionContext(const std::string& deviceSpec = "", bool tune = false,
+                               bool debug = false, Profiler* profiler = nullptr);
+    ~ProjectionContext();
+
+    /** Every device of every platform, in the order used by deviceSpec */
+    static std::vector<cl_device_id> allDevices();
+
+    cl_device_id getDevice() const { return device; }
+    std::string getDeviceName() const;
+
+    /**
+     * Copy a volume to the device; it replaces any previous volume. If
+     * inPlace, voxels stay valid and unchanged until the next setVolume (a
+     * mapped VolumeFile, say), and a device that shares host memory reads
+     * them where they are (CL_MEM_USE_HOST_PTR) instead of copying them.
+     * voxels holds the bytes of voxels of format.type.
+     */
+    void setVolume(int rows, int cols, int sheets, const unsigned char* voxels, bool inPlace = false,
+                   const VoxelFormat& format = VoxelFormat());
+
+    /**
+     * Compute projection p of the current volume. maxImg and sumImg (and
+     * workSum, if it is not null) hold p.outRows * p.outCols values.
+     * @return the largest weighted sum
+     */
+    uint64_t project(const Projection& p, unsigned char* maxImg, unsigned char* sumImg,
+                     uint64_t* workSum = nullptr);
+
+    /**
+     * Queue projection p of the current volume without waiting for it, so
+     * that several views of one volume are computed back to back. The
+     * results (as for project, with the largest sum in maxSum) may be used
+     * after finish(). If sumImg is null, the sums are only found, not
+     * normalized.
+     */
+    void enqueueProjection(const Projection& p, unsigned char* maxImg, unsigned char* sumImg,
+                           uint64_t* maxSum, uint64_t* workSum = nullptr);
+
+    /** Start the queued commands, so that other devices can be given work */
+    void flush();
+
+    /** Wait for every queued projection */
+    void finish();
+
+    /**
+     * Queue a rendering of projection p of the current volume (see
+     * Render.hpp); img holds p.outRows * p.outCols * renderChannels(mode)
+     * values and may be used after finish()
+     */
+    void enqueueRender(const Projection& p, RenderMode mode, const RenderOptions& options,
+                       unsigned char* img);
+
+    /**
+     * Queue the max and weighted sum projections along an oblique view of the
+     * current volume, as enqueueProjection does; the images hold
+     * view.outRows * view.outCols values
+     */
+    void enqueueOblique(const ObliqueView& view, unsigned char* maxImg, unsigned char* sumImg,
+                        uint64_t* maxSum, uint64_t* workSum = nullptr);
+
+    /** Queue a rendering of an oblique view of the current volume, as enqueueRender does */
+    void enqueueObliqueRender(const ObliqueView& view, RenderMode mode, const RenderOptions& options,
+                              unsigned char* img);
+
+    /**
+     * Compute a sequence of views of the current volume, such as a turntable
+     * (see turntableViews), and render each with modes, in one call: the
+     * volume stays on the device and every frame is queued before waiting
+     * for any of them
+     */
+    void projectFrames(const std::vector<ObliqueView>& views,
+                       const std::vector<ProjectionOutput>& outputs,
+                       const std::vector<RenderMode>& modes = std::vector<RenderMode>(),
+                       const RenderOptions& options = RenderOptions());
+
+    /**
+     * Whether oblique views are sampled from a 3D image (faster, but rounded
+     * slightly differently from CPUProjector) when the device supports them
+     */
+    void setUseImages(bool use) { useImages = use; }
+
+    /** Whether oblique views of the current volume are sampled from a 3D image */
+    bool obliqueUsesImage() const;
+
+    /**
+     * Compute the projections of a rows x cols x sheets volume read from in,
+     * slabSheets sheets at a time, without holding the whole volume in host
+     * or device memory. Reading a slab from the file and copying it to the
+     * device overlap the kernels working on the previous slab. The voxels
+     * are of format.type.
+     */
+    void projectStreamed(std::istream& in, int rows, int cols, int sheets, int slabSheets,
+                         const std::vector<Projection>& projections,
+                         const std::vector<ProjectionOutput>& outputs,
+                         const VoxelFormat& format = VoxelFormat());
+
+    /** The largest buffer the device can allocate */
+    size_t getMaxAllocSize() const;
+
+    /** A slab size for projectStreamed */
+    int chooseSlabSheets(int rows, int cols, VoxelType type = VOXEL_U8) const;
+
+private:
+    ProjectionContext(const ProjectionContext&); // cannot be copied
+    ProjectionContext& operator=(const ProjectionContext&);
+
+    void buildProgram();
+    void createKernels();
+    void releaseKernels();
+    void setWindowArgs();
+    void useFormat(const VoxelFormat& format);
+    cl_event* track(const std::string& stage, int projection = 0, size_t bytes = 0);
+    void ensureBuffer(cl_mem& buffer, size_t& capacity, size_t bytes, const char* name);
+    size_t localBytesPerItem(cl_kernel kernel) const;
+    WorkSize workSizeFor(cl_kernel kernel, int cols, int rows);
+    void prepareMaxKernel(cl_kernel kernel, const WorkSize& ws);
+    void enqueueSlab(const Slab& s, cl_mem img, cl_mem maxBuf, cl_mem workBuf,
+                     cl_event waitEvent, cl_event* done);
+    void enqueueResults(const Projection& p, cl_mem maxBuf, cl_mem workBuf, bool reduceSums,
+                        const ProjectionOutput& out);
+    cl_mem loadTransfer(RenderMode mode, const RenderOptions& options);
+    void enqueueObliqueKernel(const ObliqueView& view, int mode, const RenderOptions& options);
+
+    bool tune, debug;
+    Profiler* profiler;
+    int profileDevice; // this device's number in profiler
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue cmdQueue, transferQueue;
+    cl_program program;
+    cl_kernel maxKernel, maxRaysKernel, reduceMaxKernel, sumKernel, renderKernel;
+    cl_kernel obliqueKernel, obliqueImageKernel; // obliqueImageKernel needs image support
+    size_t reduceSize;
+    bool useImages;
+    bool imageFormatSupported; // the device can make ObliqueImageKernel's 3D images
+    VoxelFormat programFormat; // of the current volume, which the program is built for
+
+    // The current volume
+    int volumeRows, volumeCols, volumeSheets;
+    cl_mem volumeImage; // a copy of imgBuffer, made for the first oblique view
+    bool volumeImageFailed; // clCreateImage failed for the current volume
+
+    // Device buffers, grown as needed
+    cl_mem imgBuffer, maxBuffer, sumBuffer, workingBuffer, groupMaxBuffer, maxSumBuffer;
+    cl_mem renderBuffer, transferBuffer;
+    size_t imgCapacity, maxCapacity, sumCapacity, workCapacity, groupMaxCapacity, renderCapacity;
+    TransferFunction transferLoaded; // the contents of transferBuffer
+
+    // Work sizes are chosen once per kernel and NDRange size
+    std::map<std::tuple<cl_kernel, int, int>, WorkSize> workSizes;
+    std::set<cl_kernel> tuned;
+};
+
+#endif //EECS690_PROJECTIONCONTEXT_HPP
@@ -0,0 +1,144 @@
+#include <sys/stat.h>
+
+#include "Pyramid.hpp"
+#include "VolumeFile.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+const char* downsampleModeName(DownsampleMode mode)
+{
+    return mode == DOWNSAMPLE_MAX ? "max" : "mean";
+}
+
+bool parseDownsampleMode(const std::string& name, DownsampleMode& mode)
+{
+    if (name == "max")
+        mode = DOWNSAMPLE_MAX;
+    else if (name == "mean")
+        mode = DOWNSAMPLE_MEAN;
+    else
+        return false;
+    return true;
+}
+
+void halveSheets(int rows, int cols, int count, const unsigned char* sheets, DownsampleMode mode,
+                 unsigned char* out)
+{
+    int outRows = (rows + 1) / 2, outCols = (cols + 1) / 2;
+    size_t sheetSize = static_cast<size_t>(rows) * cols;
+    for (int x = 0; x < outCols; x++) {
+        int xCount = std::min(2, cols - 2 * x);
+        for (int y = 0; y < outRows; y++) {
+            int yCount = std::min(2, rows - 2 * y);
+            unsigned int maxVal = 0, sum = 0;
+            for (int dz = 0; dz < count; dz++) {
+                for (int dx = 0; dx < xCount; dx++) {
+                    const unsigned char* column = sheets + dz * sheetSize +
+                                                  static_cast<size_t>(rows) * (2 * x + dx) + 2 * y;
+                    for (int dy = 0; dy < yCount; dy++) {
+                        maxVal = std::max<unsigned int>(maxVal, column[dy]);
+                        sum += column[dy];
+                    }
+                }
+            }
+            unsigned int n = count * xCount * yCount;
+            out[y + static_cast<size_t>(outRows) * x] = static_cast<unsigned char>(
+                mode == DOWNSAMPLE_MAX ? maxVal : (sum + n / 2) / n);
+        }
+    }
+}
+
+// Halve the rows x cols x sheets voxels into half
+static void halve(int rows, int cols, int sheets, const unsigned char* voxels, DownsampleMode mode,
+                  VolumeLevel& half)
+{
+    half.rows = (rows + 1) / 2;
+    half.cols = (cols + 1) / 2;
+    half.sheets = (sheets + 1) / 2;
+    size_t sheetSize = static_cast<size_t>(rows) * cols;
+    size_t halfSheetSize = static_cast<size_t>(half.rows) * half.cols;
+    half.voxels.resize(halfSheetSize * half.sheets);
+    for (int z = 0; z < half.sheets; z++) {
+        halveSheets(rows, cols, std::min(2, sheets - 2 * z), voxels + 2 * z * sheetSize, mode,
+                    half.voxels.data() + z * halfSheetSize);
+    }
+}
+
+VolumeLevel halveVolume(const VolumeLevel& volume, DownsampleMode mode)
+{
+    VolumeLevel half;
+    halve(volume.rows, volume.cols, volume.sheets, volume.voxels.data(), mode, half);
+    return half;
+}
+
+std::string pyramidFileName(const std::string& volumeFile, int level, DownsampleMode mode)
+{
+    return volumeFile + ".mip" + std::to_string(level) + downsampleModeName(mode);
+}
+
+// The first line of a saved level: the level, and the volume file it was made from
+static std::string levelHeader(const struct stat& info, int rows, int cols, int sheets,
+                               int level, DownsampleMode mode)
+{
+    std::ostringstream header;
+    header << "Proj3 pyramid level " << level << ' ' << downsampleModeName(mode)
+           << " of " << rows << ' ' << cols << ' ' << sheets << ' '
+           << info.st_size << ' ' << info.st_mtime;
+    return header.str();
+}
+
+static bool readLevel(const std::string& fileName, const std::string& header, VolumeLevel& out)
+{
+    std::ifstream in(fileName, std::ios::binary);
+    std::string line;
+    if (!std::getline(in, line) || line != header)
+        return false;
+    if (!(in >> out.rows >> out.cols >> out.sheets) || in.get() != '\n')
+        return false;
+    out.voxels.resize(static_cast<size_t>(out.rows) * out.cols * out.sheets);
+    in.read(reinterpret_cast<char*>(out.voxels.data()), out.voxels.size());
+    return static_cast<size_t>(in.gcount()) == out.voxels.size();
+}
+
+static void saveLevel(const std::string& fileName, const std::string& header, const VolumeLevel& level)
+{
+    std::ofstream out(fileName, std::ios::binary);
+    out << header << '\n' << level.rows << ' ' << level.cols << ' ' << level.sheets << '\n';
+    out.write(reinterpret_cast<const char*>(level.voxels.data()), level.voxels.size());
+    if (!out)
+        std::cerr << "Could not save the pyramid level in " << fileName << '\n';
+}
+
+bool loadPyramidLevel(const std::string& volumeFile, int rows, int cols, int sheets, int level,
+                      DownsampleMode mode, VolumeLevel& out)
+{
+    struct stat info;
+    if (stat(volumeFile.c_str(), &info) != 0) {
+        std::cerr << "Could not read " << volumeFile << '\n';
+        return false;
+    }
+    std::string fileName = pyramidFileName(volumeFile, level, mode);
+    std::string header = levelHeader(info, rows, cols, sheets, level, mode);
+    if (readLevel(fileName, header, out))
+        return true;
+
+    if (level == 1) {
+        VolumeFile volume;
+        if (!volume.open(volumeFile, rows, cols, sheets) || !volume.load())
+            return false;
+        halve(rows, cols, sheets, volume.getVoxels(), mode, out);
+    }
+    else {
+        VolumeLevel below;
+        if (!loadPyramidLevel(volumeFile, rows, cols, sheets, level - 1, mode, below))
+            return false;
+        out = halveVolume(below, mode);
+    }
+    std::cout << "Built pyramid level " << level << " (" << out.rows << " x " << out.cols
+              << " x " << out.sheets << ") in " << fileName << '\n';
+    saveLevel(fileName, header, out);
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef EECS690_PYRAMID_HPP
+#define EECS690_PYRAMID_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * A mip pyramid of a volume for fast previews: level n halves the rows,
+ * cols and sheets of level n - 1 (rounding up), so level 3 has 1/512 of the
+ * voxels. Each voxel of a level is the max or the mean of the 2 x 2 x 2
+ * block below it; max keeps the max projection's bright features, mean is
+ * the better preview of the sums and renderings.
+ *
+ * Levels are saved next to the volume file (see pyramidFileName) and reused
+ * until the volume file changes.
+ */
+enum DownsampleMode
+{
+    DOWNSAMPLE_MAX,
+    DOWNSAMPLE_MEAN
+};
+
+/** A volume held in memory; voxel (y, x, z) is at y + rows * (x + cols * z) */
+struct VolumeLevel
+{
+    int rows, cols, sheets;
+    std::vector<unsigned char> voxels;
+};
+
+const char* downsampleModeName(DownsampleMode mode);
+
+/** Parse "max" or "mean" */
+bool parseDownsampleMode(const std::string& name, DownsampleMode& mode);
+
+/**
+ * Halve count (1 or 2, at the last sheet of an odd volume) sheets of rows x
+ * cols voxels into one sheet of (rows + 1) / 2 x (cols + 1) / 2 voxels. Blocks
+ * at the edges of the volume only combine the voxels within it.
+ */
+void halveSheets(int rows, int cols, int count, const unsigned char* sheets, DownsampleMode mode,
+                 unsigned char* out);
+
+/** The next level of the pyramid above volume */
+VolumeLevel halveVolume(const VolumeLevel& volume, DownsampleMode mode);
+
+/** Where a level of the pyramid of volumeFile is saved: volumeFile.mip<level><mode> */
+std::string pyramidFileName(const std::string& volumeFile, int level, DownsampleMode mode);
+
+/**
+ * Level level (1 or more) of the pyramid of the rows x cols x sheets
+ * volumeFile (raw, or a VolumeFile): read from its file if that was made
+ * from the volume file as it is now, else built from the level below and
+ * saved, as is every level below it. Level 1 is built from the mapped volume
+ * file, whose pages are read as they are halved.
+ * @return false (with a message) if the volume file cannot be read
+ */
+bool loadPyramidLevel(const std::string& volumeFile, int rows, int cols, int sheets, int level,
+                      DownsampleMode mode, VolumeLevel& out);
+
+#endif //EECS690_PYRAMID_HPP
@@ -0,0 +1,136 @@
+#ifndef EECS690_RENDER_HPP
+#define EECS690_RENDER_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Renderings of a volume along the rays of a projection (see Projection.hpp),
+ * computed by CPUProjector::render and RenderKernel:
+ *
+ *   min        the smallest voxel on the ray (minimum intensity projection)
+ *   mean       the mean of the voxels on the ray, rounded to nearest
+ *   firsthit   a depth map: 255 * (depth - i) / depth for the first sample i
+ *              at or above the threshold, or 0 if there is none
+ *   composite  front to back alpha compositing of the voxels' colors from a
+ *              transfer function, over black, stopping once the ray is
+ *              nearly opaque
+ *
+ * Compositing is done in fixed point, so that every device gets exactly the
+ * CPU's image: the transmittance T starts at 1 << 16, each sample with
+ * opacity a (0-255) adds w = (T * a + 127) / 255 of its color and takes w
+ * from T, and a channel's value is (sum of w * color + 32768) >> 16.
+ */
+enum RenderMode
+{
+    RENDER_MIN = 0,
+    RENDER_MEAN = 1,
+    RENDER_FIRST_HIT = 2,
+    RENDER_COMPOSITE = 3
+};
+
+/** 256 RGBA colors, one for each voxel value */
+typedef std::vector<unsigned char> TransferFunction;
+
+const unsigned int FULL_TRANSMITTANCE = 1u << 16;
+
+struct RenderOptions
+{
+    int threshold;                  // firsthit; and where the default opacity starts
+    unsigned int minTransmittance;  // composite stops when T falls below this
+    TransferFunction transfer;      // composite
+};
+
+inline const char* renderModeName(RenderMode mode)
+{
+    static const char* names[] = { "Min", "Mean", "FirstHit", "Composite" };
+    return names[mode];
+}
+
+inline int renderChannels(RenderMode mode)
+{
+    return mode == RENDER_COMPOSITE ? 3 : 1;
+}
+
+/**
+ * Parse a comma separated list of modes such as "min,composite"
+ * @return false if one is unknown
+ */
+inline bool parseRenderModes(const std::string& arg, std::vector<RenderMode>& modes)
+{
+    std::istringstream list(arg);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item == "min")
+            modes.push_back(RENDER_MIN);
+        else if (item == "mean")
+            modes.push_back(RENDER_MEAN);
+        else if (item == "firsthit")
+            modes.push_back(RENDER_FIRST_HIT);
+        else if (item == "composite")
+            modes.push_back(RENDER_COMPOSITE);
+        else
+            return false;
+    }
+    return !modes.empty();
+}
+
+/**
+ * Gray voxels, transparent below threshold and increasingly opaque above it
+ * (up to an opacity of 1/4, so that the inside of a structure still shows)
+ */
+inline TransferFunction defaultTransferFunction(int threshold)
+{
+    TransferFunction tf(4 * 256);
+    for (int v = 0; v < 256; v++) {
+        tf[4 * v] = tf[4 * v + 1] = tf[4 * v + 2] = static_cast<unsigned char>(v);
+        tf[4 * v + 3] = (v < threshold) ? 0 : static_cast<unsigned char>(
+            1 + (v - threshold) * 63 / std::max(1, 255 - threshold));
+    }
+    return tf;
+}
+
+/**
+ * Read a transfer function from a text file of control points, one per
+ * line: value red green blue opacity, each 0-255, in increasing order of
+ * value. Colors between control points are interpolated linearly; below the
+ * first and above the last they are those of the first and last.
+ * @return false if the file cannot be read or has no control points
+ */
+inline bool loadTransferFunction(const std::string& fileName, TransferFunction& tf)
+{
+    std::ifstream in(fileName);
+    std::vector<int> points; // value, r, g, b, a for each control point
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        int p[5];
+        if (line.empty() || line[0] == '#' ||
+            !(fields >> p[0] >> p[1] >> p[2] >> p[3] >> p[4]))
+            continue;
+        points.insert(points.end(), p, p + 5);
+    }
+    if (points.empty())
+        return false;
+
+    tf.assign(4 * 256, 0);
+    size_t n = points.size() / 5;
+    for (int v = 0; v < 256; v++) {
+        size_t k = 0;
+        while (k + 1 < n && points[5 * (k + 1)] <= v)
+            k++;
+        const int* a = &points[5 * k];
+        const int* b = (k + 1 < n && v > a[0]) ? &points[5 * (k + 1)] : a;
+        int span = b[0] - a[0];
+        for (int c = 0; c < 4; c++) {
+            int value = (span > 0) ? a[c + 1] + (b[c + 1] - a[c + 1]) * (v - a[0]) / span : a[c + 1];
+            tf[4 * v + c] = static_cast<unsigned char>(std::min(255, std::max(0, value)));
+        }
+    }
+    return true;
+}
+
+#endif //EECS690_RENDER_HPP
@@ -0,0 +1,111 @@
+/*
+    Renders the ray through pixel (u, v) of a projection (see MaxKernel.cl for
+    the geometry and vMajor) with one of the modes of Render.hpp:
+
+        0  min        the smallest voxel
+        1  mean       the mean voxel, rounded to nearest
+        2  firsthit   255 * (depth - i) / depth for the first sample i at or
+                      above threshold, else 0
+        3  composite  front to back alpha compositing of the RGBA colors in
+                      transfer (256 of them), over black, in 16 bit fixed
+                      point; the ray stops once its transmittance falls below
+                      minTransmittance
+
+    out holds 1 value per pixel, or 3 (RGB) for composite. The arithmetic is
+    the same as CPUProjector::render, so the images are identical. The
+    RenderState functions are also used by ObliqueKernel.cl.
+*/
+
+// Running state of the rendering of one ray; see beginRender
+typedef struct
+{
+    uint m;          // min
+    ulong s;         // mean
+    int found;       // firsthit
+    uint hit;
+    uint T, r, g, b; // composite
+} RenderState;
+
+void beginRender(RenderState* st)
+{
+    st->m = 255;
+    st->s = 0;
+    st->found = 0;
+    st->hit = 0;
+    st->T = 1u << 16;
+    st->r = st->g = st->b = 0;
+}
+
+// Whether the ray still needs samples
+bool renderWants(const RenderState* st, int mode, uint minTransmittance)
+{
+    if (mode == 2)
+        return !st->found;
+    return mode != 3 || st->T >= minTransmittance;
+}
+
+// Add sample i (of depth) of the ray, whose value is val
+void renderSample(RenderState* st, int mode, int i, int depth, uint val,
+                  int threshold, __constant unsigned char* transfer)
+{
+    if (mode == 0) {
+        st->m = min(st->m, val);
+    }
+    else if (mode == 1) {
+        st->s += val;
+    }
+    else if (mode == 2) {
+        if ((int)val >= threshold) {
+            st->found = 1;
+            st->hit = 255 * (depth - i) / depth;
+        }
+    }
+    else {
+        __constant const unsigned char* rgba = transfer + 4 * val;
+        uint w = (st->T * rgba[3] + 127) / 255;
+        st->r += w * rgba[0];
+        st->g += w * rgba[1];
+        st->b += w * rgba[2];
+        st->T -= w;
+    }
+}
+
+// Store the pixel of a ray that had count samples
+void storeRender(const RenderState* st, int mode, int count, long ndx, __global unsigned char* out)
+{
+    if (mode == 0) {
+        out[ndx] = (count > 0) ? (unsigned char)st->m : 0;
+    }
+    else if (mode == 1) {
+        out[ndx] = (count > 0) ? (unsigned char)((2 * st->s + count) / (2 * count)) : 0;
+    }
+    else if (mode == 2) {
+        out[ndx] = (unsigned char)st->hit;
+    }
+    else {
+        out[3 * ndx] = (unsigned char)((st->r + 32768) >> 16);
+        out[3 * ndx + 1] = (unsigned char)((st->g + 32768) >> 16);
+        out[3 * ndx + 2] = (unsigned char)((st->b + 32768) >> 16);
+    }
+}
+
+__kernel
+void RenderKernel(int outCols, int outRows, int depth,
+                  long origin, long uStride, long vStride, long iStride, int vMajor,
+                  int mode, int threshold, uint minTransmittance, __constant unsigned char* transfer,
+                  __global const VOXEL* img, __global unsigned char* out, float windowLow, float windowScale)
+{
+    int u = get_global_id(vMajor ? 1 : 0);
+    int v = get_global_id(vMajor ? 0 : 1);
+    if (u >= outCols || v >= outRows)
+        return;
+
+    __global const VOXEL* ray = img + (origin + u * uStride + v * vStride);
+
+    RenderState st;
+    beginRender(&st);
+    for (int i = 0; i < depth && renderWants(&st, mode, minTransmittance); i++)
+        renderSample(&st, mode, i, depth, voxelValue(ray[i * iStride], windowLow, windowScale),
+                     threshold, transfer);
+    storeRender(&st, mode, depth, (long)v * outCols + u, out);
+}
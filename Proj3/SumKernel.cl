@@ -1,11 +1,44 @@
 /*
-    Normalizes sum of index to max sum value found
+    Reduces the n per-group maxima written by MaxKernel to the largest sum,
+    in maxSum[0]. Runs as a single work group; scratch must hold one ulong
+    per work item.
 */
 __kernel
-void SumKernel(int cols, float maxSum, __global const float* workSum, __global unsigned char* sumArr)
+void ReduceMaxKernel(int n, __global const ulong* groupMaxArr, __global ulong* maxSum, __local ulong* scratch)
 {
-    int x = get_global_id(0);
-    int y = get_global_id(1);
-    int idx = cols * x + y;
-    sumArr[idx] = (unsigned char)round((workSum[idx] / maxSum) * 255.0);
+    uint lid = get_local_id(0);
+    uint size = get_local_size(0);
+    ulong m = 0;
+    for (uint i = lid; i < (uint)n; i += size)
+        m = max(m, groupMaxArr[i]);
+    scratch[lid] = m;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (uint active = size; active > 1; ) {
+        uint half = (active + 1) / 2;
+        if (lid < active - half)
+            scratch[lid] = max(scratch[lid], scratch[lid + half]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+        active = half;
+    }
+    if (lid == 0)
+        maxSum[0] = scratch[0];
+}
+
+/*
+    Normalizes sum of index to max sum value found, rounding to nearest
+    (the same arithmetic as normalizeSum in Projection.hpp)
+*/
+__kernel
+void SumKernel(int outCols, int outRows, __global const ulong* maxSum, __global const ulong* workSum, __global unsigned char* sumArr)
+{
+    int u = get_global_id(0);
+    int v = get_global_id(1);
+    if (u >= outCols || v >= outRows)
+        return;
+    long idx = (long)v * outCols + u;
+    ulong m = maxSum[0];
+    if (m == 0)
+        sumArr[idx] = 0;
+    else
+        sumArr[idx] = (unsigned char)((workSum[idx] * 510 + m) / (2 * m));
 }
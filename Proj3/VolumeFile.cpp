@@ -0,0 +1,237 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "VolumeFile.hpp"
+#include "Parallel.hpp"
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char VOLUME_MAGIC[8] = { 'P', 'R', 'O', 'J', '3', 'V', 'O', 'L' };
+
+// Bricks of about this size when none is given
+static const size_t DEFAULT_BRICK_BYTES = 4 << 20;
+
+VolumeFile::VolumeFile() :
+    fd(-1), rows(0), cols(0), sheets(0), type(VOXEL_U8), brickSheets(0), compression(VOLUME_UNCOMPRESSED),
+    dataOffset(0), fileBytes(0), voxels(nullptr), mapping(nullptr), mappingBytes(0)
+{
+}
+
+VolumeFile::~VolumeFile()
+{
+    if (mapping != nullptr)
+        munmap(mapping, mappingBytes);
+    if (fd >= 0)
+        close(fd);
+}
+
+bool VolumeFile::isVolumeFile(const std::string& fileName)
+{
+    char magic[sizeof(VOLUME_MAGIC)];
+    std::ifstream in(fileName, std::ios::binary);
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, VOLUME_MAGIC, sizeof(magic)) == 0;
+}
+
+// The type of voxels of a header's voxelBytes
+static bool headerVoxelType(uint32_t bytes, VoxelType& type)
+{
+    if (bytes == 1)
+        type = VOXEL_U8;
+    else if (bytes == 2)
+        type = VOXEL_U16;
+    else if (bytes == 4)
+        type = VOXEL_F32;
+    else
+        return false;
+    return true;
+}
+
+// Whether a header's dimensions fit the int members and its voxels a size_t
+static bool headerSizeFits(const VolumeHeader& header)
+{
+    if (header.rows > INT_MAX || header.cols > INT_MAX || header.sheets > INT_MAX ||
+        header.brickSheets > INT_MAX)
+        return false;
+    // rows * cols * voxelBytes < 2^64, so only the last product can overflow
+    size_t sheetBytes = static_cast<size_t>(header.rows) * header.cols * header.voxelBytes;
+    return header.sheets == 0 || sheetBytes <= SIZE_MAX / header.sheets;
+}
+
+bool VolumeFile::open(const std::string& fileName, int rows, int cols, int sheets, VoxelType type)
+{
+    this->fileName = fileName;
+    fd = ::open(fileName.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        std::cerr << "File did not open\n";
+        return false;
+    }
+    fileBytes = info.st_size;
+
+    VolumeHeader header;
+    if (fileBytes >= VOLUME_HEADER_BYTES && pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        std::memcmp(header.magic, VOLUME_MAGIC, sizeof(VOLUME_MAGIC)) == 0) {
+        if (header.version != 1 || !headerVoxelType(header.voxelBytes, this->type) || header.brickSheets == 0 ||
+            header.compression > VOLUME_ZLIB || header.rows == 0 || header.cols == 0 ||
+            header.sheets == 0 || !headerSizeFits(header)) {
+            std::cerr << fileName << " is a volume file this version cannot read\n";
+            return false;
+        }
+        if (rows > 0 && (static_cast<uint32_t>(rows) != header.rows ||
+                         static_cast<uint32_t>(cols) != header.cols ||
+                         static_cast<uint32_t>(sheets) != header.sheets)) {
+            std::cerr << fileName << " holds " << header.rows << " x " << header.cols << " x "
+                      << header.sheets << " voxels, not " << rows << " x " << cols << " x "
+                      << sheets << '\n';
+            return false;
+        }
+        this->rows = header.rows;
+        this->cols = header.cols;
+        this->sheets = header.sheets;
+        brickSheets = header.brickSheets;
+        compression = header.compression;
+        dataOffset = VOLUME_HEADER_BYTES;
+        if (!isCompressed() && fileBytes < dataOffset + getBytes()) {
+            std::cerr << fileName << " is shorter than its header says\n";
+            return false;
+        }
+        return true;
+    }
+
+    // A raw file
+    if (rows <= 0 || cols <= 0 || sheets <= 0) {
+        std::cerr << fileName << " is not a volume file, so its rows, cols and sheets are needed\n";
+        return false;
+    }
+    this->rows = rows;
+    this->cols = cols;
+    this->sheets = sheets;
+    this->type = type;
+    brickSheets = sheets;
+    if (fileBytes < getBytes()) {
+        std::cerr << "File is smaller than " << rows << " x " << cols << " x " << sheets << " voxels\n";
+        return false;
+    }
+    if (fileBytes > getBytes()) {
+        std::cout << fileName << " has " << fileBytes - getBytes() << " bytes more than " << rows
+                  << " x " << cols << " x " << sheets << " voxels; they are ignored\n";
+    }
+    return true;
+}
+
+bool VolumeFile::load(int numThreads)
+{
+    if (voxels != nullptr)
+        return true;
+
+    // Uncompressed voxels are used where they are mapped; compressed bricks
+    // are decompressed from the mapping
+    mappingBytes = isCompressed() ? fileBytes : dataOffset + getBytes();
+    mapping = mmap(nullptr, mappingBytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        std::cerr << "Could not map " << fileName << '\n';
+        return false;
+    }
+    const unsigned char* file = static_cast<const unsigned char*>(mapping);
+    if (!isCompressed()) {
+        madvise(mapping, mappingBytes, MADV_WILLNEED);
+        voxels = file + dataOffset;
+        return true;
+    }
+
+    int numBricks = (sheets + brickSheets - 1) / brickSheets;
+    size_t sheetBytes = static_cast<size_t>(rows) * cols * voxelBytes(type);
+    if (fileBytes < dataOffset + 2 * sizeof(uint64_t) * numBricks) {
+        std::cerr << fileName << " is damaged: its brick table is missing\n";
+        return false;
+    }
+    const uint64_t* table = reinterpret_cast<const uint64_t*>(file + dataOffset);
+    decompressed.resize(getBytes());
+    std::vector<char> damaged(numBricks, 0);
+    parallelFor(numBricks, threadCount(numThreads), [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            uint64_t offset = table[2 * b], size = table[2 * b + 1];
+            size_t z0 = static_cast<size_t>(b) * brickSheets;
+            uLongf bytes = sheetBytes * (std::min<size_t>(sheets, z0 + brickSheets) - z0);
+            uLongf expected = bytes;
+            damaged[b] = offset > fileBytes || size > fileBytes - offset ||
+                         uncompress(decompressed.data() + z0 * sheetBytes, &bytes, file + offset,
+                                    size) != Z_OK || bytes != expected;
+        }
+    });
+    munmap(mapping, mappingBytes);
+    mapping = nullptr;
+    for (int b = 0; b < numBricks; b++) {
+        if (damaged[b]) {
+            std::cerr << fileName << " is damaged: brick " << b << " does not decompress\n";
+            return false;
+        }
+    }
+    voxels = decompressed.data();
+    return true;
+}
+
+bool VolumeFile::write(const std::string& fileName, int rows, int cols, int sheets, VoxelType type,
+                       const unsigned char* voxels, int brickSheets, bool compress, int numThreads)
+{
+    size_t sheetBytes = static_cast<size_t>(rows) * cols * voxelBytes(type);
+    if (brickSheets <= 0)
+        brickSheets = static_cast<int>(std::max<size_t>(1, DEFAULT_BRICK_BYTES / sheetBytes));
+    brickSheets = std::min(brickSheets, sheets);
+    int numBricks = (sheets + brickSheets - 1) / brickSheets;
+
+    std::vector<char> header(VOLUME_HEADER_BYTES, 0);
+    VolumeHeader h;
+    std::memcpy(h.magic, VOLUME_MAGIC, sizeof(VOLUME_MAGIC));
+    h.version = 1;
+    h.rows = rows;
+    h.cols = cols;
+    h.sheets = sheets;
+    h.voxelBytes = static_cast<uint32_t>(voxelBytes(type));
+    h.brickSheets = brickSheets;
+    h.compression = compress ? VOLUME_ZLIB : VOLUME_UNCOMPRESSED;
+    std::memcpy(header.data(), &h, sizeof(h));
+
+    std::ofstream out(fileName, std::ios::binary);
+    out.write(header.data(), header.size());
+    if (!compress) {
+        out.write(reinterpret_cast<const char*>(voxels), sheetBytes * sheets);
+    }
+    else {
+        // Fast compression: the bricks are compressed once and read many times
+        std::vector<std::vector<unsigned char>> bricks(numBricks);
+        parallelFor(numBricks, threadCount(numThreads), [&](int begin, int end) {
+            for (int b = begin; b < end; b++) {
+                size_t z0 = static_cast<size_t>(b) * brickSheets;
+                uLong bytes = sheetBytes * (std::min<size_t>(sheets, z0 + brickSheets) - z0);
+                uLongf size = compressBound(bytes);
+                bricks[b].resize(size);
+                compress2(bricks[b].data(), &size, voxels + z0 * sheetBytes, bytes, Z_BEST_SPEED);
+                bricks[b].resize(size);
+            }
+        });
+        std::vector<uint64_t> table(2 * numBricks);
+        uint64_t offset = VOLUME_HEADER_BYTES + table.size() * sizeof(uint64_t);
+        for (int b = 0; b < numBricks; b++) {
+            table[2 * b] = offset;
+            table[2 * b + 1] = bricks[b].size();
+            offset += bricks[b].size();
+        }
+        out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(uint64_t));
+        for (const auto& brick : bricks)
+            out.write(reinterpret_cast<const char*>(brick.data()), brick.size());
+    }
+    if (!out) {
+        std::cerr << "Could not write " << fileName << '\n';
+        return false;
+    }
+    return true;
+}
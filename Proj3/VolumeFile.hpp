@@ -0,0 +1,113 @@
+#ifndef EECS690_VOLUMEFILE_HPP
+#define EECS690_VOLUMEFILE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Voxel.hpp"
+
+/**
+ * Proj3 volume files describe their own volume, so its size need not be
+ * given (and cannot be given wrong) on the command line. A file is
+ *
+ *     a header of VOLUME_HEADER_BYTES bytes (VolumeHeader, in the host's byte order)
+ *     for compressed files, a uint64_t offset and size for each brick
+ *     the voxels, in bricks of brickSheets sheets
+ *
+ * Uncompressed voxels start on a page boundary and are memory mapped and
+ * used in place. Compressed bricks (zlib) are decompressed in parallel.
+ */
+const size_t VOLUME_HEADER_BYTES = 4096;
+
+enum VolumeCompression
+{
+    VOLUME_UNCOMPRESSED = 0,
+    VOLUME_ZLIB = 1
+};
+
+struct VolumeHeader
+{
+    char magic[8];        // "PROJ3VOL"
+    uint32_t version;     // 1
+    uint32_t rows, cols, sheets;
+    uint32_t voxelBytes;  // 1, 2 or 4: unsigned char, unsigned short or float voxels
+    uint32_t brickSheets; // sheets in each brick, the last may have fewer
+    uint32_t compression; // a VolumeCompression
+};
+
+/**
+ * A volume read from a Proj3 volume file or a raw file of rows x cols x
+ * sheets voxels (voxel (y, x, z) is at y + rows * (x + cols * z)), in the
+ * host's byte order.
+ * Raw and uncompressed files are memory mapped: the pages are read as the
+ * voxels are first used, and stay in the page cache for the next run.
+ */
+class VolumeFile
+{
+public:
+    VolumeFile();
+    ~VolumeFile();
+
+    /** Whether fileName is a Proj3 volume file */
+    static bool isVolumeFile(const std::string& fileName);
+
+    /**
+     * Open a Proj3 volume file, or a raw file of rows x cols x sheets voxels
+     * of type (which must be at least that large)
+     * @return false (with a message) if it cannot be read
+     */
+    bool open(const std::string& fileName, int rows = 0, int cols = 0, int sheets = 0,
+              VoxelType type = VOXEL_U8);
+
+    /**
+     * Map the voxels, or decompress them with numThreads threads (0 for every
+     * hardware thread)
+     * @return false (with a message) if the file is damaged
+     */
+    bool load(int numThreads = 0);
+
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+    int getSheets() const { return sheets; }
+    VoxelType getVoxelType() const { return type; }
+    size_t getVoxelCount() const { return static_cast<size_t>(rows) * cols * sheets; }
+    size_t getBytes() const { return volumeBytes(rows, cols, sheets, type); }
+    bool isCompressed() const { return compression != VOLUME_UNCOMPRESSED; }
+
+    /** Where the voxels start in an uncompressed file, for reading them as a stream */
+    size_t getDataOffset() const { return dataOffset; }
+
+    /** The voxels' bytes, once loaded; they stay valid and unchanged until this is destroyed */
+    const unsigned char* getVoxels() const { return voxels; }
+
+    /**
+     * Write a Proj3 volume file of rows x cols x sheets voxels of type, in
+     * bricks of brickSheets sheets (0 for bricks of about 4 MB), compressed
+     * with numThreads threads if compress
+     * @return false (with a message) if it cannot be written
+     */
+    static bool write(const std::string& fileName, int rows, int cols, int sheets, VoxelType type,
+                      const unsigned char* voxels, int brickSheets = 0, bool compress = false,
+                      int numThreads = 0);
+
+private:
+    VolumeFile(const VolumeFile&); // cannot be copied
+    VolumeFile& operator=(const VolumeFile&);
+
+    std::string fileName;
+    int fd;
+    int rows, cols, sheets;
+    VoxelType type;
+    int brickSheets;
+    uint32_t compression;
+    size_t dataOffset;
+    size_t fileBytes;
+
+    const unsigned char* voxels;
+    void* mapping;       // the mapped file
+    size_t mappingBytes;
+    std::vector<unsigned char> decompressed;
+};
+
+#endif //EECS690_VOLUMEFILE_HPP
@@ -0,0 +1,64 @@
+#include "Voxel.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+// Voxels are split into this many blocks among the threads
+static const int BLOCKS = 1024;
+
+template <typename T>
+static void windowVoxels(const T* voxels, size_t count, const VoxelFormat& format, unsigned char* out,
+                         int numThreads)
+{
+    parallelFor(BLOCKS, threadCount(numThreads), [&](int begin, int end) {
+        size_t first = count * begin / BLOCKS, last = count * end / BLOCKS;
+        for (size_t i = first; i < last; i++) {
+            out[i] = static_cast<unsigned char>(
+                windowVoxel(static_cast<float>(voxels[i]), format.windowLow, format.windowScale));
+        }
+    });
+}
+
+void windowVolume(const void* voxels, size_t count, const VoxelFormat& format, unsigned char* out,
+                  int numThreads)
+{
+    if (format.type == VOXEL_U8)
+        windowVoxels(static_cast<const unsigned char*>(voxels), count, format, out, numThreads);
+    else if (format.type == VOXEL_U16)
+        windowVoxels(static_cast<const uint16_t*>(voxels), count, format, out, numThreads);
+    else
+        windowVoxels(static_cast<const float*>(voxels), count, format, out, numThreads);
+}
+
+template <typename T>
+static void range(const T* voxels, size_t count, double& low, double& high, int numThreads)
+{
+    int nThreads = threadCount(numThreads);
+    std::vector<double> lows(nThreads, std::numeric_limits<double>::infinity());
+    std::vector<double> highs(nThreads, -std::numeric_limits<double>::infinity());
+    parallelFor(nThreads, nThreads, [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+            size_t first = count * t / nThreads, last = count * (t + 1) / nThreads;
+            for (size_t i = first; i < last; i++) {
+                double v = voxels[i];
+                lows[t] = std::min(lows[t], v); // NaNs are skipped
+                highs[t] = std::max(highs[t], v);
+            }
+        }
+    });
+    low = *std::min_element(lows.begin(), lows.end());
+    high = *std::max_element(highs.begin(), highs.end());
+}
+
+void voxelRange(const void* voxels, size_t count, VoxelType type, double& low, double& high,
+                int numThreads)
+{
+    if (type == VOXEL_U8)
+        range(static_cast<const unsigned char*>(voxels), count, low, high, numThreads);
+    else if (type == VOXEL_U16)
+        range(static_cast<const uint16_t*>(voxels), count, low, high, numThreads);
+    else
+        range(static_cast<const float*>(voxels), count, low, high, numThreads);
+}
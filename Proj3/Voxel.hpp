@@ -0,0 +1,97 @@
+#ifndef EECS690_VOXEL_HPP
+#define EECS690_VOXEL_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+/**
+ * The types of voxel a volume can hold. Projections work on 8 bit values:
+ * other types are windowed to 0-255 (see windowVoxel) as each voxel is read,
+ * on the device by the program built for that type (see ProjectionContext),
+ * so the volume is never converted to 8 bits in a separate pass.
+ */
+enum VoxelType
+{
+    VOXEL_U8,  // unsigned char
+    VOXEL_U16, // unsigned short
+    VOXEL_F32  // float
+};
+
+inline size_t voxelBytes(VoxelType type)
+{
+    return type == VOXEL_U8 ? 1 : type == VOXEL_U16 ? 2 : 4;
+}
+
+/** The bytes of a rows x cols x sheets volume, in size_t: a 2048^3 volume has 2^33 voxels */
+inline size_t volumeBytes(int rows, int cols, int sheets, VoxelType type)
+{
+    return static_cast<size_t>(rows) * cols * sheets * voxelBytes(type);
+}
+
+inline const char* voxelTypeName(VoxelType type)
+{
+    return type == VOXEL_U8 ? "u8" : type == VOXEL_U16 ? "u16" : "f32";
+}
+
+/** Parse "u8", "u16" or "f32" */
+inline bool parseVoxelType(const std::string& name, VoxelType& type)
+{
+    if (name == "u8")
+        type = VOXEL_U8;
+    else if (name == "u16")
+        type = VOXEL_U16;
+    else if (name == "f32")
+        type = VOXEL_F32;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * How voxels become the 0-255 values that are projected. Unless windowed
+ * (which only 8 bit voxels may skip), the window of the given level (its
+ * center) and width maps level - width / 2 to 0 and level + width / 2 to 255,
+ * clamping values outside it.
+ */
+struct VoxelFormat
+{
+    VoxelType type;
+    bool windowed;
+    float windowLow, windowScale; // level - width / 2 and 255 / width
+
+    VoxelFormat() : type(VOXEL_U8), windowed(false), windowLow(0.0f), windowScale(1.0f) {}
+};
+
+inline VoxelFormat windowFormat(VoxelType type, double level, double width)
+{
+    VoxelFormat format;
+    format.type = type;
+    format.windowed = true;
+    format.windowLow = static_cast<float>(level - width / 2);
+    format.windowScale = static_cast<float>(255.0 / width);
+    return format;
+}
+
+/**
+ * A voxel's value through the window. This is the float arithmetic of
+ * voxelValue in MaxKernel.cl, so the devices and the CPU agree exactly.
+ */
+inline unsigned int windowVoxel(float voxel, float windowLow, float windowScale)
+{
+    float scaled = (voxel - windowLow) * windowScale;
+    return static_cast<unsigned int>(std::rint(std::fmin(std::fmax(scaled, 0.0f), 255.0f)));
+}
+
+/**
+ * The 8 bit values of count voxels (as the devices window them), with
+ * numThreads threads (0 for every hardware thread), for the CPU engine
+ */
+void windowVolume(const void* voxels, size_t count, const VoxelFormat& format, unsigned char* out,
+                  int numThreads = 0);
+
+/** The smallest and largest of count voxels of a type, for a default window */
+void voxelRange(const void* voxels, size_t count, VoxelType type, double& low, double& high,
+                int numThreads = 0);
+
+#endif //EECS690_VOXEL_HPP
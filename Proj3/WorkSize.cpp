@@ -0,0 +1,216 @@
+#include "WorkSize.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Work groups larger than this rarely help and limit the number of groups
+// that can be resident at once.
+static const size_t TARGET_GROUP_SIZE = 256;
+
+static size_t roundUp(size_t n, size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+struct KernelLimits
+{
+    size_t groupSize;     // CL_KERNEL_WORK_GROUP_SIZE
+    size_t multiple;      // CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+    size_t itemSizes[3];  // CL_DEVICE_MAX_WORK_ITEM_SIZES
+};
+
+// localBytesPerItem is the local memory each work item of the kernel needs
+static KernelLimits getKernelLimits(cl_kernel kernel, cl_device_id device,
+                                    size_t localBytesPerItem = 0)
+{
+    KernelLimits limits = { 1, 1, { 1, 1, 1 } };
+    clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                             sizeof(size_t), &limits.groupSize, nullptr);
+    clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                             sizeof(size_t), &limits.multiple, nullptr);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES,
+                    sizeof(limits.itemSizes), limits.itemSizes, nullptr);
+    if (localBytesPerItem > 0) {
+        cl_ulong localMem = 0;
+        clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(localMem), &localMem, nullptr);
+        limits.groupSize = std::min<size_t>(limits.groupSize, localMem / localBytesPerItem);
+    }
+    limits.groupSize = std::max<size_t>(limits.groupSize, 1);
+    limits.multiple = std::max<size_t>(limits.multiple, 1);
+    return limits;
+}
+
+static WorkSize makeWorkSize(size_t local0, size_t local1, int outCols, int outRows)
+{
+    WorkSize ws;
+    ws.local[0] = local0;
+    ws.local[1] = local1;
+    ws.global[0] = roundUp(outCols, local0);
+    ws.global[1] = roundUp(outRows, local1);
+    return ws;
+}
+
+WorkSize chooseWorkSize(cl_kernel kernel, cl_device_id device, int outCols, int outRows,
+                        size_t localBytesPerItem)
+{
+    KernelLimits limits = getKernelLimits(kernel, device, localBytesPerItem);
+    size_t maxGroup = std::min(limits.groupSize, TARGET_GROUP_SIZE);
+
+    // Width: the preferred multiple (the SIMD or warp width), widened to at
+    // least 16 so that rows of a group read neighbouring pixels
+    size_t local0 = std::min(limits.multiple, std::min(maxGroup, limits.itemSizes[0]));
+    while (local0 < 16 && local0 * 2 <= std::min(maxGroup, limits.itemSizes[0]))
+        local0 *= 2;
+
+    // Height: fill the rest of the group, but not far past the image
+    size_t local1 = 1;
+    while (local0 * local1 * 2 <= maxGroup && local1 * 2 <= limits.itemSizes[1] &&
+           local1 < static_cast<size_t>(outRows))
+        local1 *= 2;
+
+    return makeWorkSize(local0, local1, outCols, outRows);
+}
+
+static std::string deviceString(cl_device_id device, cl_device_info what)
+{
+    size_t size = 0;
+    clGetDeviceInfo(device, what, 0, nullptr, &size);
+    std::vector<char> buf(size + 1, '\0');
+    clGetDeviceInfo(device, what, size, buf.data(), nullptr);
+    return std::string(buf.data());
+}
+
+// The key of a cache entry: the kernel, the device, and its driver version
+static std::string cacheKey(cl_kernel kernel, cl_device_id device)
+{
+    size_t size = 0;
+    clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, 0, nullptr, &size);
+    std::vector<char> name(size + 1, '\0');
+    clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, size, name.data(), nullptr);
+    return std::string(name.data()) + '|' + deviceString(device, CL_DEVICE_NAME) +
+           '|' + deviceString(device, CL_DRIVER_VERSION);
+}
+
+// Cache lines are: key, tab, local size 0, space, local size 1
+static bool readCache(const std::string& cacheFile, const std::string& key,
+                      size_t& local0, size_t& local1)
+{
+    std::ifstream in(cacheFile);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t tab = line.find('\t');
+        if (tab != std::string::npos && line.compare(0, tab, key) == 0) {
+            std::istringstream sizes(line.substr(tab + 1));
+            return static_cast<bool>(sizes >> local0 >> local1);
+        }
+    }
+    return false;
+}
+
+static void writeCache(const std::string& cacheFile, const std::string& key,
+                       size_t local0, size_t local1)
+{
+    std::vector<std::string> lines;
+    std::ifstream in(cacheFile);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, key.size() + 1, key + '\t') != 0)
+            lines.push_back(line);
+    }
+    in.close();
+    std::ostringstream entry;
+    entry << key << '\t' << local0 << ' ' << local1;
+    lines.push_back(entry.str());
+
+    std::ofstream out(cacheFile);
+    for (const auto& l : lines)
+        out << l << '\n';
+    if (!out)
+        std::cerr << "Could not save work sizes in " << cacheFile << '\n';
+}
+
+WorkSize cachedWorkSize(cl_kernel kernel, cl_device_id device,
+                        int outCols, int outRows, const std::string& cacheFile,
+                        size_t localBytesPerItem)
+{
+    size_t local0, local1;
+    if (readCache(cacheFile, cacheKey(kernel, device), local0, local1)) {
+        KernelLimits limits = getKernelLimits(kernel, device, localBytesPerItem);
+        if (local0 > 0 && local1 > 0 && local0 * local1 <= limits.groupSize &&
+            local0 <= limits.itemSizes[0] && local1 <= limits.itemSizes[1])
+            return makeWorkSize(local0, local1, outCols, outRows);
+    }
+    return chooseWorkSize(kernel, device, outCols, outRows, localBytesPerItem);
+}
+
+// Best of several runs, in milliseconds; negative if the launch fails
+static double timeKernel(cl_command_queue queue, cl_kernel kernel, const WorkSize& ws)
+{
+    const int RUNS = 3;
+    double best = -1.0;
+    for (int run = 0; run <= RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        cl_int status = clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, ws.global, ws.local,
+                                               0, nullptr, nullptr);
+        if (status == CL_SUCCESS)
+            status = clFinish(queue);
+        if (status != CL_SUCCESS)
+            return -1.0;
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        if (run > 0 && (best < 0.0 || ms < best)) // run 0 warms up
+            best = ms;
+    }
+    return best;
+}
+
+WorkSize tuneWorkSize(cl_command_queue queue, cl_kernel kernel, cl_device_id device,
+                      int outCols, int outRows, const std::string& cacheFile,
+                      const std::function<void(const WorkSize&)>& prepare,
+                      size_t localBytesPerItem)
+{
+    KernelLimits limits = getKernelLimits(kernel, device, localBytesPerItem);
+    WorkSize best = chooseWorkSize(kernel, device, outCols, outRows, localBytesPerItem);
+    if (prepare)
+        prepare(best);
+    double bestTime = timeKernel(queue, kernel, best);
+
+    // Widths are multiples of the preferred multiple; heights powers of two
+    for (size_t local0 = limits.multiple; local0 <= limits.itemSizes[0] &&
+         local0 <= limits.groupSize; local0 *= 2) {
+        for (size_t local1 = 1; local1 <= limits.itemSizes[1] &&
+             local0 * local1 <= limits.groupSize; local1 *= 2) {
+            if (local0 * local1 < limits.multiple)
+                continue;
+            WorkSize ws = makeWorkSize(local0, local1, outCols, outRows);
+            if (prepare)
+                prepare(ws);
+            double ms = timeKernel(queue, kernel, ws);
+            if (ms >= 0.0 && (bestTime < 0.0 || ms < bestTime)) {
+                best = ws;
+                bestTime = ms;
+            }
+            if (local1 >= static_cast<size_t>(outRows))
+                break;
+        }
+        if (local0 >= static_cast<size_t>(outCols))
+            break;
+    }
+
+    std::cout << "Tuned local work size: " << best.local[0] << " x " << best.local[1]
+              << " (" << bestTime << " ms)\n";
+    writeCache(cacheFile, cacheKey(kernel, device), best.local[0], best.local[1]);
+    if (prepare)
+        prepare(best);
+    return best;
+}
+
+size_t chooseReductionSize(cl_kernel kernel, cl_device_id device)
+{
+    KernelLimits limits = getKernelLimits(kernel, device);
+    return std::min(TARGET_GROUP_SIZE, std::min(limits.groupSize, limits.itemSizes[0]));
+}
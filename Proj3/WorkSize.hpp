@@ -0,0 +1,61 @@
+#ifndef EECS690_WORKSIZE_HPP
+#define EECS690_WORKSIZE_HPP
+
+#include <functional>
+#include <string>
+
+#ifdef __APPLE__
+    #include <OpenCL/opencl.h>
+
+#else
+    #include <CL/opencl.h>
+#endif
+
+/**
+ * The NDRange for a kernel that computes one image of outCols x outRows
+ * pixels with one work item per pixel. The global size is rounded up to a
+ * multiple of the local size, so kernels must ignore work items outside the
+ * image.
+ */
+struct WorkSize
+{
+    size_t global[2];
+    size_t local[2];
+};
+
+/**
+ * Pick a local size from the limits of the kernel on this device
+ * (CL_KERNEL_WORK_GROUP_SIZE, CL_DEVICE_MAX_WORK_ITEM_SIZES) with a width that
+ * is a multiple of CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE.
+ * If the kernel needs localBytesPerItem bytes of local memory per work item,
+ * the group also fits in CL_DEVICE_LOCAL_MEM_SIZE (this applies to the
+ * functions below as well).
+ */
+WorkSize chooseWorkSize(cl_kernel kernel, cl_device_id device, int outCols, int outRows,
+                        size_t localBytesPerItem = 0);
+
+/**
+ * Time the kernel (whose arguments must already be set) with each candidate
+ * local size and return the fastest. The result is saved in cacheFile.
+ * If given, prepare is called before each launch (and last with the result)
+ * to set any arguments that depend on the work size.
+ */
+WorkSize tuneWorkSize(cl_command_queue queue, cl_kernel kernel, cl_device_id device,
+                      int outCols, int outRows, const std::string& cacheFile,
+                      const std::function<void(const WorkSize&)>& prepare = nullptr,
+                      size_t localBytesPerItem = 0);
+
+/**
+ * The local size saved in cacheFile by tuneWorkSize for this kernel and
+ * device, if there is one, else the one chosen by chooseWorkSize
+ */
+WorkSize cachedWorkSize(cl_kernel kernel, cl_device_id device,
+                        int outCols, int outRows, const std::string& cacheFile,
+                        size_t localBytesPerItem = 0);
+
+/**
+ * The size of the single work group of a one dimensional reduction kernel
+ */
+size_t chooseReductionSize(cl_kernel kernel, cl_device_id device);
+
+#endif //EECS690_WORKSIZE_HPP
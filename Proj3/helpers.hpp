@@ -12,7 +12,7 @@ struct NameTable
     int value;
 };
 
-void reportPlatformInformation(const cl_platform_id& platformIn)
+inline void reportPlatformInformation(const cl_platform_id& platformIn)
 {
     NameTable what[] = {
             { "CL_PLATFORM_PROFILE:    ", CL_PLATFORM_PROFILE },
@@ -48,7 +48,7 @@ void reportPlatformInformation(const cl_platform_id& platformIn)
 // the book "Heterogeneous Computing with OpenCL".
 
 // This function reads in a text file and stores it as a char pointer
-const char* readSource(const char* kernelPath) {
+inline const char* readSource(const char* kernelPath) {
 
     FILE *fp;
     char *source;
@@ -94,7 +94,7 @@ const char* readSource(const char* kernelPath) {
     return source;
 }
 
-void checkStatus(std::string where, cl_int status, bool abortOnError, bool debug)
+inline void checkStatus(std::string where, cl_int status, bool abortOnError, bool debug)
 {
     if (debug || (status != 0))
         std::cout << "Step " << where << ", status = " << status << '\n';
@@ -102,7 +102,7 @@ void checkStatus(std::string where, cl_int status, bool abortOnError, bool debug
         exit(1);
 }
 
-void showProgramBuildLog(cl_program pgm, cl_device_id dev)
+inline void showProgramBuildLog(cl_program pgm, cl_device_id dev)
 {
     size_t size;
     clGetProgramBuildInfo(pgm, dev, CL_PROGRAM_BUILD_LOG, 0, nullptr, &size);
@@ -1,6 +1,14 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <vector>
 
 #ifdef __APPLE__
     #include <OpenCL/opencl.h>
@@ -14,8 +22,18 @@
 #include "ImageWriter.h"
 
 #include "helpers.hpp"
-
-auto devType = CL_DEVICE_TYPE_ALL;
+#include "BrickedProjector.hpp"
+#include "CPUProjector.hpp"
+#include "DeviceGroup.hpp"
+#include "Oblique.hpp"
+#include "Parallel.hpp"
+#include "Profiler.hpp"
+#include "Projection.hpp"
+#include "ProjectionContext.hpp"
+#include "Pyramid.hpp"
+#include "Render.hpp"
+#include "VolumeFile.hpp"
+#include "Voxel.hpp"
 
 void print_platforms(cl_platform_id* p, int count)
 {
@@ -167,274 +185,858 @@ void print_devices(cl_device_id* devices, int deviceCount)
     }
 }
 
+void usage()
+{
+    std::cerr << "Usage: main rows cols sheets voxelFile projectionType outFileName [options]\n"
+              << "       main volumeFile projectionType outFileName [options]\n"
+              << "       main --pack rows cols sheets voxelFile volumeFile [--type TYPE] [--compress]\n"
+              << "                   [--brick SHEETS]\n"
+              << "       main --list-devices\n"
+              << "  voxelFile        raw voxels of --type, at least rows x cols x sheets\n"
+              << "  volumeFile       a volume file written by --pack, which holds its own size;\n"
+              << "                   --compress compresses its bricks of SHEETS sheets\n"
+              << "  projectionType   1 to 6, a list such as 1,3,5, all, or none; with several\n"
+              << "                   views the type (or Angle/Frame) is appended to outFileName\n"
+              << "  --type TYPE      the voxels of a voxelFile: u8 (default), u16 or f32\n"
+              << "  --window LEVEL,WIDTH\n"
+              << "                   project the voxels from LEVEL - WIDTH / 2 to LEVEL + WIDTH / 2\n"
+              << "                   as 0-255 (default for u16 and f32: the volume's range)\n"
+              << "  --cpu            compute the projections on the CPU instead of with OpenCL\n"
+              << "  --check          also compute them on the CPU and compare the results\n"
+              << "  --device DEVICE  the OpenCL device: its index in --list-devices or part\n"
+              << "                   of its name (default: $PROJ3_DEVICE, else the first GPU)\n"
+              << "  --devices LIST   split every view across several devices: all, or a\n"
+              << "                   comma separated list of DEVICEs\n"
+              << "  --tune           time the kernels with each work group size and save the\n"
+              << "                   fastest in worksize.cache for later runs\n"
+              << "  --bench          time each projection type separately and report the rate\n"
+              << "                   at which voxels are read\n"
+              << "  --stream         copy the volume to the device in slabs of sheets while\n"
+              << "                   computing, instead of holding all of it (this is automatic\n"
+              << "                   when the volume does not fit in one device buffer); with\n"
+              << "                   --cpu, project the file a brick at a time instead of\n"
+              << "                   holding all of it\n"
+              << "  --slab SHEETS    stream in slabs of SHEETS sheets\n"
+              << "  --profile FILE   time every OpenCL command and the file and image I/O,\n"
+              << "                   and write the report to FILE as JSON\n"
+              << "  --render MODES   also render each view with the modes in a list of min,\n"
+              << "                   mean, firsthit (depth of the first voxel at or above the\n"
+              << "                   threshold) and composite (alpha compositing)\n"
+              << "  --threshold N    the firsthit threshold, where the default transfer\n"
+              << "                   function becomes opaque (default 64)\n"
+              << "  --tf FILE        the composite transfer function: lines of\n"
+              << "                   value red green blue opacity (0-255)\n"
+              << "  --angle YAW[,PITCH]\n"
+              << "                   also project along an oblique view turned YAW degrees\n"
+              << "                   about the vertical axis and tilted PITCH degrees\n"
+              << "                   (0,0 is type 1); may be given more than once\n"
+              << "  --turntable N[,PITCH]\n"
+              << "                   also project N oblique views turned 360 / N degrees\n"
+              << "                   apart, the frames of a turntable animation\n"
+              << "  --no-images      sample oblique views from a buffer rather than a 3D\n"
+              << "                   image, exactly as the CPU does\n"
+              << "  --level N        project a preview: level N of the volume's mip pyramid,\n"
+              << "                   1 / 2^N the size along each axis, which is built once\n"
+              << "                   and saved next to voxelFile\n"
+              << "  --downsample MODE\n"
+              << "                   how the pyramid combines voxels: max (default) or mean\n"
+              << "  --format FORMAT  write the images as jpeg (default), png or bmp\n"
+              << "  --quality N      the JPEG quality, 0-100 (default 90)\n"
+              << "  --optimize       optimize the JPEG Huffman tables (smaller, slower)\n"
+              << "  --progressive    write progressive JPEGs\n"
+              << "  --png-level N    the PNG zlib level, 0 (store) to 9\n"
+              << "  --png-filter FILTER\n"
+              << "                   the PNG row filters: none, sub, up, avg, paeth or all\n"
+              << "  --png-fast       the fastest PNG settings: level 1 and no row filters\n";
+    exit(1);
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** An image of cols x rows pixels with 1 (gray) or 3 (RGB) channels */
+struct OutputImage
+{
+    std::string fileName;
+    int cols, rows, channels;
+    const unsigned char* img;
+};
+
+/**
+ * Write an image with the encoder options. The writers take RGB, so gray
+ * images are expanded.
+ */
+void writeImage(const OutputImage& out, const ImageWriterOptions& options)
+{
+    const unsigned char* img = out.img;
+    std::vector<unsigned char> rgb;
+    if (out.channels == 1) {
+        size_t pixels = static_cast<size_t>(out.rows) * out.cols;
+        rgb.resize(3 * pixels);
+        for (size_t i = 0; i < pixels; i++)
+            rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = img[i];
+        img = rgb.data();
+    }
+    auto ImgWriter = ImageWriter::create(out.fileName, out.cols, out.rows, 3, options);
+    ImgWriter->writeImage(img);
+    delete ImgWriter;
+}
+
+/**
+ * One projection of the volume and its results. An oblique view (see
+ * Oblique.hpp) has a proj of type 0 with only its size set.
+ */
+struct View
+{
+    std::string label; // the type, or Angle... or Frame... for oblique views
+    Projection proj;
+    bool isOblique;
+    ObliqueView oblique;
+    std::vector<unsigned char> maxImg, sumImg;
+    std::vector<uint64_t> workSum;
+    uint64_t maxSum;
+    std::vector<std::vector<unsigned char>> renders; // one for each --render mode
+};
+
+/** Compute the max image and working sums of a view with the CPU engine */
+void projectOnCPU(const CPUProjector& cpu, const View& view, unsigned char* maxImg,
+                  uint64_t* workSum)
+{
+    if (view.isOblique)
+        cpu.projectOblique(view.oblique, maxImg, workSum);
+    else
+        cpu.project(view.proj, maxImg, workSum);
+}
+
+void renderOnCPU(const CPUProjector& cpu, const View& view, RenderMode mode,
+                 const RenderOptions& options, unsigned char* img)
+{
+    if (view.isOblique)
+        cpu.renderOblique(view.oblique, mode, options, img);
+    else
+        cpu.render(view.proj, mode, options, img);
+}
+
+/**
+ * Parse "a" or "a,b" into first (and second, which is otherwise unchanged)
+ * @return false if it is not numbers
+ */
+bool parseNumbers(const std::string& arg, double& first, double& second)
+{
+    std::istringstream in(arg);
+    char comma;
+    if (!(in >> first))
+        return false;
+    if (in >> comma)
+        return comma == ',' && (in >> second) && in.eof();
+    return true;
+}
+
+/** Parse a --png-filter name */
+bool parsePNGFilters(const std::string& name, ImageWriterOptions::PNGFilters& filters)
+{
+    static const char* const names[] = { "none", "sub", "up", "avg", "paeth", "all" };
+    static const ImageWriterOptions::PNGFilters values[] = {
+        ImageWriterOptions::PNGFiltersNone, ImageWriterOptions::PNGFiltersSub,
+        ImageWriterOptions::PNGFiltersUp, ImageWriterOptions::PNGFiltersAvg,
+        ImageWriterOptions::PNGFiltersPaeth, ImageWriterOptions::PNGFiltersAll };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (name == names[i]) {
+            filters = values[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Parse a projection type argument: a single type, a comma separated list
+ * of types such as "1,3,5", "all" for types 1 through 6, or "none" (for only
+ * oblique views)
+ */
+std::vector<int> parseProjectionTypes(const std::string& arg)
+{
+    std::vector<int> types;
+    if (arg == "none")
+        return types;
+    if (arg == "all") {
+        for (int type = 1; type <= 6; type++)
+            types.push_back(type);
+        return types;
+    }
+    std::istringstream list(arg);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        try {
+            types.push_back(std::stoi(item));
+        }
+        catch (const std::exception&) {
+            std::cerr << "Invalid projection type: " << item << std::endl;
+            exit(1);
+        }
+    }
+    if (types.empty())
+        usage();
+    return types;
+}
+
+/**
+ * Time project(view) a few times for each view, and report the best time and
+ * the rate at which it reads the volume, so that the projection directions
+ * can be compared
+ */
+template <typename F>
+void benchmark(const char* engine, std::vector<View>& views, size_t volumeBytes, F project)
+{
+    const int RUNS = 5;
+    for (auto& view : views) {
+        double best = -1.0;
+        for (int run = 0; run <= RUNS; run++) {
+            auto start = std::chrono::steady_clock::now();
+            project(view);
+            double ms = millisecondsSince(start);
+            if (run > 0 && (best < 0.0 || ms < best)) // run 0 warms up
+                best = ms;
+        }
+        std::cout << engine << " projection " << view.label << ": " << best << " ms, "
+                  << volumeBytes / (best * 1.0e6) << " GB/s\n";
+    }
+}
+
+/**
+ * Report how many values of a and b differ
+ * @return true if they are identical
+ */
+template <typename T>
+bool compareResults(const char* what, const T* a, const T* b, size_t count)
+{
+    size_t differences = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (a[i] != b[i])
+            differences++;
+    }
+    std::cout << what << ": " << differences << " of " << count << " values differ\n";
+    return differences == 0;
+}
+
+/**
+ * main --pack: write a raw volume as a volume file
+ * @return the exit status
+ */
+int packVolume(int argc, char* argv[])
+{
+    if (argc < 7)
+        usage();
+    bool compress = false;
+    int brickSheets = 0;
+    VoxelType type = VOXEL_U8;
+    for (int i = 7; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--type" && i + 1 < argc) {
+            if (!parseVoxelType(argv[++i], type))
+                usage();
+        }
+        else if (option == "--compress")
+            compress = true;
+        else if (option == "--brick" && i + 1 < argc)
+            brickSheets = std::stoi(argv[++i]);
+        else
+            usage();
+    }
 
+    VolumeFile raw;
+    if (!raw.open(argv[5], std::stoi(argv[2]), std::stoi(argv[3]), std::stoi(argv[4]), type) ||
+        !raw.load())
+        return 1;
+    auto start = std::chrono::steady_clock::now();
+    if (!VolumeFile::write(argv[6], raw.getRows(), raw.getCols(), raw.getSheets(), type,
+                           raw.getVoxels(), brickSheets, compress))
+        return 1;
+    std::cout << "Wrote " << argv[6] << " in " << millisecondsSince(start) << " ms\n";
+    return 0;
+}
 
 int main (int argc, char* argv[]) {
 
-    if (argc != 7) {
-        std::cerr << "Invalid parameters\n";
+    if (argc == 2 && std::string(argv[1]) == "--list-devices") {
+        cl_uint numPlatforms = 0;
+        clGetPlatformIDs(0, nullptr, &numPlatforms);
+        auto platforms = new cl_platform_id[numPlatforms];
+        clGetPlatformIDs(numPlatforms, platforms, nullptr);
+        print_platforms(platforms, numPlatforms);
+        delete[] platforms;
+
+        std::vector<cl_device_id> devices = ProjectionContext::allDevices();
+        print_devices(devices.data(), devices.size());
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--pack")
+        return packVolume(argc, argv);
+
+    // A volume file holds its own size, so it is not given
+    bool hasSize = !(argc >= 4 && VolumeFile::isVolumeFile(argv[1]));
+    int firstOption = hasSize ? 7 : 4;
+    if (argc < firstOption) {
+        usage();
+    }
+
+    bool useCPU = false;
+    bool check = false;
+    bool tune = false;
+    bool bench = false;
+    bool stream = false;
+    int slabSheets = 0;
+    std::vector<std::string> deviceSpecs(1, "");
+    std::string profileFile;
+    std::vector<RenderMode> renderModes;
+    int threshold = 64;
+    std::string transferFile;
+    std::vector<std::pair<double, double>> angles; // yaw, pitch
+    int turntableFrames = 0;
+    double turntablePitch = 0.0;
+    bool useImages = true;
+    int level = 0;
+    DownsampleMode downsampleMode = DOWNSAMPLE_MAX;
+    VoxelType voxelType = VOXEL_U8;
+    bool hasType = false;
+    bool hasWindow = false;
+    double windowLevel = 0.0, windowWidth = NAN;
+    std::string imageExtension = ".jpeg";
+    ImageWriterOptions imageOptions;
+    for (int i = firstOption; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format != "jpeg" && format != "png" && format != "bmp")
+                usage();
+            imageExtension = "." + format;
+        }
+        else if (option == "--quality" && i + 1 < argc) {
+            imageOptions.jpegQuality = std::stoi(argv[++i]);
+            if (imageOptions.jpegQuality < 0 || imageOptions.jpegQuality > 100)
+                usage();
+        }
+        else if (option == "--optimize")
+            imageOptions.jpegOptimize = true;
+        else if (option == "--progressive")
+            imageOptions.jpegProgressive = true;
+        else if (option == "--png-level" && i + 1 < argc) {
+            imageOptions.pngLevel = std::stoi(argv[++i]);
+            if (imageOptions.pngLevel < 0 || imageOptions.pngLevel > 9)
+                usage();
+        }
+        else if (option == "--png-filter" && i + 1 < argc) {
+            if (!parsePNGFilters(argv[++i], imageOptions.pngFilters))
+                usage();
+        }
+        else if (option == "--png-fast")
+            imageOptions.pngFast = true;
+        else if (option == "--type" && i + 1 < argc) {
+            if (!parseVoxelType(argv[++i], voxelType))
+                usage();
+            hasType = true;
+        }
+        else if (option == "--window" && i + 1 < argc) {
+            if (!parseNumbers(argv[++i], windowLevel, windowWidth) || !(windowWidth > 0))
+                usage();
+            hasWindow = true;
+        }
+        else if (option == "--cpu")
+            useCPU = true;
+        else if (option == "--check")
+            check = true;
+        else if (option == "--tune")
+            tune = true;
+        else if (option == "--bench")
+            bench = true;
+        else if (option == "--profile" && i + 1 < argc)
+            profileFile = argv[++i];
+        else if (option == "--render" && i + 1 < argc) {
+            if (!parseRenderModes(argv[++i], renderModes))
+                usage();
+        }
+        else if (option == "--threshold" && i + 1 < argc)
+            threshold = std::stoi(argv[++i]);
+        else if (option == "--tf" && i + 1 < argc)
+            transferFile = argv[++i];
+        else if (option == "--angle" && i + 1 < argc) {
+            double yaw, pitch = 0.0;
+            if (!parseNumbers(argv[++i], yaw, pitch))
+                usage();
+            angles.push_back(std::make_pair(yaw, pitch));
+        }
+        else if (option == "--turntable" && i + 1 < argc) {
+            double frames;
+            if (!parseNumbers(argv[++i], frames, turntablePitch) || frames < 1)
+                usage();
+            turntableFrames = static_cast<int>(frames);
+        }
+        else if (option == "--no-images")
+            useImages = false;
+        else if (option == "--level" && i + 1 < argc) {
+            level = std::stoi(argv[++i]);
+            if (level < 0)
+                usage();
+        }
+        else if (option == "--downsample" && i + 1 < argc) {
+            if (!parseDownsampleMode(argv[++i], downsampleMode))
+                usage();
+        }
+        else if (option == "--stream")
+            stream = true;
+        else if (option == "--slab" && i + 1 < argc) {
+            stream = true;
+            slabSheets = std::stoi(argv[++i]);
+        }
+        else if (option == "--device" && i + 1 < argc)
+            deviceSpecs.assign(1, argv[++i]);
+        else if (option == "--devices" && i + 1 < argc) {
+            std::string list = argv[++i];
+            deviceSpecs.clear();
+            if (list == "all") {
+                deviceSpecs = DeviceGroup::allDeviceSpecs();
+            }
+            else {
+                std::istringstream items(list);
+                std::string item;
+                while (std::getline(items, item, ','))
+                    deviceSpecs.push_back(item);
+            }
+            if (deviceSpecs.empty())
+                usage();
+        }
+        else
+            usage();
+    }
+
+    int rows = hasSize ? std::stoi(argv[1]) : 0;
+    int cols = hasSize ? std::stoi(argv[2]) : 0;
+    int sheets = hasSize ? std::stoi(argv[3]) : 0;
+    std::string fileName = argv[firstOption - 3];
+    std::vector<int> projectionTypes = parseProjectionTypes(argv[firstOption - 2]);
+    std::string outFileName = argv[firstOption - 1];
+
+    VolumeFile volumeFile;
+    if (!volumeFile.open(fileName, rows, cols, sheets, voxelType))
         exit(1);
+    if (hasType && volumeFile.getVoxelType() != voxelType) {
+        std::cerr << fileName << " holds " << voxelTypeName(volumeFile.getVoxelType())
+                  << " voxels, not " << voxelTypeName(voxelType) << '\n';
+        exit(1);
+    }
+    rows = volumeFile.getRows();
+    cols = volumeFile.getCols();
+    sheets = volumeFile.getSheets();
+    voxelType = volumeFile.getVoxelType();
+    if (level > 0 && voxelType != VOXEL_U8) {
+        std::cerr << "--level previews are built from unsigned char voxels\n";
+        exit(1);
+    }
+
+    std::unique_ptr<Profiler> profiler;
+    if (!profileFile.empty())
+        profiler.reset(new Profiler());
+
+    // A preview projects a level of the pyramid in place of the volume
+    VolumeLevel preview;
+    if (level > 0) {
+        auto start = std::chrono::steady_clock::now();
+        if (!loadPyramidLevel(fileName, rows, cols, sheets, level, downsampleMode, preview))
+            exit(1);
+        rows = preview.rows;
+        cols = preview.cols;
+        sheets = preview.sheets;
+        std::cout << "Projecting pyramid level " << level << " (" << downsampleModeName(downsampleMode)
+                  << "): " << rows << " x " << cols << " x " << sheets << " voxels\n";
+        if (profiler)
+            profiler->addHost("load pyramid level", millisecondsSince(start), preview.voxels.size());
     }
 
-    int outRows, outCols;
-    int rows = std::stoi(argv[1]);
-    int cols = std::stoi(argv[2]);
-    int sheets = std::stoi(argv[3]);
-    std::string fileName = argv[4];
-    int projectionType = std::stoi(argv[5]);
-    std::string outFileName = argv[6];
+    // Renderings stop once a ray is 99% opaque
+    RenderOptions renderOptions;
+    renderOptions.threshold = threshold;
+    renderOptions.minTransmittance = FULL_TRANSMITTANCE / 100;
+    renderOptions.transfer = defaultTransferFunction(threshold);
+    if (!transferFile.empty() && !loadTransferFunction(transferFile, renderOptions.transfer)) {
+        std::cerr << "Could not read a transfer function from " << transferFile << std::endl;
+        exit(1);
+    }
 
-    // Determine projection size
-    int projSize;
-    if (projectionType == 1 || projectionType == 2) {
-        projSize = rows * cols;
-        outRows = rows;
-        outCols = cols;
+    // Determine projection sizes: the axis aligned views, then the oblique ones
+    std::vector<View> views;
+    for (int type : projectionTypes) {
+        View view;
+        view.label = std::to_string(type);
+        view.isOblique = false;
+        if (!makeProjection(type, rows, cols, sheets, view.proj)) {
+            std::cerr << "Invalid projection type: " << type << std::endl;
+            exit(1);
+        }
+        views.push_back(view);
     }
-    else if (projectionType == 3 || projectionType == 4) {
-        projSize = cols * sheets;
-        outRows = rows;
-        outCols = sheets;
+    for (const auto& angle : angles) {
+        View view;
+        std::ostringstream label;
+        label << "Angle" << angle.first;
+        if (angle.second != 0.0)
+            label << "Pitch" << angle.second;
+        view.label = label.str();
+        view.isOblique = true;
+        double rotation[9];
+        turntableRotation(angle.first, angle.second, rotation);
+        makeObliqueView(rows, cols, sheets, rotation, view.oblique);
+        views.push_back(view);
     }
-    else if (projectionType == 5 || projectionType == 6) {
-        projSize = rows * sheets;
-        outRows = sheets;
-        outCols = cols;
+    std::vector<ObliqueView> frames = turntableViews(rows, cols, sheets, turntableFrames, turntablePitch);
+    for (int f = 0; f < turntableFrames; f++) {
+        View view;
+        char label[32];
+        snprintf(label, sizeof(label), "Frame%03d", f);
+        view.label = label;
+        view.isOblique = true;
+        view.oblique = frames[f];
+        views.push_back(view);
     }
+    if (views.empty())
+        usage();
+
+    for (auto& view : views) {
+        if (view.isOblique) {
+            Projection size = { 0, view.oblique.outRows, view.oblique.outCols, view.oblique.depth,
+                                0, 0, 0, 0 };
+            view.proj = size;
+        }
+        // Sizes are computed in 64 bits: a 2048^3 volume has 2^33 voxels
+        size_t projSize = static_cast<size_t>(view.proj.outRows) * view.proj.outCols;
+        view.maxImg.resize(projSize);
+        view.sumImg.resize(projSize);
+        view.workSum.resize(projSize);
+        view.maxSum = 0;
+        for (RenderMode mode : renderModes)
+            view.renders.push_back(std::vector<unsigned char>(projSize * renderChannels(mode)));
+    }
+    bool anyOblique = !angles.empty() || turntableFrames > 0;
 
-    // Read file
-    auto fileSize = rows * cols * sheets;
-    unsigned char* data;
+    // Open file
+    size_t voxelCount = static_cast<size_t>(rows) * cols * sheets;
+    size_t fileSize = voxelCount * voxelBytes(voxelType);
     std::ifstream file;
-    file.open(fileName);
+    file.open(fileName, std::ios::binary);
+    file.seekg(volumeFile.getDataOffset());
 
     if (file.is_open()) {
-        data = new unsigned char[fileSize];
         std::cout << "Filed opened\n";
-        file.read(reinterpret_cast<char*>(data), fileSize);
-        file.close();
-
     } else {
         std::cerr << "File did not open\n";
         exit(1);
     }
 
-    // Create max, working sum, and sum results arrays
-    auto maxImg = new unsigned char[projSize];
-    auto sumImg = new unsigned char[projSize];
-    auto workSum = new float[projSize];
-
-    // Get platform info
-    cl_uint numPlatforms = 0;
-    cl_int status = clGetPlatformIDs(0, nullptr, &numPlatforms);
-    auto platforms = new cl_platform_id[numPlatforms];
-    status = clGetPlatformIDs(numPlatforms, platforms, nullptr);
-    checkStatus("clGetPlatformIDs", status, true, DEBUG);
-
-    print_platforms(platforms, numPlatforms);
-
-    // Get number of devices for platform 0
-    cl_uint numDevices = 0;
-    status = clGetDeviceIDs(platforms[0], devType, 0, nullptr, &numDevices);
-    checkStatus("clGetDeviceIDs-0", status, true, DEBUG);
-
-    // Create device array
-    auto devices = new cl_device_id[numDevices];
-
-    // Initialize devices for platform 0
-    status = clGetDeviceIDs(platforms[0], devType, numDevices, devices, nullptr);
-    checkStatus("clGetDeviceIDs-0", status, true, DEBUG);
-
-    print_devices(devices, numDevices);
-
-    int device;
-    while (true) {
-        std::cout << "Pick device: ";
-        std::cin >> device;
-        if (0 <= device && device < numDevices)
-            break;
-    }
-
-    // Create context
-    cl_context context = clCreateContext(nullptr, numDevices, devices, nullptr, nullptr, &status);
-    checkStatus("clCreateContext", status, true, DEBUG);
-
-    // Create command queue for specified device
-    cl_command_queue cmdQueue = clCreateCommandQueue(context, devices[device], 0, &status);
-    checkStatus("clCreateCommandQueue", status, true, DEBUG);
-
-    // Create buffer to send image data to kernel
-    auto buffSize = fileSize * sizeof(unsigned char);
-    auto imgBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY, buffSize, nullptr, &status);
-    checkStatus("clCreateBuffer-imgBuffer", status, true, DEBUG);
-
-    // Write image data to buffer
-    status = clEnqueueWriteBuffer(cmdQueue, imgBuffer, CL_FALSE, 0, buffSize, data, 0, nullptr, nullptr);
-    checkStatus("clEnqueueWriteBuffer-imgBuffer", status, true, DEBUG);
-
-    // Create buffer to put max results in
-    auto maxBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, buffSize, nullptr, &status);
-    checkStatus("clCreateBuffer-maxBuffer", status, true, DEBUG);
-
-    // Create sum buffer
-    auto sumBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, buffSize, nullptr, &status);
-    checkStatus("clCreateBuffer-sumBuffer", status, true, DEBUG);
-
-    // Create buffer for working sum buffer
-    auto workBuffSize = projSize * sizeof(float);
-    auto workingBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, workBuffSize, nullptr, &status);
-    checkStatus("clCreateBuffer-workingBuffer", status, true, DEBUG);
-
-    // Get kernel 1
-    const char* programSource[] = { readSource("MaxKernel.cl") };
-    cl_program program = clCreateProgramWithSource(context, 1, programSource, nullptr, &status);
-    checkStatus("clCreateProgramWithSource", status, true, DEBUG);
-
-    status = clBuildProgram(program, numDevices, devices,
-                            nullptr, nullptr, nullptr);
-    if (status != 0)
-        showProgramBuildLog(program, devices[device]);
-    checkStatus("clBuildProgram", status, true, DEBUG);
-
-    // Create Kernel 1
-    cl_kernel kernel = clCreateKernel(program, "MaxKernel", &status);
-    checkStatus("clCreateKernel", status, true, DEBUG);
-
-    // Set Kernel 1 args
-    status = clSetKernelArg(kernel, 0, sizeof(int), &sheets);
-    checkStatus("clSetKernelArg-0", status, true, DEBUG);
-    status = clSetKernelArg(kernel, 1, sizeof(int), &cols);
-    checkStatus("clSetKernelArg-1", status, true, DEBUG);
-    status = clSetKernelArg(kernel, 2, sizeof(int), &rows);
-    checkStatus("clSetKernelArg-2", status, true, DEBUG);
-    status = clSetKernelArg(kernel, 3, sizeof(int), &projectionType);
-    checkStatus("clSetKernelArg-3", status, true, DEBUG);
-    status = clSetKernelArg(kernel, 4, sizeof(cl_mem), &imgBuffer);
-    checkStatus("clSetKernelArg-4", status, true, DEBUG);
-    status = clSetKernelArg(kernel, 5, sizeof(cl_mem), &maxBuffer);
-    checkStatus("clSetKernelArg-5", status, true, DEBUG);
-    status = clSetKernelArg(kernel, 6, sizeof(cl_mem), &workingBuffer);
-    checkStatus("clSetKernelArg-6", status, true, DEBUG);
-
-    /*
-     * Set processing size
-     * TODO: this should be dynamically allocated based on image size and device
-     */
-    size_t global_work_size[] = { 256, 256 };
-    size_t* global_work_offset = nullptr;
-    size_t local_work_size[] = { 32, 32 };
-
-    // Run Kernel 1
-    status = clEnqueueNDRangeKernel(
-            cmdQueue,
-            kernel,
-            2,
-            global_work_offset,
-            global_work_size,
-            local_work_size,
-            0,
-            nullptr,
-            nullptr
-        );
-    checkStatus("clEnqueueNDRangeKernel-1", status, true, DEBUG);
-
-    /*
-     * Read data back
-     * TODO: this is where I seg fault. I've doubled checked sizes and parameters agaisnt
-     * provided examples as well as tried to change the 5th parameter to 'progSize' which
-     * did not cause a seg fault but the max image prints nothing and there is no working
-     * sum max
-    */
-    clEnqueueReadBuffer(cmdQueue, maxBuffer, CL_FALSE, 0, buffSize, maxImg, 0, nullptr, nullptr);
-    clEnqueueReadBuffer(cmdQueue, workingBuffer, CL_FALSE, 0, workBuffSize, workSum, 0, nullptr, nullptr);
-
-    // Block until finished
-    clFinish(cmdQueue);
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
-
-    // Write max image
-    auto ImgWriter = ImageWriter::create(outFileName + "Max.jpeg", outCols, outRows);
-    ImgWriter->writeImage(maxImg);
-    delete ImgWriter;
+    if (!useCPU && ProjectionContext::allDevices().empty()) {
+        std::cout << "No OpenCL devices; using the CPU\n";
+        useCPU = true;
+    }
+    // Every device holds the whole volume; a streamed volume is only
+    // projected on the first
+    std::unique_ptr<DeviceGroup> gpu;
+    if (!useCPU) {
+        gpu.reset(new DeviceGroup(deviceSpecs, tune, DEBUG, profiler.get()));
+        gpu->setUseImages(useImages);
+        size_t maxAlloc = gpu->device(0).getMaxAllocSize();
+        for (size_t d = 1; d < gpu->size(); d++)
+            maxAlloc = std::min(maxAlloc, gpu->device(d).getMaxAllocSize());
+        if (!stream && fileSize > maxAlloc) {
+            std::cout << "The volume is larger than the largest device buffer; streaming it\n";
+            stream = true;
+        }
+        if (stream && gpu->size() > 1)
+            std::cout << "Streaming uses only the first device\n";
+        if (stream && slabSheets <= 0)
+            slabSheets = std::min(sheets, gpu->device(0).chooseSlabSheets(rows, cols, voxelType));
+    }
+    if (stream && (!renderModes.empty() || anyOblique)) {
+        std::cerr << "--render and oblique views need the whole volume in memory, so it "
+                     "cannot be streamed\n";
+        exit(1);
+    }
+    if (stream && volumeFile.isCompressed()) {
+        std::cerr << "A compressed volume file cannot be streamed\n";
+        exit(1);
+    }
+    if (stream && level > 0) {
+        std::cerr << "--level projects a pyramid level held in memory, so it cannot be streamed\n";
+        exit(1);
+    }
 
-    // Find max of working sum
-    float max = 0.00;
-    for (int x = 0; x < outCols; x++) {
-        for (int y = 0; y < outRows; y++) {
-            auto idx = x * cols + y;
-            auto val = workSum[idx];
-            if (val > max) {
-                max = val;
+    // The CPU projects a streamed volume from the file a brick at a time
+    std::unique_ptr<BrickedProjector> bricked;
+    if (useCPU && stream) {
+        bricked.reset(new BrickedProjector(fileName, volumeFile.getDataOffset(), rows, cols, sheets,
+                                           voxelType));
+        if (!bricked->isValid())
+            exit(1);
+    }
+
+    // Map (or decompress) the file, unless it is only streamed (to the device
+    // or through bricks) or a preview is projected
+    const unsigned char* data = nullptr;
+    if (level > 0) {
+        data = preview.voxels.data();
+    }
+    else if (!stream || (check && !useCPU)) {
+        auto start = std::chrono::steady_clock::now();
+        if (!volumeFile.load())
+            exit(1);
+        data = volumeFile.getVoxels();
+        if (profiler) {
+            profiler->addHost(volumeFile.isCompressed() ? "decompress file" : "map file",
+                              millisecondsSince(start), fileSize);
+        }
+    }
+
+    // Voxels other than unsigned char ones are windowed to 0-255, by default
+    // over the volume's whole range
+    VoxelFormat format;
+    if (voxelType != VOXEL_U8 || hasWindow) {
+        if (!hasWindow) {
+            auto start = std::chrono::steady_clock::now();
+            double low, high;
+            if (bricked) {
+                bricked->range(low, high);
             }
+            else {
+                if (data == nullptr) {
+                    if (!volumeFile.load())
+                        exit(1);
+                    data = volumeFile.getVoxels();
+                }
+                voxelRange(data, voxelCount, voxelType, low, high);
+            }
+            if (!std::isfinite(low) || !std::isfinite(high)) {
+                low = 0.0;
+                high = 255.0;
+            }
+            windowLevel = (low + high) / 2;
+            windowWidth = high > low ? high - low : 1.0;
+            if (profiler)
+                profiler->addHost("voxel range", millisecondsSince(start), fileSize);
         }
+        format = windowFormat(voxelType, windowLevel, windowWidth);
+        std::cout << voxelTypeName(voxelType) << " voxels, window level " << windowLevel
+                  << " width " << windowWidth << '\n';
     }
-    std::cout << "Max sum value: " << max << std::endl;
-
-    // Get kernel 2
-    const char* sumSource[] = { readSource("SumKernel.cl") };
-    program = clCreateProgramWithSource(context, 1, sumSource, nullptr, &status);
-    checkStatus("clCreateProgramWithSource", status, true, DEBUG);
-
-    status = clBuildProgram(program, numDevices, devices,
-                            nullptr, nullptr, nullptr);
-    if (status != 0)
-        showProgramBuildLog(program, devices[device]);
-    checkStatus("clBuildProgram", status, true, DEBUG);
-
-    // Create Sum kernel
-    cl_kernel SumKernel = clCreateKernel(program, "SumKernel", &status);
-    checkStatus("clCreateKernel", status, true, DEBUG);
-
-    // Set sum kernel args
-    status = clSetKernelArg(kernel, 0, sizeof(int), &cols);
-    checkStatus("clSetKernelArg-0", status, true, DEBUG);
-    status = clSetKernelArg(kernel, 1, sizeof(float), &max);
-    checkStatus("clSetKernelArg-1", status, true, DEBUG);
-    status = clSetKernelArg(kernel, 2, workBuffSize, &workingBuffer);
-    checkStatus("clSetKernelArg-2", status, true, DEBUG);
-    status = clSetKernelArg(kernel, 3, buffSize, &sumBuffer);
-    checkStatus("clSetKernelArg-3", status, true, DEBUG);
-
-    // Run sum kernel
-    status = clEnqueueNDRangeKernel(
-            cmdQueue,
-            SumKernel,
-            2,
-            global_work_offset,
-            global_work_size,
-            local_work_size,
-            0,
-            nullptr,
-            nullptr
-        );
-    checkStatus("clEnqueueNDRangeKernel-2", status, true, DEBUG);
-
-    // Read back sum image data
-    clEnqueueReadBuffer(cmdQueue, sumBuffer, CL_TRUE, 0, buffSize, sumImg, 0, nullptr, nullptr);
-    clFinish(cmdQueue);
-
-    // Write out image
-    ImgWriter = ImageWriter::create(outFileName + "Sum.jpeg", outCols, outRows);
-    ImgWriter->writeImage(sumImg);
-    delete ImgWriter;
 
-    // Free OpenCL resources
-    clReleaseMemObject(imgBuffer);
-    clReleaseMemObject(maxBuffer);
-    clReleaseMemObject(sumBuffer);
-    clReleaseMemObject(workingBuffer);
-    clReleaseKernel(SumKernel);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(cmdQueue);
-    clReleaseContext(context);
-
-    // Clean up
-    delete[] data;
-    delete[] maxImg;
-    delete[] sumImg;
-    delete[] platforms;
-    delete[] devices;
-    delete[] programSource;
-    delete[] sumSource;
+    // The CPU engine projects 8 bit values, so it is given a windowed copy
+    std::vector<unsigned char> windowed;
+    const unsigned char* cpuData = data;
+    if (format.windowed && (useCPU || check) && !bricked) {
+        auto start = std::chrono::steady_clock::now();
+        windowed.resize(voxelCount);
+        windowVolume(data, voxelCount, format, windowed.data());
+        cpuData = windowed.data();
+        if (profiler)
+            profiler->addHost("window volume", millisecondsSince(start), fileSize);
+    }
+
+    CPUProjector cpu(rows, cols, sheets, cpuData);
+    if (bricked) {
+        // Every view is computed in one pass over the bricks
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Projection> projections;
+        std::vector<unsigned char*> maxImgs;
+        std::vector<uint64_t*> workSums;
+        for (auto& view : views) {
+            projections.push_back(view.proj);
+            maxImgs.push_back(view.maxImg.data());
+            workSums.push_back(view.workSum.data());
+        }
+        bricked->project(projections, format, maxImgs, workSums);
+        for (auto& view : views) {
+            view.maxSum = CPUProjector::normalize(view.workSum.data(), view.workSum.size(),
+                                                  view.sumImg.data());
+        }
+        double ms = millisecondsSince(start);
+        std::cout << "CPU projection in bricks of " << bricked->getBrickSize() << "^3 voxels ("
+                  << bricked->getNumThreads() << " threads): " << ms << " ms\n";
+        if (profiler)
+            profiler->addHost("CPU projection", ms, fileSize);
+
+        if (bench) {
+            benchmark("Bricked CPU", views, fileSize, [&](View& view) {
+                bricked->project(std::vector<Projection>(1, view.proj), format,
+                                 std::vector<unsigned char*>(1, view.maxImg.data()),
+                                 std::vector<uint64_t*>(1, view.workSum.data()));
+                CPUProjector::normalize(view.workSum.data(), view.workSum.size(), view.sumImg.data());
+            });
+        }
+    }
+    else if (useCPU) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto& view : views) {
+            projectOnCPU(cpu, view, view.maxImg.data(), view.workSum.data());
+            view.maxSum = CPUProjector::normalize(view.workSum.data(), view.workSum.size(),
+                                                  view.sumImg.data());
+        }
+        double ms = millisecondsSince(start);
+        std::cout << "CPU projection (" << cpu.getNumThreads() << " threads): " << ms << " ms\n";
+        if (profiler)
+            profiler->addHost("CPU projection", ms, fileSize * views.size());
+
+        if (!renderModes.empty()) {
+            start = std::chrono::steady_clock::now();
+            for (auto& view : views) {
+                for (size_t k = 0; k < renderModes.size(); k++)
+                    renderOnCPU(cpu, view, renderModes[k], renderOptions, view.renders[k].data());
+            }
+            ms = millisecondsSince(start);
+            std::cout << "CPU rendering: " << ms << " ms\n";
+            if (profiler)
+                profiler->addHost("CPU render", ms);
+        }
+
+        if (bench) {
+            benchmark("CPU", views, fileSize, [&cpu](View& view) {
+                projectOnCPU(cpu, view, view.maxImg.data(), view.workSum.data());
+                CPUProjector::normalize(view.workSum.data(), view.workSum.size(), view.sumImg.data());
+            });
+        }
+    }
+    else if (stream) {
+        // Every view is computed in one pass over the file
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Projection> projections;
+        std::vector<ProjectionOutput> outputs;
+        for (auto& view : views) {
+            projections.push_back(view.proj);
+            ProjectionOutput out = { view.maxImg.data(), view.sumImg.data(), &view.maxSum,
+                                     check ? view.workSum.data() : nullptr };
+            outputs.push_back(out);
+        }
+        gpu->device(0).projectStreamed(file, rows, cols, sheets, slabSheets, projections, outputs,
+                                       format);
+        std::cout << "OpenCL projection, streamed in slabs of " << slabSheets << " sheets: "
+                  << millisecondsSince(start) << " ms\n";
+
+        if (bench) {
+            benchmark("Streamed OpenCL", views, fileSize, [&](View& view) {
+                file.clear();
+                file.seekg(volumeFile.getDataOffset());
+                ProjectionOutput out = { view.maxImg.data(), view.sumImg.data(), &view.maxSum, nullptr };
+                gpu->device(0).projectStreamed(file, rows, cols, sheets, slabSheets,
+                                     std::vector<Projection>(1, view.proj),
+                                     std::vector<ProjectionOutput>(1, out), format);
+            });
+        }
+    }
+    else {
+        // The volume is copied to the device once, and every view is queued
+        // behind it before waiting; the oblique views are one sequence of frames
+        auto start = std::chrono::steady_clock::now();
+        gpu->setVolume(rows, cols, sheets, data, true, format);
+        std::vector<ObliqueView> obliqueViews;
+        std::vector<ProjectionOutput> obliqueOutputs;
+        for (auto& view : views) {
+            ProjectionOutput out = { view.maxImg.data(), view.sumImg.data(), &view.maxSum,
+                                     check ? view.workSum.data() : nullptr };
+            for (auto& render : view.renders)
+                out.renders.push_back(render.data());
+            if (view.isOblique) {
+                obliqueViews.push_back(view.oblique);
+                obliqueOutputs.push_back(out);
+                continue;
+            }
+            gpu->enqueueProjection(view.proj, out.maxImg, out.sumImg, out.maxSum, out.workSum);
+            for (size_t k = 0; k < renderModes.size(); k++)
+                gpu->enqueueRender(view.proj, renderModes[k], renderOptions, out.renders[k]);
+        }
+        gpu->projectFrames(obliqueViews, obliqueOutputs, renderModes, renderOptions);
+        std::cout << "OpenCL projection";
+        if (gpu->size() > 1)
+            std::cout << " on " << gpu->size() << " devices";
+        std::cout << ": " << millisecondsSince(start) << " ms\n";
+        if (anyOblique && gpu->obliqueUsesImage())
+            std::cout << "Oblique views are sampled from a 3D image\n";
+
+        if (bench) {
+            benchmark("OpenCL", views, fileSize, [&gpu](View& view) {
+                if (view.isOblique) {
+                    gpu->enqueueOblique(view.oblique, view.maxImg.data(), view.sumImg.data(), &view.maxSum);
+                    gpu->finish();
+                }
+                else {
+                    gpu->project(view.proj, view.maxImg.data(), view.sumImg.data());
+                }
+            });
+        }
+    }
+
+    // Compare against the CPU engine
+    if (!useCPU && check) {
+        bool same = true;
+        for (auto& view : views) {
+            size_t projSize = view.maxImg.size();
+            std::vector<unsigned char> cpuMax(projSize);
+            std::vector<unsigned char> cpuSum(projSize);
+            std::vector<uint64_t> cpuWorkSum(projSize);
+            auto start = std::chrono::steady_clock::now();
+            projectOnCPU(cpu, view, cpuMax.data(), cpuWorkSum.data());
+            CPUProjector::normalize(cpuWorkSum.data(), projSize, cpuSum.data());
+            std::cout << "Projection " << view.label << ": CPU projection ("
+                      << cpu.getNumThreads() << " threads): " << millisecondsSince(start) << " ms\n";
+            same = compareResults("Max image", view.maxImg.data(), cpuMax.data(), projSize) && same;
+            same = compareResults("Working sum", view.workSum.data(), cpuWorkSum.data(), projSize) && same;
+            same = compareResults("Sum image", view.sumImg.data(), cpuSum.data(), projSize) && same;
+            for (size_t k = 0; k < renderModes.size(); k++) {
+                std::vector<unsigned char> cpuRender(view.renders[k].size());
+                renderOnCPU(cpu, view, renderModes[k], renderOptions, cpuRender.data());
+                std::string what = std::string(renderModeName(renderModes[k])) + " image";
+                same = compareResults(what.c_str(), view.renders[k].data(), cpuRender.data(),
+                                      cpuRender.size()) && same;
+            }
+        }
+        std::cout << (same ? "OpenCL and CPU results match\n" : "OpenCL and CPU results DIFFER\n");
+        if (!same && anyOblique && gpu->obliqueUsesImage())
+            std::cout << "(the texture units filter oblique views with their own rounding; "
+                         "--no-images samples them exactly as the CPU does)\n";
+    }
+
+    // Write out images; with several views each name includes the view's
+    // label. The images are encoded at once by a pool of threads.
+    std::vector<OutputImage> images;
+    size_t imageBytes = 0;
+    for (const auto& view : views) {
+        std::cout << "Projection " << view.label << ": max sum value: " << view.maxSum << std::endl;
+        std::string name = outFileName;
+        if (views.size() > 1)
+            name += view.label;
+        int outCols = view.proj.outCols, outRows = view.proj.outRows;
+        images.push_back({ name + "Max" + imageExtension, outCols, outRows, 1, view.maxImg.data() });
+        images.push_back({ name + "Sum" + imageExtension, outCols, outRows, 1, view.sumImg.data() });
+        for (size_t k = 0; k < renderModes.size(); k++) {
+            images.push_back({ name + renderModeName(renderModes[k]) + imageExtension, outCols, outRows,
+                               renderChannels(renderModes[k]), view.renders[k].data() });
+        }
+        imageBytes += view.maxImg.size() + view.sumImg.size();
+        for (const auto& render : view.renders)
+            imageBytes += render.size();
+    }
+    auto start = std::chrono::steady_clock::now();
+    parallelForEach(static_cast<int>(images.size()), threadCount(0), [&](int i) {
+        writeImage(images[i], imageOptions);
+    });
+    double writeMs = millisecondsSince(start);
+    std::cout << "Wrote " << images.size() << " images: " << writeMs << " ms\n";
+    if (profiler)
+        profiler->addHost("write images", writeMs, imageBytes);
+
+    if (profiler) {
+        std::ofstream report(profileFile);
+        profiler->writeJson(report);
+        if (!report)
+            std::cerr << "Could not write the profile to " << profileFile << '\n';
+        else
+            std::cout << "Profile written to " << profileFile << '\n';
+    }
 }